@@ -1,3 +1,15 @@
 CFLAGS = -mlongcalls -DMRBC_DEBUG
 COMPONENT_ADD_INCLUDEDIRS := mrubyc_src
 COMPONENT_SRCDIRS := mrubyc_src mrubyc_src/hal
+
+# features used by the application. (see vm_config.h)
+# keep the same as main/component.mk, mrubyc.h depends on them.
+CFLAGS += -DMRBC_USE_METHOD_CACHE=1 \
+  -DMRBC_USE_ADC=1 \
+  -DMRBC_USE_SCRATCH=1 \
+  -DMRBC_USE_CONSOLE_STREAM=1 \
+  -DMRBC_USE_HEALTH=1
+
+ifdef SCHED_BENCH
+CFLAGS += -DMRBC_USE_TRACE=1 -DMRBC_TRACE_BUFFER_SIZE=1024 -DMRBC_SCHEDULER_EXIT=1
+endif
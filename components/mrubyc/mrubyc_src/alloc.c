@@ -19,6 +19,8 @@
 #include <assert.h>
 #include "vm.h"
 #include "alloc.h"
+#include "runtime.h"
+#include "trace.h"
 #include "hal/hal.h"
 
 
@@ -39,16 +41,6 @@
   9  8000-ffff  8000- 9000- a000- b000- c000- d000- e000- f000-ffff
 */
 
-#ifndef MRBC_ALLOC_FLI_BIT_WIDTH	// 0000 0000 0000 0000
-# define MRBC_ALLOC_FLI_BIT_WIDTH 9	// ~~~~~~~~~~~
-#endif
-#ifndef MRBC_ALLOC_SLI_BIT_WIDTH	// 0000 0000 0000 0000
-# define MRBC_ALLOC_SLI_BIT_WIDTH 3	//            ~~~
-#endif
-#ifndef MRBC_ALLOC_IGNORE_LSBS		// 0000 0000 0000 0000
-# define MRBC_ALLOC_IGNORE_LSBS	  4	//                ~~~~
-#endif
-
 #define FLI(x) ((x) >> MRBC_ALLOC_SLI_BIT_WIDTH)
 #define SLI(x) ((x) & ((1 << MRBC_ALLOC_SLI_BIT_WIDTH) - 1))
 
@@ -110,6 +102,7 @@ typedef struct FREE_BLOCK {
 #define SET_PHYS_PREV(p1,p2) \
   ((p2)->prev_offset = (uint8_t *)(p2)-(uint8_t *)(p1))
 
+#define IS_SCRATCH_BLOCK(p) ((p)->size == 0)
 #define SET_VM_ID(p,id) \
   (((USED_BLOCK *)((uint8_t *)(p) - sizeof(USED_BLOCK)))->vm_id = (id))
 #define GET_VM_ID(p) \
@@ -125,23 +118,21 @@ typedef struct FREE_BLOCK {
 #endif
 
 
-// memory pool
-static uint8_t *memory_pool;
-static MRBC_ALLOC_MEMSIZE_T memory_pool_size;
-
-// free memory block index
-#define SIZE_FREE_BLOCKS \
-  ((MRBC_ALLOC_FLI_BIT_WIDTH + 1) * (1 << MRBC_ALLOC_SLI_BIT_WIDTH))
-static FREE_BLOCK *free_blocks[SIZE_FREE_BLOCKS + 1];
-
-// free memory bitmap
-static uint16_t free_fli_bitmap;
-static uint8_t  free_sli_bitmap[MRBC_ALLOC_FLI_BIT_WIDTH +1+1]; // + sentinel
+// memory pool, free memory block index and bitmap. (see runtime.h)
+#define memory_pool		(mrbc_current_runtime->memory_pool)
+#define memory_pool_size	(mrbc_current_runtime->memory_pool_size)
+#define free_blocks		(mrbc_current_runtime->free_blocks)
+#define free_fli_bitmap		(mrbc_current_runtime->free_fli_bitmap)
+#define free_sli_bitmap		(mrbc_current_runtime->free_sli_bitmap)
 #define MSB_BIT1_FLI 0x8000
 #define MSB_BIT1_SLI 0x80
 #define NLZ_FLI(x) nlz16(x)
 #define NLZ_SLI(x) nlz8(x)
 
+// allocation counters (wrap around 32bit)
+#define alloc_count		(mrbc_current_runtime->alloc_count)
+#define alloc_bytes		(mrbc_current_runtime->alloc_bytes)
+
 
 //================================================================
 /*! Number of leading zeros. 16bit version.
@@ -366,6 +357,61 @@ void mrbc_cleanup_alloc(void)
 }
 
 
+//================================================================
+/*! allocation counters.
+
+  @param  count		(out) number of allocations.
+  @param  bytes		(out) total bytes of allocated blocks.
+  @note   both wrap around 32bit. use the difference of two calls.
+*/
+void mrbc_alloc_counters(uint32_t *count, uint32_t *bytes)
+{
+  *count = alloc_count;
+  *bytes = alloc_bytes;
+}
+
+
+//================================================================
+/*! size of the block header.
+
+  block sizes in the trace (MRBC_TRACE_ALLOC) include it.
+*/
+unsigned int mrbc_alloc_header_size(void)
+{
+  return sizeof(USED_BLOCK);
+}
+
+
+//================================================================
+/*! new capacity of a growing buffer. (String, Array)
+
+  Grows to 1.5 times, or 1.125 times when the largest free block is
+  less than four times of it (near pool exhaustion). At least required.
+  The largest free block is estimated from the FLI bitmap, cheaply.
+
+  @param  capa		current capacity in bytes.
+  @param  required	required capacity in bytes.
+  @return		new capacity in bytes.
+*/
+unsigned int mrbc_alloc_grow_size(unsigned int capa, unsigned int required)
+{
+  unsigned int size = capa + capa / 2 + 8;
+
+  // lower bound of the largest free block.
+  unsigned int largest = 0;
+  int fli;
+  for( fli = MRBC_ALLOC_FLI_BIT_WIDTH; fli > 0; fli-- ) {
+    if( free_fli_bitmap & (MSB_BIT1_FLI >> fli) ) {
+      largest = 1 << (fli - 1 + MRBC_ALLOC_SLI_BIT_WIDTH + MRBC_ALLOC_IGNORE_LSBS);
+      break;
+    }
+  }
+  if( largest < size * 4 ) size = capa + capa / 8 + 8;
+
+  return size < required ? required : size;
+}
+
+
 //================================================================
 /*! allocate memory sub function.
 */
@@ -395,6 +441,10 @@ static void * mrbc_raw_alloc_ff_sub(unsigned int alloc_size, unsigned int index)
           target->size - sizeof(USED_BLOCK) );
 #endif
   target->vm_id = 0;
+  alloc_count++;
+  alloc_bytes += target->size;
+  MRBC_TRACE_ALLOC(MRBC_TRACE_ALLOC, target->size,
+		   (uint8_t *)target - memory_pool);
 
   return (uint8_t *)target + sizeof(USED_BLOCK);
 }
@@ -486,11 +536,260 @@ void * mrbc_raw_alloc(unsigned int size)
           target->size - sizeof(USED_BLOCK) );
 #endif
   target->vm_id = 0;
+  alloc_count++;
+  alloc_bytes += target->size;
+  MRBC_TRACE_ALLOC(MRBC_TRACE_ALLOC, target->size,
+		   (uint8_t *)target - memory_pool);
 
   return (uint8_t *)target + sizeof(USED_BLOCK);
 }
 
 
+#if MRBC_USE_SCRATCH
+/*
+  Scratch arena.
+
+  A task that opened it (VM.scratch) takes its objects from the arena
+  by bumping a pointer, not from TLSF. The arena is two halves, each
+  counts its live objects. A half is rewound wholesale when all its
+  objects are freed (by reference count), and the task switches to
+  the other half when it sleeps, or the current one is full. So the
+  objects of a loop iteration go away with a pointer reset, and an
+  object that lives longer only keeps its half from rewinding. When
+  both halves are busy, objects are taken from TLSF as before.
+
+  Each object has a USED_BLOCK header with size 0 (never a TLSF block),
+  and prev_offset is the offset from the arena, to find it at free.
+*/
+
+//================================================================
+/*!@brief
+  Scratch arena. (one TLSF block)
+*/
+typedef struct SCRATCH {
+  uint16_t half_size;		//!< bytes of each half.
+  uint16_t top[2];		//!< bump offset of each half.
+  uint16_t live[2];		//!< objects alive in each half.
+  uint8_t cur;			//!< current half.
+  uint8_t orphan;		//!< the task ended with live objects.
+  uint32_t count;		//!< objects allocated from the arena.
+  uint8_t data[];
+} mrbc_scratch;
+
+//================================================================
+/*!@brief
+  Header of an object in the arena.
+*/
+typedef struct SCRATCH_BLOCK {
+  uint16_t size;		//!< bytes of the object, aligned.
+  uint16_t dummy;
+  USED_BLOCK hdr;
+} SCRATCH_BLOCK;
+
+#define SCRATCH_OF(b) ((mrbc_scratch *)((uint8_t *)(b) - (b)->prev_offset))
+#define SCRATCH_BLOCK_OF(b) \
+  ((SCRATCH_BLOCK *)((uint8_t *)(b) - offsetof(SCRATCH_BLOCK, hdr)))
+#define SCRATCH_HALF(s,n) ((s)->data + (n) * (s)->half_size)
+
+
+//================================================================
+/*! allocate from the scratch arena.
+
+  @param  s	scratch arena.
+  @param  vm_id	owner.
+  @param  size	request size.
+  @return	pointer, or NULL if no room.
+*/
+static void *scratch_alloc(mrbc_scratch *s, int vm_id, unsigned int size)
+{
+  unsigned int need = sizeof(SCRATCH_BLOCK) + size + (-size & 3);
+  int cur = s->cur;
+
+  if( s->live[cur] == 0 ) s->top[cur] = 0;
+  if( s->top[cur] + need > s->half_size ) {
+    cur ^= 1;
+    if( s->live[cur] != 0 || need > s->half_size ) return NULL;
+    s->cur = cur;
+    s->top[cur] = 0;
+  }
+
+  SCRATCH_BLOCK *b = (SCRATCH_BLOCK *)(SCRATCH_HALF(s, cur) + s->top[cur]);
+  b->size = need - sizeof(SCRATCH_BLOCK);
+  b->hdr.size = 0;
+  SET_USED_BLOCK( &b->hdr );
+  b->hdr.vm_id = vm_id;
+  b->hdr.prev_offset = (uint8_t *)&b->hdr - (uint8_t *)s;
+
+  s->top[cur] += need;
+  s->live[cur]++;
+  s->count++;
+
+  return (uint8_t *)&b->hdr + sizeof(USED_BLOCK);
+}
+
+
+//================================================================
+/*! free an object of the scratch arena.
+
+  @param  hdr	header of the object.
+*/
+static void scratch_free(USED_BLOCK *hdr)
+{
+  mrbc_scratch *s = SCRATCH_OF(hdr);
+  int half = ((uint8_t *)hdr - s->data) / s->half_size;
+
+  SET_FREE_BLOCK( hdr );
+  if( --s->live[half] == 0 ) s->top[half] = 0;
+  if( s->orphan && s->live[0] == 0 && s->live[1] == 0 ) mrbc_raw_free(s);
+}
+
+
+//================================================================
+/*! realloc an object of the scratch arena.
+  grows in place if it is the last object of its half.
+*/
+static void *scratch_realloc(USED_BLOCK *hdr, unsigned int size)
+{
+  mrbc_scratch *s = SCRATCH_OF(hdr);
+  SCRATCH_BLOCK *b = SCRATCH_BLOCK_OF(hdr);
+  uint8_t *ptr = (uint8_t *)hdr + sizeof(USED_BLOCK);
+  int half = ((uint8_t *)hdr - s->data) / s->half_size;
+
+  if( size <= b->size ) return ptr;
+
+  unsigned int grow = size + (-size & 3) - b->size;
+  if( ptr + b->size == SCRATCH_HALF(s, half) + s->top[half] &&
+      s->top[half] + grow <= s->half_size ) {
+    b->size += grow;
+    s->top[half] += grow;
+    return ptr;
+  }
+
+  uint8_t *new_ptr = s->orphan ? NULL : scratch_alloc( s, hdr->vm_id, size );
+  if( !new_ptr ) {
+    new_ptr = mrbc_raw_alloc( size );
+    if( new_ptr == NULL ) return NULL;	// ENOMEM
+    SET_VM_ID( new_ptr, hdr->vm_id );
+  }
+  memcpy( new_ptr, ptr, b->size );
+  scratch_free( hdr );
+
+  return new_ptr;
+}
+
+
+//================================================================
+/*! open the scratch arena of the task.
+
+  @param  vm	pointer to VM.
+  @param  size	bytes of the arena, both halves.
+  @retval 0	No error.
+  @retval -1	error. (ENOMEM, or the arena in use)
+*/
+int mrbc_scratch_open(struct VM *vm, unsigned int size)
+{
+  if( mrbc_scratch_close( vm ) != 0 ) return -1;
+
+  unsigned int half = (size / 2) & ~3;
+  if( half < sizeof(SCRATCH_BLOCK) + 4 || half > 0x7ff0 ) return -1;
+
+  mrbc_scratch *s = mrbc_raw_alloc( sizeof(mrbc_scratch) + half * 2 );
+  if( !s ) return -1;		// ENOMEM
+  SET_VM_ID( s, vm->vm_id );
+
+  memset( s, 0, sizeof(mrbc_scratch) );
+  s->half_size = half;
+  vm->scratch = s;
+
+  return 0;
+}
+
+
+//================================================================
+/*! close the scratch arena of the task.
+
+  @param  vm	pointer to VM.
+  @retval 0	No error.
+  @retval -1	objects in the arena still alive.
+*/
+int mrbc_scratch_close(struct VM *vm)
+{
+  mrbc_scratch *s = vm->scratch;
+  if( !s ) return 0;
+  if( s->live[0] != 0 || s->live[1] != 0 ) return -1;
+
+  vm->scratch = NULL;
+  mrbc_raw_free( s );
+  return 0;
+}
+
+
+//================================================================
+/*! the task ends. discard the objects of the task, same as
+  mrbc_free_all(). the arena is kept until other objects (vm_id 0)
+  are freed.
+
+  @param  vm	pointer to VM.
+*/
+void mrbc_scratch_free_all(struct VM *vm)
+{
+  mrbc_scratch *s = vm->scratch;
+  if( !s ) return;
+
+  int half;
+  for( half = 0; half < 2; half++ ) {
+    uint8_t *p = SCRATCH_HALF(s, half);
+    uint8_t *end = p + s->top[half];
+
+    while( p < end ) {
+      SCRATCH_BLOCK *b = (SCRATCH_BLOCK *)p;
+      if( IS_USED_BLOCK(&b->hdr) && b->hdr.vm_id == vm->vm_id ) {
+	SET_FREE_BLOCK( &b->hdr );
+	s->live[half]--;
+      }
+      p += sizeof(SCRATCH_BLOCK) + b->size;
+    }
+  }
+
+  vm->scratch = NULL;
+  if( s->live[0] == 0 && s->live[1] == 0 ) {
+    mrbc_raw_free( s );
+  } else {
+    s->orphan = 1;
+    SET_VM_ID( s, 0 );		// not freed by mrbc_free_all()
+  }
+}
+
+
+//================================================================
+/*! the task sleeps. start the next objects from an empty half.
+
+  @param  vm	pointer to VM.
+*/
+void mrbc_scratch_rewind(struct VM *vm)
+{
+  mrbc_scratch *s = vm->scratch;
+  if( !s ) return;
+
+  if( s->live[s->cur] != 0 && s->live[s->cur ^ 1] == 0 ) {
+    s->cur ^= 1;
+    s->top[s->cur] = 0;
+  }
+}
+
+
+//================================================================
+/*! number of objects allocated from the arena.
+
+  @param  vm	pointer to VM.
+*/
+uint32_t mrbc_scratch_count(const struct VM *vm)
+{
+  return vm->scratch ? vm->scratch->count : 0;
+}
+#endif
+
+
 //================================================================
 /*! release memory
 
@@ -500,6 +799,14 @@ void mrbc_raw_free(void *ptr)
 {
   // get target block
   FREE_BLOCK *target = (FREE_BLOCK *)((uint8_t *)ptr - sizeof(USED_BLOCK));
+#if MRBC_USE_SCRATCH
+  if( IS_SCRATCH_BLOCK(target) ) {
+    scratch_free( (USED_BLOCK *)target );
+    return;
+  }
+#endif
+  MRBC_TRACE_ALLOC(MRBC_TRACE_FREE, target->size,
+		   (uint8_t *)target - memory_pool);
 
   // check next block, merge?
   FREE_BLOCK *next = (FREE_BLOCK *)PHYS_NEXT(target);
@@ -534,6 +841,9 @@ void mrbc_raw_free(void *ptr)
 void * mrbc_raw_realloc(void *ptr, unsigned int size)
 {
   USED_BLOCK  *target = (USED_BLOCK *)((uint8_t *)ptr - sizeof(USED_BLOCK));
+#if MRBC_USE_SCRATCH
+  if( IS_SCRATCH_BLOCK(target) ) return scratch_realloc( target, size );
+#endif
   unsigned int alloc_size = size + sizeof(USED_BLOCK);
 
   // align 4 byte
@@ -617,6 +927,12 @@ int is_allocated_memory(void *tgt)
 */
 void * mrbc_alloc(const struct VM *vm, unsigned int size)
 {
+#if MRBC_USE_SCRATCH
+  if( vm && vm->scratch ) {
+    void *p = scratch_alloc( vm->scratch, vm->vm_id, size );
+    if( p ) return p;
+  }
+#endif
   uint8_t *ptr = mrbc_raw_alloc(size);
   if( ptr == NULL ) return NULL;	// ENOMEM
   if( vm ) SET_VM_ID(ptr, vm->vm_id);
@@ -676,8 +992,7 @@ int mrbc_get_vm_id(void *ptr)
 
 
 
-#ifdef MRBC_DEBUG
-#include "console.h"
+#if defined(MRBC_DEBUG) || MRBC_USE_HEALTH
 //================================================================
 /*! statistics
 
@@ -711,6 +1026,28 @@ void mrbc_alloc_statistics(int *total, int *used, int *free, int *fragmentation)
 
 
 
+//================================================================
+/*! get the largest free block size
+
+  @return int		allocatable size of the largest free block.
+*/
+int mrbc_alloc_largest_free(void)
+{
+  USED_BLOCK *block = (USED_BLOCK *)memory_pool;
+  int largest = 0;
+
+  while( (uint8_t *)block < (memory_pool + memory_pool_size) ) {
+    if( IS_FREE_BLOCK(block) && block->size > largest ) {
+      largest = block->size;
+    }
+    block = (USED_BLOCK *)PHYS_NEXT(block);
+  }
+
+  return largest ? largest - sizeof(USED_BLOCK) : 0;
+}
+
+
+
 //================================================================
 /*! get used memory size
 
@@ -731,9 +1068,12 @@ int mrbc_alloc_vm_used( int vm_id )
 
   return total;
 }
+#endif
 
 
 
+#ifdef MRBC_DEBUG
+#include "console.h"
 //================================================================
 /*! print memory block for debug.
 
@@ -16,10 +16,28 @@
 #ifndef MRBC_SRC_ALLOC_H_
 #define MRBC_SRC_ALLOC_H_
 
+#include <stdint.h>
+#include "vm_config.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// TLSF parameters. (see alloc.c)
+#ifndef MRBC_ALLOC_FLI_BIT_WIDTH	// 0000 0000 0000 0000
+# define MRBC_ALLOC_FLI_BIT_WIDTH 9	// ~~~~~~~~~~~
+#endif
+#ifndef MRBC_ALLOC_SLI_BIT_WIDTH	// 0000 0000 0000 0000
+# define MRBC_ALLOC_SLI_BIT_WIDTH 3	//            ~~~
+#endif
+#ifndef MRBC_ALLOC_IGNORE_LSBS		// 0000 0000 0000 0000
+# define MRBC_ALLOC_IGNORE_LSBS	  4	//                ~~~~
+#endif
+
+// number of free memory block index
+#define SIZE_FREE_BLOCKS \
+  ((MRBC_ALLOC_FLI_BIT_WIDTH + 1) * (1 << MRBC_ALLOC_SLI_BIT_WIDTH))
+
 struct VM;
 
 void mrbc_init_alloc(void *ptr, unsigned int size);
@@ -32,9 +50,21 @@ void *mrbc_alloc(const struct VM *vm, unsigned int size);
 void mrbc_free_all(const struct VM *vm);
 void mrbc_set_vm_id(void *ptr, int vm_id);
 int mrbc_get_vm_id(void *ptr);
+void mrbc_alloc_counters(uint32_t *count, uint32_t *bytes);
+unsigned int mrbc_alloc_header_size(void);
+unsigned int mrbc_alloc_grow_size(unsigned int capa, unsigned int required);
+
+#if MRBC_USE_SCRATCH
+int mrbc_scratch_open(struct VM *vm, unsigned int size);
+int mrbc_scratch_close(struct VM *vm);
+void mrbc_scratch_free_all(struct VM *vm);
+void mrbc_scratch_rewind(struct VM *vm);
+uint32_t mrbc_scratch_count(const struct VM *vm);
+#endif
 
-// for statistics or debug. (need #define MRBC_DEBUG)
+// for statistics or debug. (need #define MRBC_DEBUG, or MRBC_USE_HEALTH)
 void mrbc_alloc_statistics(int *total, int *used, int *free, int *fragmentation);
+int mrbc_alloc_largest_free(void);
 int mrbc_alloc_vm_used(int vm_id);
 
 
@@ -0,0 +1,276 @@
+/*! @file
+  @brief
+  mruby/c ADC class
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Multi-channel ADC scanner. The HAL calls mrbc_adc_sweep() at the
+  sample rate (hal_adc_start), outside of the VM. A sweep oversamples
+  every channel, and converts the average through the calibration
+  table of the channel, built once by hal_adc_raw_to_mv() when
+  configured. The results are packed into one buffer of millivolts,
+  that Ruby and C read without allocation.
+
+  (e.g.)
+    adc = ADC.new([10, 3], 20, 16)	# channels, Hz, oversample
+    mv = adc[0]				# channel 10, in mV.
+    if adc.seq != last then ... end	# a new sweep?
+
+  Channel numbers are of the HAL. (see hal_adc_open)
+  One scanner at a time, ADC.new reconfigures it.
+  </pre>
+*/
+
+#include "vm_config.h"
+
+#include "value.h"
+#include "alloc.h"
+#include "static.h"
+#include "class.h"
+#include "vm.h"
+#include "c_array.h"
+#include "c_adc.h"
+#include "hal/hal.h"
+
+
+#if MRBC_USE_ADC
+
+#define RAW_MAX ((1 << MRBC_ADC_RAW_BITS) - 1)
+#define LUT_MASK ((1 << MRBC_ADC_LUT_SHIFT) - 1)
+
+
+//================================================================
+/*!@brief
+  Scanner configuration. changed only while stopped.
+*/
+static struct {
+  uint8_t n_channels;
+  uint8_t channel[MRBC_ADC_MAX_CHANNELS];
+  uint16_t oversample;
+  uint16_t lut[MRBC_ADC_MAX_CHANNELS][MRBC_ADC_LUT_SIZE];  //!< raw to mV.
+} scan_;
+
+//================================================================
+/*!@brief
+  Results of the last sweep.
+*/
+static struct {
+  volatile uint32_t seq;	//!< sweep count, odd while writing.
+  volatile uint16_t mv[MRBC_ADC_MAX_CHANNELS];
+} result_;
+
+
+//================================================================
+/*! raw value to mV, by the calibration table.
+*/
+static inline int raw_to_mv(const uint16_t *lut, int raw)
+{
+  int k = raw >> MRBC_ADC_LUT_SHIFT;
+  int f = raw & LUT_MASK;
+
+  return lut[k] + (((lut[k+1] - lut[k]) * f) >> MRBC_ADC_LUT_SHIFT);
+}
+
+
+//================================================================
+/*! configure and start the scanner.
+
+  @param  channels	channel numbers of HAL.
+  @param  n		number of channels.
+  @param  rate_hz	sweeps per second.
+  @param  oversample	samples per channel in a sweep.
+  @retval 0	No error.
+  @retval -1	error. (too many channels, or hal_adc_open failed)
+*/
+int mrbc_adc_configure(const int *channels, int n, int rate_hz, int oversample)
+{
+  if( n < 1 || n > MRBC_ADC_MAX_CHANNELS || rate_hz <= 0 ) return -1;
+  if( oversample < 1 ) oversample = 1;
+
+  hal_adc_start( 0 );		// no sweep from here.
+  scan_.n_channels = 0;
+
+  int i, k;
+  for( i = 0; i < n; i++ ) {
+    if( hal_adc_open( channels[i] ) != 0 ) return -1;
+    scan_.channel[i] = channels[i];
+
+    for( k = 0; k < MRBC_ADC_LUT_SIZE; k++ ) {
+      int raw = k << MRBC_ADC_LUT_SHIFT;
+      scan_.lut[i][k] = hal_adc_raw_to_mv( channels[i], raw > RAW_MAX ? RAW_MAX : raw );
+    }
+  }
+  scan_.n_channels = n;
+  scan_.oversample = oversample;
+
+  // the first sweep here, so values are ready at return.
+  result_.seq = 0;
+  mrbc_adc_sweep();
+
+  return hal_adc_start( rate_hz );
+}
+
+
+//================================================================
+/*! sweep all channels. called from HAL at the sample rate.
+*/
+void mrbc_adc_sweep(void)
+{
+  uint16_t mv[MRBC_ADC_MAX_CHANNELS];
+  int i, j;
+
+  for( i = 0; i < scan_.n_channels; i++ ) {
+    uint32_t sum = 0;
+    for( j = 0; j < scan_.oversample; j++ ) {
+      sum += hal_adc_read_raw( scan_.channel[i] );
+    }
+    mv[i] = raw_to_mv( scan_.lut[i],
+		       (sum + scan_.oversample / 2) / scan_.oversample );
+  }
+
+  // publish, as a seqlock.
+  result_.seq++;
+  __sync_synchronize();
+  for( i = 0; i < scan_.n_channels; i++ ) result_.mv[i] = mv[i];
+  __sync_synchronize();
+  result_.seq++;
+}
+
+
+//================================================================
+/*! result of the channel.
+
+  @param  idx	index in the channel list.
+  @return	mV, or -1 if no channel.
+*/
+int mrbc_adc_value(int idx)
+{
+  if( idx < 0 || idx >= scan_.n_channels ) return -1;
+  return result_.mv[idx];
+}
+
+
+//================================================================
+/*! number of sweeps since configured.
+*/
+uint32_t mrbc_adc_seq(void)
+{
+  return result_.seq / 2;
+}
+
+
+//================================================================
+/*! (method) new(channels, rate_hz = 10, oversample = 16)
+*/
+static void c_adc_new(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 1 || GET_TT_ARG(1) != MRBC_TT_ARRAY ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  int rate_hz = 10;
+  int oversample = 16;
+  if( argc >= 2 && GET_TT_ARG(2) == MRBC_TT_FIXNUM ) rate_hz = GET_INT_ARG(2);
+  if( argc >= 3 && GET_TT_ARG(3) == MRBC_TT_FIXNUM ) oversample = GET_INT_ARG(3);
+
+  int channels[MRBC_ADC_MAX_CHANNELS];
+  int n = mrbc_array_size( &v[1] );
+  int i;
+  for( i = 0; i < n && i < MRBC_ADC_MAX_CHANNELS; i++ ) {
+    mrbc_value ch = mrbc_array_get( &v[1], i );
+    if( ch.tt != MRBC_TT_FIXNUM ) break;
+    channels[i] = ch.i;
+  }
+  if( i != n || mrbc_adc_configure( channels, n, rate_hz, oversample ) != 0 ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  *v = mrbc_instance_new(vm, v->cls, 0);
+}
+
+
+//================================================================
+/*! (method) [](idx)  => mV
+*/
+static void c_adc_get(struct VM *vm, mrbc_value v[], int argc)
+{
+  int mv = -1;
+  if( argc >= 1 && GET_TT_ARG(1) == MRBC_TT_FIXNUM ) mv = mrbc_adc_value( GET_INT_ARG(1) );
+
+  if( mv < 0 ) {
+    SET_NIL_RETURN();
+  } else {
+    SET_INT_RETURN( mv );
+  }
+}
+
+
+//================================================================
+/*! (method) values  => [mV, ...] of one sweep.
+*/
+static void c_adc_values(struct VM *vm, mrbc_value v[], int argc)
+{
+  int n = scan_.n_channels;
+  uint16_t mv[MRBC_ADC_MAX_CHANNELS];
+  uint32_t seq;
+  int i;
+
+  do {
+    seq = result_.seq;
+    __sync_synchronize();
+    for( i = 0; i < n; i++ ) mv[i] = result_.mv[i];
+    __sync_synchronize();
+  } while( (seq & 1) || seq != result_.seq );
+
+  mrbc_value ret = mrbc_array_new( vm, n );
+  if( !ret.array ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  for( i = 0; i < n; i++ ) {
+    mrbc_value val = mrbc_fixnum_value( mv[i] );
+    mrbc_array_set( &ret, i, &val );
+  }
+  SET_RETURN( ret );
+}
+
+
+//================================================================
+/*! (method) seq  number of sweeps.
+*/
+static void c_adc_seq(struct VM *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN( mrbc_adc_seq() );
+}
+
+
+//================================================================
+/*! (method) size  number of channels.
+*/
+static void c_adc_size(struct VM *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN( scan_.n_channels );
+}
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_adc(struct VM *vm)
+{
+  mrbc_class *cls = mrbc_define_class(vm, "ADC", mrbc_class_object);
+
+  mrbc_define_method(vm, cls, "new", c_adc_new);
+  mrbc_define_method(vm, cls, "[]", c_adc_get);
+  mrbc_define_method(vm, cls, "values", c_adc_values);
+  mrbc_define_method(vm, cls, "seq", c_adc_seq);
+  mrbc_define_method(vm, cls, "size", c_adc_size);
+}
+
+
+#endif  // MRBC_USE_ADC
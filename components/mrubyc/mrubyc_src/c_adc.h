@@ -0,0 +1,42 @@
+/*! @file
+  @brief
+  mruby/c ADC class
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_C_ADC_H_
+#define MRBC_SRC_C_ADC_H_
+
+#include <stdint.h>
+#include "vm_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if MRBC_USE_ADC
+struct VM;
+
+#define MRBC_ADC_RAW_BITS 12
+#define MRBC_ADC_LUT_SHIFT 6		//!< raw counts per LUT step, as shift.
+#define MRBC_ADC_LUT_SIZE ((1 << (MRBC_ADC_RAW_BITS - MRBC_ADC_LUT_SHIFT)) + 1)
+
+int mrbc_adc_configure(const int *channels, int n, int rate_hz, int oversample);
+int mrbc_adc_value(int idx);
+uint32_t mrbc_adc_seq(void);
+void mrbc_adc_sweep(void);
+void mrbc_init_class_adc(struct VM *vm);
+#endif
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
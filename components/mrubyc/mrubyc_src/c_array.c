@@ -150,6 +150,58 @@ int mrbc_array_resize(mrbc_value *ary, int size)
 }
 
 
+//================================================================
+/*! grow buffer geometrically, to store size values.
+
+  @param  ary	pointer to target value
+  @param  size	required size
+  @return	mrbc_error_code
+*/
+static int array_grow(mrbc_value *ary, int size)
+{
+  mrbc_array *h = ary->array;
+  if( size <= h->data_size ) return 0;
+
+  int n = mrbc_alloc_grow_size( sizeof(mrbc_value) * h->data_size,
+				sizeof(mrbc_value) * size ) / sizeof(mrbc_value);
+  if( n > UINT16_MAX ) n = UINT16_MAX;
+  if( n < size ) return E_NOMEMORY_ERROR;
+
+  if( mrbc_array_resize(ary, n) == 0 ) return 0;
+  return mrbc_array_resize(ary, size);	// retry without a margin.
+}
+
+
+//================================================================
+/*! reserve buffer capacity
+
+  @param  ary	pointer to target value
+  @param  size	capacity
+  @return	mrbc_error_code
+*/
+int mrbc_array_reserve(mrbc_value *ary, int size)
+{
+  if( size <= ary->array->data_size ) return 0;
+  if( size > UINT16_MAX ) return E_NOMEMORY_ERROR;
+
+  return mrbc_array_resize(ary, size);
+}
+
+
+//================================================================
+/*! shrink buffer capacity to the number of stored values
+
+  @param  ary	pointer to target value
+*/
+void mrbc_array_shrink_to_fit(mrbc_value *ary)
+{
+  mrbc_array *h = ary->array;
+  if( h->n_stored == h->data_size ) return;
+
+  mrbc_array_resize(ary, h->n_stored);	// shrink never fails.
+}
+
+
 //================================================================
 /*! setter
 
@@ -168,7 +220,7 @@ int mrbc_array_set(mrbc_value *ary, int idx, mrbc_value *set_val)
   }
 
   // need resize?
-  if( idx >= h->data_size && mrbc_array_resize(ary, idx + 1) != 0 ) {
+  if( array_grow(ary, idx + 1) != 0 ) {
     return E_NOMEMORY_ERROR;			// ENOMEM
   }
 
@@ -219,10 +271,8 @@ int mrbc_array_push(mrbc_value *ary, mrbc_value *set_val)
 {
   mrbc_array *h = ary->array;
 
-  if( h->n_stored >= h->data_size ) {
-    int size = h->data_size + 6;
-    if( mrbc_array_resize(ary, size) != 0 )
-      return E_NOMEMORY_ERROR;		// ENOMEM
+  if( array_grow(ary, h->n_stored + 1) != 0 ) {
+    return E_NOMEMORY_ERROR;		// ENOMEM
   }
 
   h->data[h->n_stored++] = *set_val;
@@ -296,13 +346,8 @@ int mrbc_array_insert(mrbc_value *ary, int idx, mrbc_value *set_val)
   }
 
   // need resize?
-  int size = 0;
-  if( idx >= h->data_size ) {
-    size = idx + 1;
-  } else if( h->n_stored >= h->data_size ) {
-    size = h->data_size + 1;
-  }
-  if( size && mrbc_array_resize(ary, size) != 0 ) {
+  int size = (idx >= h->n_stored) ? idx + 1 : h->n_stored + 1;
+  if( array_grow(ary, size) != 0 ) {
     return E_NOMEMORY_ERROR;			// ENOMEM
   }
 
@@ -38,6 +38,8 @@ mrbc_value mrbc_array_new(struct VM *vm, int size);
 void mrbc_array_delete(mrbc_value *ary);
 void mrbc_array_clear_vm_id(mrbc_value *ary);
 int mrbc_array_resize(mrbc_value *ary, int size);
+int mrbc_array_reserve(mrbc_value *ary, int size);
+void mrbc_array_shrink_to_fit(mrbc_value *ary);
 int mrbc_array_set(mrbc_value *ary, int idx, mrbc_value *set_val);
 mrbc_value mrbc_array_get(const mrbc_value *ary, int idx);
 int mrbc_array_push(mrbc_value *ary, mrbc_value *set_val);
@@ -0,0 +1,87 @@
+/*! @file
+  @brief
+  mruby/c Benchmark class
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  (e.g.)
+    r = Benchmark.measure { 100.times { |i| s = i.to_s } }
+    # => {:cycles=>1234567, :micros=>5144, :allocs=>200, :bytes=>3200}
+
+  allocs and bytes include two call frames of the block.
+  cycles are CPU cycles (hal_cycles), wrap around 32bit.
+  </pre>
+*/
+
+#include "vm_config.h"
+
+#include "value.h"
+#include "alloc.h"
+#include "static.h"
+#include "class.h"
+#include "vm.h"
+#include "symbol.h"
+#include "c_hash.h"
+#include "hal/hal.h"
+
+
+#if MRBC_USE_BENCHMARK
+
+//================================================================
+/*! set a result item.
+*/
+static void set_item(mrbc_value *hash, const char *key, uint32_t value)
+{
+  mrbc_value k = {.tt = MRBC_TT_SYMBOL};
+  mrbc_value v = mrbc_fixnum_value( value );
+
+  k.i = str_to_symid( key );
+  mrbc_hash_set( hash, &k, &v );
+}
+
+
+//================================================================
+/*! (method) measure { ... }
+*/
+static void c_benchmark_measure(struct VM *vm, mrbc_value v[], int argc)
+{
+  uint32_t count0, bytes0, count1, bytes1;
+
+  mrbc_alloc_counters( &count0, &bytes0 );
+  uint32_t micros0 = hal_micros();
+  uint32_t cycles0 = hal_cycles();
+
+  mrbc_value ret = mrbc_yield_block( vm, v, argc + 1 );
+
+  uint32_t cycles1 = hal_cycles();
+  uint32_t micros1 = hal_micros();
+  mrbc_alloc_counters( &count1, &bytes1 );
+  mrbc_release( &ret );
+
+  mrbc_value result = mrbc_hash_new( vm, 4 );
+  if( result.hash == NULL ) return;	// ENOMEM
+  set_item( &result, "cycles", cycles1 - cycles0 );
+  set_item( &result, "micros", micros1 - micros0 );
+  set_item( &result, "allocs", count1 - count0 );
+  set_item( &result, "bytes",  bytes1 - bytes0 );
+
+  SET_RETURN( result );
+}
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_benchmark(struct VM *vm)
+{
+  mrbc_class *cls = mrbc_define_class(vm, "Benchmark", mrbc_class_object);
+
+  mrbc_define_method(vm, cls, "measure", c_benchmark_measure);
+}
+
+
+#endif  // MRBC_USE_BENCHMARK
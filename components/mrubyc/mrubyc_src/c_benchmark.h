@@ -0,0 +1,28 @@
+/*! @file
+  @brief
+  mruby/c Benchmark class
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_C_BENCHMARK_H_
+#define MRBC_SRC_C_BENCHMARK_H_
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mrbc_init_class_benchmark(struct VM *vm);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,533 @@
+/*! @file
+  @brief
+  mruby/c I2C and SPI class
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Bulk transfers on I2C and SPI buses. The backend works on a buffer
+  owned by the transfer, and the received data is copied into the String
+  given by the caller on completion. A transfer in progress at timeout
+  keeps the buffer until the backend completes, so it never writes into
+  a String that may have been resized or freed. Transfers
+  of the tasks sharing a bus are queued and run one by one. The calling
+  task is blocked (see mrbc_cfunc_block) until the backend calls
+  mrbc_bus_complete(), other tasks run meanwhile.
+
+  (e.g.)
+    i2c = I2C.new(0, 100_000)		# bus, frequency
+    buf = String.new(capacity: 18)
+    i2c.write(0x61, "\x03\x00")		# => 2, or nil if error.
+    i2c.read(0x61, buf, 18)		# => buf of 18 bytes, or nil.
+    i2c.write_read(0x76, "\xF7", buf, 8)	# register read.
+
+    spi = SPI.new(1, 5, 1_000_000, 0)	# bus, CS, frequency, mode
+    spi.write_read("\xD0", buf, 1)	# tx, then rx with CS held.
+    spi.transfer("\x9F\x00\x00", buf)	# full duplex.
+    spi.timeout = 50			# ms, 0 is wait forever.
+
+  </pre>
+*/
+
+#include "vm_config.h"
+#include <string.h>
+
+#include "value.h"
+#include "alloc.h"
+#include "static.h"
+#include "class.h"
+#include "vm.h"
+#include "c_string.h"
+#include "c_bus.h"
+#include "rrt0.h"
+#include "hal/hal.h"
+
+
+#if MRBC_USE_BUS
+
+enum {
+  XFER_FREE = 0,
+  XFER_QUEUED,
+  XFER_ACTIVE,
+  XFER_DONE,
+};
+
+
+//================================================================
+/*!@brief
+  Transfer queue of a bus.
+*/
+typedef struct RBusQueue {
+  uint8_t type;			//!< 0 is unused slot.
+  uint8_t bus;
+  const mrbc_bus_backend *backend;
+  mrbc_bus_xfer *head;		//!< transfer in progress.
+  mrbc_bus_xfer *tail;
+} mrbc_bus_queue;
+
+//================================================================
+/*!@brief
+  I2C or SPI instance.
+*/
+typedef struct RBusDevice {
+  mrbc_bus_queue *q;
+  uint16_t addr;		//!< SPI chip select.
+  uint32_t timeout_ms;		//!< 0 is wait forever.
+} mrbc_bus_device;
+
+static const mrbc_bus_backend hal_backend_ = { hal_bus_open, hal_bus_start };
+static mrbc_bus_queue queue_[MRBC_BUS_MAX];
+static mrbc_bus_xfer xfer_[MRBC_BUS_QUEUE_SIZE];
+
+
+//================================================================
+/*! get device from self.
+*/
+static inline mrbc_bus_device *get_device(const mrbc_value v[])
+{
+  return (mrbc_bus_device *)v[0].instance->data;
+}
+
+
+//================================================================
+/*! find the queue of the bus, or make it.
+*/
+static mrbc_bus_queue *find_queue(int type, int bus, int flag_create)
+{
+  mrbc_bus_queue *q = NULL;
+  int i;
+  for( i = 0; i < MRBC_BUS_MAX; i++ ) {
+    if( queue_[i].type == type && queue_[i].bus == bus ) return &queue_[i];
+    if( queue_[i].type == 0 && q == NULL ) q = &queue_[i];
+  }
+  if( !flag_create || q == NULL ) return NULL;
+
+  q->type = type;
+  q->bus = bus;
+  q->backend = &hal_backend_;
+  return q;
+}
+
+
+//================================================================
+/*! free the transfers completed after timeout.
+*/
+static void xfer_reap(void)
+{
+  int i;
+  for( i = 0; i < MRBC_BUS_QUEUE_SIZE; i++ ) {
+    mrbc_bus_xfer *x = &xfer_[i];
+    if( x->state != XFER_DONE || x->waiter != NULL ) continue;
+
+    mrbc_raw_free( x->buf );
+    mrbc_release( &x->rx_str );
+    x->state = XFER_FREE;
+  }
+}
+
+
+//================================================================
+/*! get a free transfer.
+*/
+static mrbc_bus_xfer *xfer_alloc(void)
+{
+  int i;
+
+  xfer_reap();
+  for( i = 0; i < MRBC_BUS_QUEUE_SIZE; i++ ) {
+    mrbc_bus_xfer *x = &xfer_[i];
+    if( x->state != XFER_FREE ) continue;
+
+    memset( x, 0, sizeof(mrbc_bus_xfer) );
+    x->rx_str.tt = MRBC_TT_NIL;
+    return x;
+  }
+  return NULL;
+}
+
+
+//================================================================
+/*! start the transfer at the head of queue.
+*/
+static void xfer_start(mrbc_bus_queue *q, mrbc_bus_xfer *x)
+{
+  if( q->backend->start( x ) != 0 ) mrbc_bus_complete( x, -1 );
+}
+
+
+//================================================================
+/*! add the transfer to the queue, and start if the bus is idle.
+*/
+static void xfer_enqueue(mrbc_bus_queue *q, mrbc_bus_xfer *x)
+{
+  hal_disable_irq();
+  x->next = NULL;
+  int flag_idle = (q->head == NULL);
+  if( flag_idle ) {
+    x->state = XFER_ACTIVE;
+    q->head = x;
+  } else {
+    x->state = XFER_QUEUED;
+    q->tail->next = x;
+  }
+  q->tail = x;
+  hal_enable_irq();
+
+  if( flag_idle ) xfer_start( q, x );
+}
+
+
+//================================================================
+/*! remove the transfer waiting in the queue. (timeout)
+*/
+static void xfer_dequeue(mrbc_bus_queue *q, mrbc_bus_xfer *x)
+{
+  mrbc_bus_xfer *p = q->head;
+  while( p != NULL && p->next != x ) p = p->next;
+  if( p == NULL ) return;
+
+  p->next = x->next;
+  if( q->tail == x ) q->tail = p;
+  x->state = XFER_DONE;
+}
+
+
+//================================================================
+/*! continuation of transfer methods.
+*/
+static void bus_resume(struct VM *vm, mrbc_value v[], void *state)
+{
+  mrbc_bus_xfer *x = (mrbc_bus_xfer *)state;
+  uint32_t elapsed_ms = (hal_micros() - x->start_us) / 1000;
+
+  hal_disable_irq();
+  int flag_done = (x->state == XFER_DONE);
+  int flag_timeout = !flag_done && x->timeout_ms != 0 &&
+    elapsed_ms >= x->timeout_ms;
+  if( flag_timeout && x->state == XFER_QUEUED ) {
+    xfer_dequeue( find_queue(x->type, x->bus, 0), x );
+  }
+  if( flag_done || flag_timeout ) x->waiter = NULL;
+  hal_enable_irq();
+
+  if( !flag_done && !flag_timeout ) {	// woken up by other reason.
+    mrbc_cfunc_block( vm, v, bus_resume, x,
+		      x->timeout_ms ? x->timeout_ms - elapsed_ms : 0 );
+    return;
+  }
+
+  // the transfer in progress at timeout is freed after completion.
+  if( flag_timeout || x->result < 0 ) {
+    SET_NIL_RETURN();
+  } else if( x->rx_str.tt == MRBC_TT_STRING ) {
+    if( mrbc_string_reserve( &x->rx_str, x->rx_len ) != 0 ) {
+      SET_NIL_RETURN();		// ENOMEM
+    } else {
+      mrbc_string *h = x->rx_str.string;
+      memcpy( h->data, x->rx, x->rx_len );
+      h->size = x->rx_len;
+      h->data[h->size] = '\0';
+      mrbc_dup( &x->rx_str );
+      SET_RETURN( x->rx_str );
+    }
+  } else {
+    SET_INT_RETURN( x->result );
+  }
+
+  xfer_reap();
+}
+
+
+//================================================================
+/*! submit a transfer and block.
+
+  @param  tx	index of tx String in v[], or 0.
+  @param  rx	index of rx String in v[], or 0.
+  @param  len	length of rx.
+*/
+static void bus_transfer(struct VM *vm, mrbc_value v[], int addr, int tx, int rx, int len, int flags)
+{
+  mrbc_bus_device *dev = get_device(v);
+
+  if( (tx && v[tx].tt != MRBC_TT_STRING) ||
+      (rx && (v[rx].tt != MRBC_TT_STRING || len <= 0)) ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  mrbc_bus_xfer *x = xfer_alloc();
+  if( !x ) {
+    SET_NIL_RETURN();		// too many transfers.
+    return;
+  }
+  int tx_len = tx ? v[tx].string->size : 0;
+  int rx_len = rx ? len : 0;
+  x->buf = mrbc_raw_alloc( tx_len + rx_len + 1 );
+  if( !x->buf ) {
+    SET_NIL_RETURN();		// ENOMEM
+    return;
+  }
+
+  x->type = dev->q->type;
+  x->bus = dev->q->bus;
+  x->flags = flags;
+  x->addr = addr;
+  if( tx ) memcpy( x->buf, v[tx].string->data, tx_len );
+  x->tx = x->buf;
+  x->tx_len = tx_len;
+  x->rx = x->buf + tx_len;
+  x->rx_len = rx_len;
+  if( rx ) {
+    x->rx_str = v[rx];
+    mrbc_dup( &x->rx_str );
+  }
+  x->waiter = vm;
+  x->start_us = hal_micros();
+  x->timeout_ms = dev->timeout_ms;
+
+  // block first, so that the completion inside enqueue can wake up.
+  mrbc_cfunc_block( vm, v, bus_resume, x, dev->timeout_ms );
+  xfer_enqueue( dev->q, x );
+}
+
+
+//================================================================
+/*! open the bus and make an instance.
+*/
+static void bus_new(struct VM *vm, mrbc_value v[], int type, int bus, int addr, uint32_t freq, int mode)
+{
+  mrbc_bus_queue *q = find_queue( type, bus, 1 );
+  if( q == NULL || q->backend->open( type, bus, addr, freq, mode ) != 0 ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  *v = mrbc_instance_new(vm, v->cls, sizeof(mrbc_bus_device));
+  if( !v->instance ) return;
+
+  mrbc_bus_device *dev = get_device(v);
+  dev->q = q;
+  dev->addr = addr;
+  dev->timeout_ms = MRBC_BUS_TIMEOUT_MS;
+}
+
+
+//================================================================
+/*! (method) I2C.new(bus = 0, frequency = 100_000)
+*/
+static void c_i2c_new(struct VM *vm, mrbc_value v[], int argc)
+{
+  int bus = 0;
+  uint32_t freq = 100000;
+  if( argc >= 1 && GET_TT_ARG(1) == MRBC_TT_FIXNUM ) bus = GET_INT_ARG(1);
+  if( argc >= 2 && GET_TT_ARG(2) == MRBC_TT_FIXNUM ) freq = GET_INT_ARG(2);
+
+  bus_new( vm, v, MRBC_BUS_I2C, bus, 0, freq, 0 );
+}
+
+
+//================================================================
+/*! (method) I2C#write(addr, str)
+*/
+static void c_i2c_write(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 2 || GET_TT_ARG(1) != MRBC_TT_FIXNUM ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  bus_transfer( vm, v, GET_INT_ARG(1), 2, 0, 0, 0 );
+}
+
+
+//================================================================
+/*! (method) I2C#read(addr, buf, len)
+*/
+static void c_i2c_read(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 3 || GET_TT_ARG(1) != MRBC_TT_FIXNUM ||
+      GET_TT_ARG(3) != MRBC_TT_FIXNUM ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  bus_transfer( vm, v, GET_INT_ARG(1), 0, 2, GET_INT_ARG(3), 0 );
+}
+
+
+//================================================================
+/*! (method) I2C#write_read(addr, tx, buf, len)
+*/
+static void c_i2c_write_read(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 4 || GET_TT_ARG(1) != MRBC_TT_FIXNUM ||
+      GET_TT_ARG(4) != MRBC_TT_FIXNUM ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  bus_transfer( vm, v, GET_INT_ARG(1), 2, 3, GET_INT_ARG(4), 0 );
+}
+
+
+//================================================================
+/*! (method) SPI.new(bus, cs, frequency = 1_000_000, mode = 0)
+*/
+static void c_spi_new(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 2 || GET_TT_ARG(1) != MRBC_TT_FIXNUM ||
+      GET_TT_ARG(2) != MRBC_TT_FIXNUM ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  uint32_t freq = 1000000;
+  int mode = 0;
+  if( argc >= 3 && GET_TT_ARG(3) == MRBC_TT_FIXNUM ) freq = GET_INT_ARG(3);
+  if( argc >= 4 && GET_TT_ARG(4) == MRBC_TT_FIXNUM ) mode = GET_INT_ARG(4);
+
+  bus_new( vm, v, MRBC_BUS_SPI, GET_INT_ARG(1), GET_INT_ARG(2), freq, mode );
+}
+
+
+//================================================================
+/*! (method) SPI#write(str)
+*/
+static void c_spi_write(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 1 ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  bus_transfer( vm, v, get_device(v)->addr, 1, 0, 0, 0 );
+}
+
+
+//================================================================
+/*! (method) SPI#read(buf, len)
+*/
+static void c_spi_read(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 2 || GET_TT_ARG(2) != MRBC_TT_FIXNUM ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  bus_transfer( vm, v, get_device(v)->addr, 0, 1, GET_INT_ARG(2), 0 );
+}
+
+
+//================================================================
+/*! (method) SPI#write_read(tx, buf, len)
+*/
+static void c_spi_write_read(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 3 || GET_TT_ARG(3) != MRBC_TT_FIXNUM ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  bus_transfer( vm, v, get_device(v)->addr, 1, 2, GET_INT_ARG(3), 0 );
+}
+
+
+//================================================================
+/*! (method) SPI#transfer(tx, buf)
+*/
+static void c_spi_transfer(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 2 || GET_TT_ARG(1) != MRBC_TT_STRING ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  bus_transfer( vm, v, get_device(v)->addr, 1, 2,
+		mrbc_string_size(&v[1]), MRBC_BUS_DUPLEX );
+}
+
+
+//================================================================
+/*! (method) timeout
+*/
+static void c_bus_timeout(struct VM *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN( get_device(v)->timeout_ms );
+}
+
+
+//================================================================
+/*! (method) timeout = ms
+*/
+static void c_bus_set_timeout(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 1 || GET_TT_ARG(1) != MRBC_TT_FIXNUM ) return;
+  get_device(v)->timeout_ms = GET_INT_ARG(1) < 0 ? 0 : GET_INT_ARG(1);
+}
+
+
+//================================================================
+/*! set the backend of the bus.
+
+  Call before I2C.new or SPI.new of the bus.
+
+  @param  type		MRBC_BUS_I2C or MRBC_BUS_SPI
+  @param  bus		bus number.
+  @param  backend	backend, or NULL to use hal_bus_*.
+*/
+void mrbc_bus_set_backend(int type, int bus, const mrbc_bus_backend *backend)
+{
+  mrbc_bus_queue *q = find_queue( type, bus, 1 );
+  if( q ) q->backend = backend ? backend : &hal_backend_;
+}
+
+
+//================================================================
+/*! notify completion of the transfer, and start the next one.
+
+  Called by the backend. Can be called from interrupt handler or
+  other FreeRTOS tasks, or inside start().
+
+  @param  x		transfer.
+  @param  result	bytes transferred, or -1 if error.
+*/
+void mrbc_bus_complete(mrbc_bus_xfer *x, int result)
+{
+  mrbc_bus_queue *q = find_queue( x->type, x->bus, 0 );
+
+  hal_disable_irq();
+  x->result = result;
+  x->state = XFER_DONE;
+  struct VM *waiter = x->waiter;
+  mrbc_bus_xfer *next = x->next;
+  q->head = next;
+  if( next ) next->state = XFER_ACTIVE; else q->tail = NULL;
+  hal_enable_irq();
+
+  if( waiter ) mrbc_cfunc_wakeup( VM2TCB(waiter) );
+  if( next ) xfer_start( q, next );
+}
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_bus(struct VM *vm)
+{
+  mrbc_class *cls = mrbc_define_class(vm, "I2C", mrbc_class_object);
+
+  mrbc_define_method(vm, cls, "new", c_i2c_new);
+  mrbc_define_method(vm, cls, "write", c_i2c_write);
+  mrbc_define_method(vm, cls, "read", c_i2c_read);
+  mrbc_define_method(vm, cls, "write_read", c_i2c_write_read);
+  mrbc_define_method(vm, cls, "timeout", c_bus_timeout);
+  mrbc_define_method(vm, cls, "timeout=", c_bus_set_timeout);
+
+  cls = mrbc_define_class(vm, "SPI", mrbc_class_object);
+
+  mrbc_define_method(vm, cls, "new", c_spi_new);
+  mrbc_define_method(vm, cls, "write", c_spi_write);
+  mrbc_define_method(vm, cls, "read", c_spi_read);
+  mrbc_define_method(vm, cls, "write_read", c_spi_write_read);
+  mrbc_define_method(vm, cls, "transfer", c_spi_transfer);
+  mrbc_define_method(vm, cls, "timeout", c_bus_timeout);
+  mrbc_define_method(vm, cls, "timeout=", c_bus_set_timeout);
+}
+
+
+#endif  // MRBC_USE_BUS
@@ -0,0 +1,96 @@
+/*! @file
+  @brief
+  mruby/c I2C and SPI class
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_C_BUS_H_
+#define MRBC_SRC_C_BUS_H_
+
+#include <stdint.h>
+#include "vm_config.h"
+#include "value.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if MRBC_USE_BUS
+struct VM;
+
+//================================================================
+/*!@brief
+  Bus type.
+*/
+enum MrbcBusType {
+  MRBC_BUS_I2C = 1,
+  MRBC_BUS_SPI = 2,
+};
+
+//================================================================
+/*!@brief
+  Transfer flags.
+*/
+enum MrbcBusFlag {
+  MRBC_BUS_DUPLEX = 0x01,	//!< SPI full duplex. (rx while tx)
+};
+
+
+//================================================================
+/*!@brief
+  Transfer.
+
+  I2C: write tx, then read rx with repeated start. (either may be empty)
+  SPI: write tx, then read rx, with CS active through. If DUPLEX,
+       clock tx_len bytes, and receive them into rx at the same time.
+*/
+typedef struct RBusXfer {
+  struct RBusXfer *next;
+  uint8_t type;			//!< MRBC_BUS_I2C or MRBC_BUS_SPI
+  uint8_t bus;			//!< bus (port) number.
+  uint8_t flags;		//!< MrbcBusFlag
+  volatile uint8_t state;	//!< (internal)
+  uint16_t addr;		//!< I2C slave address, or SPI chip select.
+  uint16_t tx_len;
+  uint16_t rx_len;
+  const uint8_t *tx;
+  uint8_t *rx;
+  volatile int16_t result;	//!< bytes transferred, or -1 if error.
+  struct VM * volatile waiter;	//!< (internal)
+  uint32_t start_us;		//!< (internal)
+  uint32_t timeout_ms;		//!< (internal)
+  uint8_t *buf;			//!< (internal) tx and rx, owned by the transfer.
+  mrbc_value rx_str;		//!< (internal) String to receive, on completion.
+} mrbc_bus_xfer;
+
+
+//================================================================
+/*!@brief
+  Bus backend. The default is hal_bus_open() and hal_bus_start().
+
+  start() must not wait for the transfer. It calls mrbc_bus_complete()
+  when finished, from interrupt handler, other task, or inside start().
+*/
+typedef struct RBusBackend {
+  int (*open)(int type, int bus, int addr, uint32_t freq, int mode);
+  int (*start)(mrbc_bus_xfer *x);
+} mrbc_bus_backend;
+
+
+void mrbc_bus_set_backend(int type, int bus, const mrbc_bus_backend *backend);
+void mrbc_bus_complete(mrbc_bus_xfer *x, int result);
+void mrbc_init_class_bus(struct VM *vm);
+#endif
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,399 @@
+/*! @file
+  @brief
+  mruby/c GPIO class
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  GPIO input with edge capture. The GPIO interrupt handler of HAL calls
+  mrbc_gpio_event(), and the edge is put into a lock-free ring buffer
+  with the time since the previous edge of the pin. Ruby takes the edges out in batches, and can
+  wait for them without polling. (see mrbc_cfunc_block)
+  Rising edges are counted too, by the pulse counter of the hardware
+  where available. (hal_gpio_counter_*)
+
+  (e.g.)
+    button = GPIO.new(4, :falling, :up)	# pin, edge, pull
+    tacho = GPIO.new(5, :none)		# count only.
+    while true
+      if GPIO.wait(1000)			# ms, 0 is wait forever.
+        GPIO.events(16).each do |pin, level, dt|	# dt is usec.
+          ...
+        end
+      end
+      rpm = tacho.count * 60 / 2; tacho.clear_count
+    end
+
+  The ring has one producer (GPIO interrupt, or the simulator of
+  hal_posix) and is meant for one consumer task. If several tasks wait,
+  the first to run takes the events. Events are dropped when the ring
+  is full, see GPIO.lost.
+
+  The time of an event is the interval from the previous event of the
+  same pin in the ring (from GPIO.new for the first), not hal_micros()
+  itself, which wraps every 71 minutes and exceeds Fixnum after 35.
+  Intervals of 0x7fffffff usec (35.8 minutes) or more are reported as
+  0x7fffffff, and intervals of 71 minutes or more wrap.
+  </pre>
+*/
+
+#include "vm_config.h"
+#include <string.h>
+
+#include "value.h"
+#include "alloc.h"
+#include "static.h"
+#include "class.h"
+#include "symbol.h"
+#include "vm.h"
+#include "c_array.h"
+#include "c_gpio.h"
+#include "rrt0.h"
+#include "hal/hal.h"
+
+
+#if MRBC_USE_GPIO
+
+#define EVENT_MASK (MRBC_GPIO_EVENT_BUFFER_SIZE - 1)
+
+
+//================================================================
+/*!@brief
+  Edge event.
+*/
+typedef struct RGpioEvent {
+  uint8_t pin;
+  uint8_t level;		//!< level after the edge.
+  uint32_t us;			//!< interval from the previous event of the pin.
+} mrbc_gpio_event_t;
+
+//================================================================
+/*!@brief
+  Input pin.
+*/
+typedef struct RGpio {
+  uint8_t used;			//!< 0 is unused slot.
+  uint8_t pin;
+  uint8_t edge;			//!< edges to capture. MrbcGpioEdge
+  uint8_t flag_hw_count;	//!< counted by hardware.
+  volatile uint32_t count;	//!< rising edges, if not flag_hw_count.
+  uint32_t last_us;		//!< hal_micros() at the previous event.
+} mrbc_gpio;
+
+static mrbc_gpio gpio_[MRBC_GPIO_MAX_PINS];
+
+static struct {
+  volatile uint16_t head;	//!< write position. (free running)
+  volatile uint16_t tail;	//!< read position. (free running)
+  volatile uint16_t lost;	//!< dropped events.
+  mrbc_gpio_event_t buf[MRBC_GPIO_EVENT_BUFFER_SIZE];
+} ring_;
+
+// GPIO.wait of each task. (index by vm_id)
+static struct {
+  uint32_t start_us;
+  uint32_t timeout_ms;
+} wait_[MAX_VM_COUNT + 1];
+
+
+//================================================================
+/*! get gpio from self.
+*/
+static inline mrbc_gpio *get_gpio(const mrbc_value v[])
+{
+  return *(mrbc_gpio **)v[0].instance->data;
+}
+
+
+//================================================================
+/*! find the pin.
+*/
+static mrbc_gpio *find_gpio(int pin)
+{
+  int i;
+  for( i = 0; i < MRBC_GPIO_MAX_PINS; i++ ) {
+    if( gpio_[i].used && gpio_[i].pin == pin ) return &gpio_[i];
+  }
+  return NULL;
+}
+
+
+//================================================================
+/*! number of events in ring buffer.
+*/
+static inline int event_count(void)
+{
+  return (uint16_t)(ring_.head - ring_.tail);
+}
+
+
+//================================================================
+/*! symbol argument to enum value.
+
+  @param  names	names of the values, from 0.
+  @return	value, or -1 if not found.
+*/
+static int sym_to_enum(const mrbc_value *v, const char * const names[], int n)
+{
+  if( v->tt == MRBC_TT_NIL ) return 0;
+  if( v->tt != MRBC_TT_SYMBOL ) return -1;
+
+  const char *s = symid_to_str( v->i );
+  int i;
+  for( i = 0; i < n; i++ ) {
+    if( strcmp( s, names[i] ) == 0 ) return i;
+  }
+  return -1;
+}
+
+
+//================================================================
+/*! continuation of GPIO.wait
+*/
+static void gpio_wait_resume(struct VM *vm, mrbc_value v[], void *state)
+{
+  if( event_count() > 0 ) {
+    SET_TRUE_RETURN();
+    return;
+  }
+
+  uint32_t timeout_ms = wait_[vm->vm_id].timeout_ms;
+  uint32_t elapsed_ms = (hal_micros() - wait_[vm->vm_id].start_us) / 1000;
+  if( timeout_ms != 0 && elapsed_ms >= timeout_ms ) {
+    SET_FALSE_RETURN();
+    return;
+  }
+
+  // woken up, but the events are taken by other task.
+  mrbc_cfunc_block( vm, v, gpio_wait_resume, &ring_,
+		    timeout_ms ? timeout_ms - elapsed_ms : 0 );
+}
+
+
+//================================================================
+/*! (method) new(pin, edge = :both, pull = nil)
+
+  edge: :rising, :falling, :both or :none
+  pull: :up, :down or nil
+*/
+static void c_gpio_new(struct VM *vm, mrbc_value v[], int argc)
+{
+  static const char * const edges[] = { "none", "rising", "falling", "both" };
+  static const char * const pulls[] = { "none", "up", "down" };
+
+  if( argc < 1 || GET_TT_ARG(1) != MRBC_TT_FIXNUM ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  int pin = GET_INT_ARG(1);
+  int edge = (argc >= 2) ? sym_to_enum( &v[2], edges, 4 ) : MRBC_GPIO_EDGE_BOTH;
+  int pull = (argc >= 3) ? sym_to_enum( &v[3], pulls, 3 ) : MRBC_GPIO_PULL_NONE;
+  if( pin < 0 || pin > 255 || edge < 0 || pull < 0 ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  // find the pin, or an unused slot.
+  mrbc_gpio *g = find_gpio( pin );
+  int i;
+  for( i = 0; g == NULL && i < MRBC_GPIO_MAX_PINS; i++ ) {
+    if( !gpio_[i].used ) g = &gpio_[i];
+  }
+  if( g == NULL ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  g->edge = MRBC_GPIO_EDGE_NONE;	// stop capture while configuring.
+  g->pin = pin;
+  g->count = 0;
+  g->last_us = hal_micros();
+  g->used = 1;
+  g->flag_hw_count = (hal_gpio_counter_open( pin ) == 0);
+
+  // count rising edges by software, if no hardware counter.
+  int hal_edge = edge | (g->flag_hw_count ? 0 : MRBC_GPIO_EDGE_RISING);
+  if( hal_gpio_input( pin, pull, hal_edge ) != 0 ) {
+    g->used = 0;
+    SET_NIL_RETURN();
+    return;
+  }
+  g->edge = edge;
+
+  *v = mrbc_instance_new(vm, v->cls, sizeof(mrbc_gpio *));
+  if( !v->instance ) return;
+
+  *(mrbc_gpio **)v->instance->data = g;
+}
+
+
+//================================================================
+/*! (method) value
+*/
+static void c_gpio_value(struct VM *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN( hal_gpio_read( get_gpio(v)->pin ) );
+}
+
+
+//================================================================
+/*! (method) count  rising edges.
+*/
+static void c_gpio_count(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_gpio *g = get_gpio(v);
+
+  SET_INT_RETURN( g->flag_hw_count ? hal_gpio_counter_read( g->pin ) : g->count );
+}
+
+
+//================================================================
+/*! (method) clear_count
+*/
+static void c_gpio_clear_count(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_gpio *g = get_gpio(v);
+
+  if( g->flag_hw_count ) {
+    hal_gpio_counter_clear( g->pin );
+  } else {
+    g->count = 0;
+  }
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! (class method) events(max = 16)  => [[pin, level, usec], ...]
+
+  take out the events from the ring buffer, oldest first.
+  usec is the interval from the previous event of the pin, at most
+  0x7fffffff.
+*/
+static void c_gpio_events(struct VM *vm, mrbc_value v[], int argc)
+{
+  int max = 16;
+  if( argc >= 1 && GET_TT_ARG(1) == MRBC_TT_FIXNUM ) max = GET_INT_ARG(1);
+
+  int n = event_count();
+  if( n > max ) n = max;
+  if( n < 0 ) n = 0;
+
+  mrbc_value ret = mrbc_array_new( vm, n );
+  if( !ret.array ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  uint16_t tail = ring_.tail;
+  int i;
+  for( i = 0; i < n; i++ ) {
+    const mrbc_gpio_event_t *e = &ring_.buf[(tail + i) & EVENT_MASK];
+    mrbc_value ev = mrbc_array_new( vm, 3 );
+    if( !ev.array ) break;
+
+    mrbc_value pin = mrbc_fixnum_value( e->pin );
+    mrbc_value level = mrbc_fixnum_value( e->level );
+    mrbc_value us = mrbc_fixnum_value( e->us < 0x7fffffff ? e->us : 0x7fffffff );
+    mrbc_array_set( &ev, 0, &pin );
+    mrbc_array_set( &ev, 1, &level );
+    mrbc_array_set( &ev, 2, &us );
+    mrbc_array_set( &ret, i, &ev );
+  }
+  ring_.tail = tail + i;	// the slots are free for the producer.
+
+  SET_RETURN( ret );
+}
+
+
+//================================================================
+/*! (class method) wait(timeout_ms = 0)
+
+  wait until the ring buffer has events.
+  @return	true, or false if timeout.
+*/
+static void c_gpio_wait(struct VM *vm, mrbc_value v[], int argc)
+{
+  uint32_t timeout_ms = 0;
+  if( argc >= 1 && GET_TT_ARG(1) == MRBC_TT_FIXNUM && GET_INT_ARG(1) > 0 ) {
+    timeout_ms = GET_INT_ARG(1);
+  }
+  wait_[vm->vm_id].timeout_ms = timeout_ms;
+  wait_[vm->vm_id].start_us = hal_micros();
+
+  // block first, so that the event after checking can wake up.
+  mrbc_cfunc_block( vm, v, gpio_wait_resume, &ring_, timeout_ms );
+  if( event_count() > 0 ) mrbc_cfunc_wakeup( VM2TCB(vm) );
+}
+
+
+//================================================================
+/*! (class method) lost  dropped events since last call.
+*/
+static void c_gpio_lost(struct VM *vm, mrbc_value v[], int argc)
+{
+  hal_disable_irq();
+  int lost = ring_.lost;
+  ring_.lost = 0;
+  hal_enable_irq();
+
+  SET_INT_RETURN( lost );
+}
+
+
+//================================================================
+/*! edge event.
+
+  Called from GPIO interrupt handler of HAL.
+
+  @param  pin	GPIO number.
+  @param  level	level after the edge.
+  @param  us	hal_micros() at the edge.
+*/
+void mrbc_gpio_event(int pin, int level, uint32_t us)
+{
+  mrbc_gpio *g = find_gpio( pin );
+  if( g == NULL ) return;
+
+  if( level && !g->flag_hw_count ) g->count++;
+  if( !(g->edge & (level ? MRBC_GPIO_EDGE_RISING : MRBC_GPIO_EDGE_FALLING)) ) return;
+
+  uint16_t head = ring_.head;
+  if( (uint16_t)(head - ring_.tail) >= MRBC_GPIO_EVENT_BUFFER_SIZE ) {
+    ring_.lost++;
+    return;
+  }
+
+  mrbc_gpio_event_t *e = &ring_.buf[head & EVENT_MASK];
+  e->pin = pin;
+  e->level = level;
+  e->us = us - g->last_us;	// wraps around with hal_micros().
+  g->last_us = us;
+  __sync_synchronize();		// the event, before the head.
+  ring_.head = head + 1;
+
+  mrbc_cfunc_wakeup_all( &ring_ );
+}
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_gpio(struct VM *vm)
+{
+  mrbc_class *cls = mrbc_define_class(vm, "GPIO", mrbc_class_object);
+
+  mrbc_define_method(vm, cls, "new", c_gpio_new);
+  mrbc_define_method(vm, cls, "value", c_gpio_value);
+  mrbc_define_method(vm, cls, "count", c_gpio_count);
+  mrbc_define_method(vm, cls, "clear_count", c_gpio_clear_count);
+  mrbc_define_method(vm, cls, "events", c_gpio_events);
+  mrbc_define_method(vm, cls, "wait", c_gpio_wait);
+  mrbc_define_method(vm, cls, "lost", c_gpio_lost);
+}
+
+
+#endif  // MRBC_USE_GPIO
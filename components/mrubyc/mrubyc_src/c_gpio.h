@@ -0,0 +1,56 @@
+/*! @file
+  @brief
+  mruby/c GPIO class
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_C_GPIO_H_
+#define MRBC_SRC_C_GPIO_H_
+
+#include <stdint.h>
+#include "vm_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if MRBC_USE_GPIO
+struct VM;
+
+//================================================================
+/*!@brief
+  Edges to capture.
+*/
+enum MrbcGpioEdge {
+  MRBC_GPIO_EDGE_NONE    = 0,
+  MRBC_GPIO_EDGE_RISING  = 1,
+  MRBC_GPIO_EDGE_FALLING = 2,
+  MRBC_GPIO_EDGE_BOTH    = 3,
+};
+
+//================================================================
+/*!@brief
+  Pull up or down.
+*/
+enum MrbcGpioPull {
+  MRBC_GPIO_PULL_NONE = 0,
+  MRBC_GPIO_PULL_UP   = 1,
+  MRBC_GPIO_PULL_DOWN = 2,
+};
+
+void mrbc_gpio_event(int pin, int level, uint32_t us);
+void mrbc_init_class_gpio(struct VM *vm);
+#endif
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -17,6 +17,7 @@
 #include "value.h"
 #include "static.h"
 #include "class.h"
+#include "math_fast.h"
 
 
 #if MRBC_USE_FLOAT && MRBC_USE_MATH
@@ -104,7 +105,7 @@ static void c_math_cbrt(struct VM *vm, mrbc_value v[], int argc)
 */
 static void c_math_cos(struct VM *vm, mrbc_value v[], int argc)
 {
-  v[0] = mrbc_float_value( cos( to_double(&v[1]) ));
+  v[0] = mrbc_float_value( MRBC_MATH_COS( to_double(&v[1]) ));
 }
 
 //================================================================
@@ -136,7 +137,7 @@ static void c_math_erfc(struct VM *vm, mrbc_value v[], int argc)
 */
 static void c_math_exp(struct VM *vm, mrbc_value v[], int argc)
 {
-  v[0] = mrbc_float_value( exp( to_double(&v[1]) ));
+  v[0] = mrbc_float_value( MRBC_MATH_EXP( to_double(&v[1]) ));
 }
 
 //================================================================
@@ -167,7 +168,7 @@ static void c_math_ldexp(struct VM *vm, mrbc_value v[], int argc)
 */
 static void c_math_log(struct VM *vm, mrbc_value v[], int argc)
 {
-  v[0] = mrbc_float_value( log( to_double(&v[1]) ));
+  v[0] = mrbc_float_value( MRBC_MATH_LOG( to_double(&v[1]) ));
 }
 
 //================================================================
@@ -191,7 +192,7 @@ static void c_math_log2(struct VM *vm, mrbc_value v[], int argc)
 */
 static void c_math_sin(struct VM *vm, mrbc_value v[], int argc)
 {
-  v[0] = mrbc_float_value( sin( to_double(&v[1]) ));
+  v[0] = mrbc_float_value( MRBC_MATH_SIN( to_double(&v[1]) ));
 }
 
 //================================================================
@@ -207,7 +208,7 @@ static void c_math_sinh(struct VM *vm, mrbc_value v[], int argc)
 */
 static void c_math_sqrt(struct VM *vm, mrbc_value v[], int argc)
 {
-  v[0] = mrbc_float_value( sqrt( to_double(&v[1]) ));
+  v[0] = mrbc_float_value( MRBC_MATH_SQRT( to_double(&v[1]) ));
 }
 
 //================================================================
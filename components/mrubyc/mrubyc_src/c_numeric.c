@@ -26,6 +26,7 @@
 #include "console.h"
 #include "c_numeric.h"
 #include "c_string.h"
+#include "math_fast.h"
 
 
 //================================================================
@@ -78,7 +79,7 @@ static void c_fixnum_power(struct VM *vm, mrbc_value v[], int argc)
 
 #if MRBC_USE_FLOAT && MRBC_USE_MATH
   else if( v[1].tt == MRBC_TT_FLOAT ) {
-    SET_FLOAT_RETURN( pow( v[0].i, v[1].d ) );
+    SET_FLOAT_RETURN( MRBC_MATH_POW( v[0].i, v[1].d ) );
   }
 #endif
 }
@@ -296,7 +297,7 @@ static void c_float_power(struct VM *vm, mrbc_value v[], int argc)
   default:				break;
   }
 
-  SET_FLOAT_RETURN( pow( v[0].d, n ));
+  SET_FLOAT_RETURN( MRBC_MATH_POW( v[0].d, n ));
 }
 #endif
 
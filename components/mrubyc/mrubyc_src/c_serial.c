@@ -0,0 +1,399 @@
+/*! @file
+  @brief
+  mruby/c Serial class
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Buffered UART on top of hal_uart_*. Received bytes are moved into
+  a preallocated ring buffer for each port. gets and read_frame block
+  only the calling task (see mrbc_cfunc_block), and are woken up by
+  mrbc_serial_notify() or by polling every MRBC_SERIAL_POLL_MS.
+
+  (e.g.)
+    s = Serial.new(2, 9600)
+    s.timeout = 200		# ms, 0 is wait forever.
+    s.write "\xFF\x01\x86\x00\x00\x00\x00\x00\x79"
+    res = s.read_frame(9)	# => String of 9 bytes, or nil if timeout.
+    line = s.gets("\n")		# => String including "\n", or nil.
+    s.read_nonblock(16)		# => String, or nil if no data.
+
+  One task can wait on a port at the same time.
+  </pre>
+*/
+
+#include "vm_config.h"
+#include <string.h>
+
+#include "value.h"
+#include "alloc.h"
+#include "static.h"
+#include "class.h"
+#include "vm.h"
+#include "c_string.h"
+#include "c_serial.h"
+#include "rrt0.h"
+#include "hal/hal.h"
+
+
+#if MRBC_USE_SERIAL
+
+#ifndef MRBC_SERIAL_POLL_MS
+#define MRBC_SERIAL_POLL_MS 10
+#endif
+#define BUFFER_MASK (MRBC_SERIAL_BUFFER_SIZE - 1)
+
+enum {
+  SERIAL_OP_GETS = 1,
+  SERIAL_OP_READ_FRAME,
+};
+
+
+//================================================================
+/*!@brief
+  Serial port and its receive ring buffer.
+*/
+typedef struct RSerial {
+  int16_t port;			//!< UART port.
+  uint8_t used;			//!< 0 is unused slot.
+  uint16_t head;		//!< write position. (free running)
+  uint16_t tail;		//!< read position. (free running)
+  uint8_t op;			//!< waiting operation. SERIAL_OP_*
+  uint8_t delim;		//!< delimiter of gets.
+  uint16_t len;			//!< length of read_frame.
+  uint32_t timeout_ms;		//!< 0 is wait forever.
+  uint32_t start_us;		//!< hal_micros() at start of waiting.
+  struct VM * volatile waiter;	//!< blocked task.
+  uint8_t buf[MRBC_SERIAL_BUFFER_SIZE];
+} mrbc_serial;
+
+static mrbc_serial serial_[MRBC_SERIAL_MAX_PORTS];
+
+
+//================================================================
+/*! get serial from self.
+*/
+static inline mrbc_serial *get_serial(const mrbc_value v[])
+{
+  return *(mrbc_serial **)v[0].instance->data;
+}
+
+
+//================================================================
+/*! number of received bytes in ring buffer.
+*/
+static inline int rx_count(const mrbc_serial *s)
+{
+  return (uint16_t)(s->head - s->tail);
+}
+
+
+//================================================================
+/*! move received bytes from UART to ring buffer.
+*/
+static void rx_fill(mrbc_serial *s)
+{
+  while( 1 ) {
+    int room = MRBC_SERIAL_BUFFER_SIZE - rx_count(s);
+    if( room == 0 ) break;
+
+    int pos = s->head & BUFFER_MASK;
+    int chunk = MRBC_SERIAL_BUFFER_SIZE - pos;
+    if( chunk > room ) chunk = room;
+
+    int n = hal_uart_read( s->port, s->buf + pos, chunk );
+    s->head += n;
+    if( n < chunk ) break;
+  }
+}
+
+
+//================================================================
+/*! take bytes from ring buffer as a String.
+*/
+static mrbc_value rx_take(struct VM *vm, mrbc_serial *s, int len)
+{
+  mrbc_value ret = mrbc_string_new( vm, NULL, len );
+  if( !ret.string ) return ret;		// ENOMEM
+
+  uint8_t *p = ret.string->data;
+  int pos = s->tail & BUFFER_MASK;
+  int n1 = MRBC_SERIAL_BUFFER_SIZE - pos;
+  if( n1 > len ) n1 = len;
+  memcpy( p, s->buf + pos, n1 );
+  memcpy( p + n1, s->buf, len - n1 );
+  p[len] = '\0';
+  s->tail += len;
+
+  return ret;
+}
+
+
+//================================================================
+/*! length up to delimiter, or 0 if not found.
+*/
+static int rx_find(const mrbc_serial *s, int delim)
+{
+  int count = rx_count(s);
+  int i;
+  for( i = 0; i < count; i++ ) {
+    if( s->buf[(s->tail + i) & BUFFER_MASK] == delim ) return i + 1;
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! try waiting operation.
+
+  @return	1 if completed and v[0] is set.
+*/
+static int serial_try(struct VM *vm, mrbc_value v[], mrbc_serial *s)
+{
+  rx_fill( s );
+
+  int len = 0;
+  switch( s->op ) {
+  case SERIAL_OP_GETS:
+    len = rx_find( s, s->delim );
+    if( len == 0 && rx_count(s) == MRBC_SERIAL_BUFFER_SIZE ) {
+      len = MRBC_SERIAL_BUFFER_SIZE;	// buffer full, no delimiter.
+    }
+    break;
+
+  case SERIAL_OP_READ_FRAME:
+    if( rx_count(s) >= s->len ) len = s->len;
+    break;
+  }
+  if( len == 0 ) return 0;
+
+  SET_RETURN( rx_take( vm, s, len ) );
+  return 1;
+}
+
+
+//================================================================
+/*! continuation of gets and read_frame.
+*/
+static void serial_resume(struct VM *vm, mrbc_value v[], void *state)
+{
+  mrbc_serial *s = (mrbc_serial *)state;
+
+  if( serial_try( vm, v, s ) ) {
+    s->waiter = NULL;
+    return;
+  }
+
+  if( s->timeout_ms != 0 &&
+      (uint32_t)(hal_micros() - s->start_us) >= s->timeout_ms * 1000 ) {
+    s->waiter = NULL;
+    SET_NIL_RETURN();
+    return;
+  }
+
+  mrbc_cfunc_block( vm, v, serial_resume, s, MRBC_SERIAL_POLL_MS );
+}
+
+
+//================================================================
+/*! start waiting operation.
+*/
+static void serial_wait(struct VM *vm, mrbc_value v[], mrbc_serial *s, int op)
+{
+  s->op = op;
+  if( serial_try( vm, v, s ) ) return;
+
+  s->start_us = hal_micros();
+  s->waiter = vm;
+  mrbc_cfunc_block( vm, v, serial_resume, s, MRBC_SERIAL_POLL_MS );
+}
+
+
+//================================================================
+/*! (method) new(port, baud = 9600)
+*/
+static void c_serial_new(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 1 || GET_TT_ARG(1) != MRBC_TT_FIXNUM ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  int port = GET_INT_ARG(1);
+  int baud = 9600;
+  if( argc >= 2 && GET_TT_ARG(2) == MRBC_TT_FIXNUM ) baud = GET_INT_ARG(2);
+
+  // find the port, or an unused slot.
+  mrbc_serial *s = NULL;
+  int i;
+  for( i = 0; i < MRBC_SERIAL_MAX_PORTS; i++ ) {
+    if( serial_[i].used && serial_[i].port == port ) {
+      s = &serial_[i];
+      break;
+    }
+    if( !serial_[i].used && s == NULL ) s = &serial_[i];
+  }
+  if( s == NULL || hal_uart_open( port, baud ) != 0 ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  if( !s->used ) {
+    memset( s, 0, sizeof(mrbc_serial) );
+    s->port = port;
+    s->used = 1;
+  }
+
+  *v = mrbc_instance_new(vm, v->cls, sizeof(mrbc_serial *));
+  if( !v->instance ) return;
+
+  *(mrbc_serial **)v->instance->data = s;
+}
+
+
+//================================================================
+/*! (method) write(str)
+*/
+static void c_serial_write(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 1 || GET_TT_ARG(1) != MRBC_TT_STRING ) {
+    SET_INT_RETURN( 0 );
+    return;
+  }
+  mrbc_serial *s = get_serial(v);
+
+  int n = hal_uart_write( s->port, GET_STRING_ARG(1), mrbc_string_size(&v[1]) );
+  SET_INT_RETURN( n );
+}
+
+
+//================================================================
+/*! (method) read_nonblock(maxlen = buffer size)
+*/
+static void c_serial_read_nonblock(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_serial *s = get_serial(v);
+  int maxlen = MRBC_SERIAL_BUFFER_SIZE;
+  if( argc >= 1 && GET_TT_ARG(1) == MRBC_TT_FIXNUM ) maxlen = GET_INT_ARG(1);
+
+  rx_fill( s );
+  int len = rx_count(s);
+  if( len > maxlen ) len = maxlen;
+  if( len <= 0 ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  SET_RETURN( rx_take( vm, s, len ) );
+}
+
+
+//================================================================
+/*! (method) gets(delim = "\n")
+*/
+static void c_serial_gets(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_serial *s = get_serial(v);
+  if( s->waiter ) {
+    SET_NIL_RETURN();		// another task is waiting.
+    return;
+  }
+
+  s->delim = '\n';
+  if( argc >= 1 && GET_TT_ARG(1) == MRBC_TT_STRING &&
+      mrbc_string_size(&v[1]) > 0 ) {
+    s->delim = GET_STRING_ARG(1)[0];
+  }
+
+  serial_wait( vm, v, s, SERIAL_OP_GETS );
+}
+
+
+//================================================================
+/*! (method) read_frame(len)
+*/
+static void c_serial_read_frame(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_serial *s = get_serial(v);
+  if( s->waiter || argc < 1 || GET_TT_ARG(1) != MRBC_TT_FIXNUM ||
+      GET_INT_ARG(1) <= 0 || GET_INT_ARG(1) > MRBC_SERIAL_BUFFER_SIZE ) {
+    SET_NIL_RETURN();
+    return;
+  }
+
+  s->len = GET_INT_ARG(1);
+  serial_wait( vm, v, s, SERIAL_OP_READ_FRAME );
+}
+
+
+//================================================================
+/*! (method) available
+*/
+static void c_serial_available(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_serial *s = get_serial(v);
+
+  rx_fill( s );
+  SET_INT_RETURN( rx_count(s) );
+}
+
+
+//================================================================
+/*! (method) timeout
+*/
+static void c_serial_timeout(struct VM *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN( get_serial(v)->timeout_ms );
+}
+
+
+//================================================================
+/*! (method) timeout = ms
+*/
+static void c_serial_set_timeout(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 1 || GET_TT_ARG(1) != MRBC_TT_FIXNUM ) return;
+  get_serial(v)->timeout_ms = GET_INT_ARG(1) < 0 ? 0 : GET_INT_ARG(1);
+}
+
+
+//================================================================
+/*! notify data arrival.
+
+  Wake up the task waiting on the port. Can be called from interrupt
+  handler or other FreeRTOS tasks. (e.g. UART event queue handler)
+
+  @param  port	UART port.
+*/
+void mrbc_serial_notify(int port)
+{
+  int i;
+  for( i = 0; i < MRBC_SERIAL_MAX_PORTS; i++ ) {
+    struct VM *waiter = serial_[i].waiter;
+    if( serial_[i].used && serial_[i].port == port && waiter != NULL ) {
+      mrbc_cfunc_wakeup( VM2TCB(waiter) );
+    }
+  }
+}
+
+
+//================================================================
+/*! initialize
+*/
+void mrbc_init_class_serial(struct VM *vm)
+{
+  mrbc_class *cls = mrbc_define_class(vm, "Serial", mrbc_class_object);
+
+  mrbc_define_method(vm, cls, "new", c_serial_new);
+  mrbc_define_method(vm, cls, "write", c_serial_write);
+  mrbc_define_method(vm, cls, "read_nonblock", c_serial_read_nonblock);
+  mrbc_define_method(vm, cls, "gets", c_serial_gets);
+  mrbc_define_method(vm, cls, "read_frame", c_serial_read_frame);
+  mrbc_define_method(vm, cls, "available", c_serial_available);
+  mrbc_define_method(vm, cls, "timeout", c_serial_timeout);
+  mrbc_define_method(vm, cls, "timeout=", c_serial_set_timeout);
+}
+
+
+#endif  // MRBC_USE_SERIAL
@@ -0,0 +1,34 @@
+/*! @file
+  @brief
+  mruby/c Serial class
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_C_SERIAL_H_
+#define MRBC_SRC_C_SERIAL_H_
+
+#include "vm_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if MRBC_USE_SERIAL
+struct VM;
+
+void mrbc_serial_notify(int port);
+void mrbc_init_class_serial(struct VM *vm);
+#endif
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
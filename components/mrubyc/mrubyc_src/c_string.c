@@ -24,6 +24,7 @@
 #include "class.h"
 #include "symbol.h"
 #include "c_array.h"
+#include "c_hash.h"
 #include "c_string.h"
 #include "console.h"
 
@@ -75,6 +76,7 @@ mrbc_value mrbc_string_new(struct VM *vm, const void *src, int len)
   h->ref_count = 1;
   h->tt = MRBC_TT_STRING;	// TODO: for DEBUG
   h->size = len;
+  h->capa = len;
   h->data = str;
 
   /*
@@ -127,6 +129,7 @@ mrbc_value mrbc_string_new_alloc(struct VM *vm, void *buf, int len)
   h->ref_count = 1;
   h->tt = MRBC_TT_STRING;	// TODO: for DEBUG
   h->size = len;
+  h->capa = len;
   h->data = buf;
 
   value.string = h;
@@ -201,6 +204,74 @@ mrbc_value mrbc_string_add(struct VM *vm, const mrbc_value *s1, const mrbc_value
 }
 
 
+//================================================================
+/*! grow buffer geometrically, to store len bytes.
+
+  @param  h	pointer to string handle
+  @param  len	required length. ('\0' excluded)
+  @return	mrbc_error_code
+*/
+static int string_grow(mrbc_string *h, int len)
+{
+  if( len <= h->capa ) return 0;
+
+  int capa = mrbc_alloc_grow_size( h->capa + 1, len + 1 ) - 1;
+  if( capa > UINT16_MAX ) capa = UINT16_MAX;
+  if( capa < len ) return E_NOMEMORY_ERROR;
+
+  uint8_t *str = mrbc_raw_realloc(h->data, capa + 1);
+  if( !str ) {
+    // retry without a margin.
+    capa = len;
+    str = mrbc_raw_realloc(h->data, capa + 1);
+    if( !str ) return E_NOMEMORY_ERROR;
+  }
+
+  h->data = str;
+  h->capa = capa;
+
+  return 0;
+}
+
+
+//================================================================
+/*! reserve buffer capacity
+
+  @param  str	pointer to target value
+  @param  capa	capacity. ('\0' excluded)
+  @return	mrbc_error_code
+*/
+int mrbc_string_reserve(mrbc_value *str, int capa)
+{
+  mrbc_string *h = str->string;
+  if( capa <= h->capa ) return 0;
+  if( capa > UINT16_MAX ) return E_NOMEMORY_ERROR;
+
+  uint8_t *p = mrbc_raw_realloc(h->data, capa + 1);
+  if( !p ) return E_NOMEMORY_ERROR;
+
+  h->data = p;
+  h->capa = capa;
+
+  return 0;
+}
+
+
+//================================================================
+/*! shrink buffer capacity to the string length
+
+  @param  str	pointer to target value
+*/
+void mrbc_string_shrink_to_fit(mrbc_value *str)
+{
+  mrbc_string *h = str->string;
+  if( h->capa == h->size ) return;
+
+  h->data = mrbc_raw_realloc(h->data, h->size + 1);	// shrink never fails.
+  h->capa = h->size;
+}
+
+
 //================================================================
 /*! append string (s1 += s2)
 
@@ -213,8 +284,8 @@ int mrbc_string_append(mrbc_value *s1, const mrbc_value *s2)
   int len1 = s1->string->size;
   int len2 = (s2->tt == MRBC_TT_STRING) ? s2->string->size : 1;
 
-  uint8_t *str = mrbc_raw_realloc(s1->string->data, len1+len2+1);
-  if( !str ) return E_NOMEMORY_ERROR;
+  if( string_grow(s1->string, len1+len2) != 0 ) return E_NOMEMORY_ERROR;
+  uint8_t *str = s1->string->data;
 
   if( s2->tt == MRBC_TT_STRING ) {
     memcpy(str + len1, s2->string->data, len2 + 1);
@@ -224,7 +295,6 @@ int mrbc_string_append(mrbc_value *s1, const mrbc_value *s2)
   }
 
   s1->string->size = len1 + len2;
-  s1->string->data = str;
 
   return 0;
 }
@@ -242,13 +312,10 @@ int mrbc_string_append_cstr(mrbc_value *s1, const char *s2)
   int len1 = s1->string->size;
   int len2 = strlen(s2);
 
-  uint8_t *str = mrbc_raw_realloc(s1->string->data, len1+len2+1);
-  if( !str ) return E_NOMEMORY_ERROR;
-
-  memcpy(str + len1, s2, len2 + 1);
+  if( string_grow(s1->string, len1+len2) != 0 ) return E_NOMEMORY_ERROR;
 
+  memcpy(s1->string->data + len1, s2, len2 + 1);
   s1->string->size = len1 + len2;
-  s1->string->data = str;
 
   return 0;
 }
@@ -316,6 +383,7 @@ int mrbc_string_strip(mrbc_value *src, int mode)
   buf[new_size] = '\0';
   mrbc_raw_realloc(buf, new_size+1);	// shrink suitable size.
   src->string->size = new_size;
+  src->string->capa = new_size;
 
   return 1;
 }
@@ -351,6 +419,33 @@ int mrbc_string_chomp(mrbc_value *src)
 
 
 
+//================================================================
+/*! (method) new(str = "", capacity: n)
+*/
+static void c_string_new(struct VM *vm, mrbc_value v[], int argc)
+{
+  int capa = 0;
+  if( argc >= 1 && v[argc].tt == MRBC_TT_HASH ) {
+    mrbc_value key = {.tt = MRBC_TT_SYMBOL};
+    key.i = str_to_symid("capacity");
+    mrbc_value *val = mrbc_hash_search( &v[argc], &key );
+    if( val && val->tt == MRBC_TT_FIXNUM ) capa = val->i;
+    argc--;
+  }
+
+  mrbc_value ret;
+  if( argc >= 1 && v[1].tt == MRBC_TT_STRING ) {
+    ret = mrbc_string_dup( vm, &v[1] );
+  } else {
+    ret = mrbc_string_new( vm, NULL, 0 );
+  }
+  if( !ret.string ) return;		// ENOMEM
+
+  mrbc_string_reserve( &ret, capa );
+  SET_RETURN(ret);
+}
+
+
 //================================================================
 /*! (method) +
 */
@@ -569,14 +664,12 @@ static void c_string_insert(struct VM *vm, mrbc_value v[], int argc)
     return;
   }
 
-  uint8_t *str = mrbc_realloc(vm, mrbc_string_cstr(v), len1 + len2 - len + 1);
-  if( !str ) return;
+  if( string_grow(v->string, len1 + len2 - len) != 0 ) return;
+  uint8_t *str = v->string->data;
 
   memmove( str + nth + len2, str + nth + len, len1 - nth - len + 1 );
   memcpy( str + nth, mrbc_string_cstr(val), len2 );
   v->string->size = len1 + len2 - len;
-
-  v->string->data = str;
 }
 
 
@@ -1285,6 +1378,7 @@ void mrbc_init_class_string(struct VM *vm)
 {
   mrbc_class_string = mrbc_define_class(vm, "String", mrbc_class_object);
 
+  mrbc_define_method(vm, mrbc_class_string, "new",	c_string_new);
   mrbc_define_method(vm, mrbc_class_string, "+",	c_string_add);
   mrbc_define_method(vm, mrbc_class_string, "*",	c_string_mul);
   mrbc_define_method(vm, mrbc_class_string, "size",	c_string_size);
@@ -30,6 +30,7 @@ typedef struct RString {
   MRBC_OBJECT_HEADER;
 
   uint16_t size;	//!< string length.
+  uint16_t capa;	//!< buffer capacity. ('\0' excluded)
   uint8_t *data;	//!< pointer to allocated buffer.
 
 } mrbc_string;
@@ -44,6 +45,8 @@ mrbc_value mrbc_string_dup(struct VM *vm, mrbc_value *s1);
 mrbc_value mrbc_string_add(struct VM *vm, const mrbc_value *s1, const mrbc_value *s2);
 int mrbc_string_append(mrbc_value *s1, const mrbc_value *s2);
 int mrbc_string_append_cstr(mrbc_value *s1, const char *s2);
+int mrbc_string_reserve(mrbc_value *str, int capa);
+void mrbc_string_shrink_to_fit(mrbc_value *str);
 int mrbc_string_index(const mrbc_value *src, const mrbc_value *pattern, int offset);
 int mrbc_string_strip(mrbc_value *src, int mode);
 int mrbc_string_chomp(mrbc_value *src);
@@ -34,8 +34,13 @@
 #include "c_math.h"
 #include "c_string.h"
 #include "c_range.h"
+#include "c_benchmark.h"
 
 
+static const char * const *used_methods_;
+static int n_used_methods_;
+static MRBC_THREAD_LOCAL int filter_methods_;	// true while mrbc_init_class()
+
 
 //================================================================
 /*! Check the class is the class of object.
@@ -70,9 +75,6 @@ mrbc_proc *mrbc_rproc_alloc(struct VM *vm, const char *name)
 
   proc->ref_count = 1;
   proc->sym_id = str_to_symid(name);
-#ifdef MRBC_DEBUG
-  proc->names = name;	// for debug; delete soon.
-#endif
   proc->next = 0;
 
   return proc;
@@ -200,11 +202,28 @@ mrbc_class *find_class_by_object(struct VM *vm, const mrbc_object *obj)
   @return
 */
 mrbc_proc *find_method_by_class(struct VM *vm, const mrbc_class *cls, mrbc_sym sym_id)
+{
+  mrbc_class *owner;
+  return find_method_and_owner(cls, sym_id, &owner);
+}
+
+
+//================================================================
+/*!@brief
+  find method from class, and the class that has the method.
+
+  @param  cls		class to search from.
+  @param  sym_id	method name.
+  @param  owner		returns the class that has the method.
+  @return		pointer to proc, or NULL if not found.
+*/
+mrbc_proc *find_method_and_owner(const mrbc_class *cls, mrbc_sym sym_id, mrbc_class **owner)
 {
   while( cls != 0 ) {
     mrbc_proc *proc = cls->procs;
     while( proc != 0 ) {
       if( proc->sym_id == sym_id ) {
+        *owner = (mrbc_class *)cls;
         return proc;
       }
       proc = proc->next;
@@ -216,6 +235,17 @@ mrbc_proc *find_method_by_class(struct VM *vm, const mrbc_class *cls, mrbc_sym s
 }
 
 
+//================================================================
+/*!@brief
+  invalidate the method cache of all call sites.
+  call it after changing the method list of any class.
+*/
+void mrbc_method_cache_clear(void)
+{
+  mrbc_current_runtime->method_serial++;
+}
+
+
 //================================================================
 /*!@brief
   find method from object
@@ -255,9 +285,6 @@ mrbc_class * mrbc_define_class(struct VM *vm, const char *name, mrbc_class *supe
     if( !cls ) return cls;	// ENOMEM
 
     cls->sym_id = sym_id;
-#ifdef MRBC_DEBUG
-    cls->names = name;	// for debug; delete soon.
-#endif
     cls->super = super;
     cls->procs = 0;
 
@@ -306,6 +333,7 @@ mrbc_class * mrbc_get_class_by_name( const char *name )
 void mrbc_define_method(struct VM *vm, mrbc_class *cls, const char *name, mrbc_func_t cfunc)
 {
   if( cls == NULL ) cls = mrbc_class_object;	// set default to Object.
+  if( !mrbc_is_used_method(name) ) return;
 
   mrbc_proc *proc = mrbc_rproc_alloc(vm, name);
   if( !proc ) return;	// ENOMEM
@@ -315,6 +343,7 @@ void mrbc_define_method(struct VM *vm, mrbc_class *cls, const char *name, mrbc_f
 
   proc->next = cls->procs;
   cls->procs = proc;
+  mrbc_method_cache_clear();
 }
 
 
@@ -333,7 +362,9 @@ void mrbc_define_method(struct VM *vm, mrbc_class *cls, const char *name, mrbc_f
 void mrbc_funcall(struct VM *vm, const char *name, mrbc_value *v, int argc)
 {
   mrbc_sym sym_id = str_to_symid(name);
-  mrbc_proc *m = find_method(vm, &v[0], sym_id);
+  mrbc_class *owner;
+  mrbc_proc *m = find_method_and_owner(find_class_by_object(vm, &v[0]),
+				       sym_id, &owner);
 
   if( m==0 ) return;   // no method
 
@@ -341,8 +372,10 @@ void mrbc_funcall(struct VM *vm, const char *name, mrbc_value *v, int argc)
   callinfo->current_regs = vm->current_regs;
   callinfo->pc_irep = vm->pc_irep;
   callinfo->pc = vm->pc;
+  callinfo->mid = sym_id;
   callinfo->n_args = 0;
   callinfo->target_class = vm->target_class;
+  callinfo->own_class = owner;
   callinfo->prev = vm->callinfo_tail;
   vm->callinfo_tail = callinfo;
 
@@ -610,11 +643,9 @@ static void c_object_alias_method(struct VM *vm, mrbc_value v[], int argc)
 
   // register procs link.
   proc_alias->sym_id = v[1].i;
-#if defined(MRBC_DEBUG)
-  proc_alias->names = symid_to_str(v[1].i);
-#endif
   proc_alias->next = v[0].cls->procs;
   v[0].cls->procs = proc_alias;
+  mrbc_method_cache_clear();
 }
 
 
@@ -660,6 +691,21 @@ static void c_object_puts(struct VM *vm, mrbc_value v[], int argc)
 }
 
 
+//================================================================
+/*! check the method is Object#puts or Object#print of this file.
+
+  @param  m	method.
+  @return	MRBC_CONSOLE_PUTS, MRBC_CONSOLE_PRINT, or 0 if others.
+*/
+int mrbc_console_method(const mrbc_proc *m)
+{
+  if( !m->c_func ) return 0;
+  if( m->func == c_object_puts ) return MRBC_CONSOLE_PUTS;
+  if( m->func == c_object_print ) return MRBC_CONSOLE_PRINT;
+  return 0;
+}
+
+
 //================================================================
 /*! (operator) !
  */
@@ -1230,6 +1276,50 @@ void c_ineffect(struct VM *vm, mrbc_value v[], int argc)
 }
 
 
+//================================================================
+/*! set the names of built-in methods used by the application.
+
+  Only these methods are defined by mrbc_init_class(), both in C and
+  in mrblib. Call before mrbc_init().
+  The list is generated by tools/used_methods.rb.
+
+  @param  names		method names, sorted by strcmp().
+  @param  size		number of names.
+*/
+void mrbc_set_used_methods(const char * const *names, int size)
+{
+  used_methods_ = names;
+  n_used_methods_ = size;
+}
+
+
+//================================================================
+/*! check if the method is used by the application.
+
+  @param  name		method name.
+  @return		true if used, or not filtering now.
+*/
+int mrbc_is_used_method(const char *name)
+{
+  int left = 0;
+  int right = n_used_methods_ - 1;
+
+  if( !filter_methods_ || used_methods_ == NULL ) return 1;
+
+  while( left <= right ) {
+    int mid = (left + right) / 2;
+    int cmp = strcmp( name, used_methods_[mid] );
+    if( cmp == 0 ) return 1;
+    if( cmp < 0 ) {
+      right = mid - 1;
+    } else {
+      left = mid + 1;
+    }
+  }
+  return 0;
+}
+
+
 //================================================================
 /*! Run mrblib, which is mruby bytecode
 */
@@ -1260,6 +1350,7 @@ void mrbc_init_class(void)
 {
   extern const uint8_t mrblib_bytecode[];
 
+  filter_methods_ = 1;
   mrbc_init_class_object(0);
   mrbc_init_class_nil(0);
   mrbc_init_class_proc(0);
@@ -1280,6 +1371,10 @@ void mrbc_init_class(void)
   mrbc_init_class_array(0);
   mrbc_init_class_range(0);
   mrbc_init_class_hash(0);
+#if MRBC_USE_BENCHMARK
+  mrbc_init_class_benchmark(0);
+#endif
 
   mrbc_run_mrblib(mrblib_bytecode);
+  filter_methods_ = 0;
 }
@@ -28,9 +28,6 @@ extern "C" {
 */
 typedef struct RClass {
   mrbc_sym sym_id;	// class name
-#ifdef MRBC_DEBUG
-  const char *names;	// for debug. delete soon.
-#endif
   struct RClass *super;	// mrbc_class[super]
   struct RProc *procs;	// mrbc_proc[rprocs], linked list
 
@@ -60,9 +57,6 @@ typedef struct RProc {
 
   unsigned int c_func : 1;	// 0:IREP, 1:C Func
   mrbc_sym sym_id;
-#ifdef MRBC_DEBUG
-  const char *names;		// for debug; delete soon
-#endif
   struct RProc *next;
   union {
     struct IREP *irep;
@@ -73,6 +67,15 @@ typedef struct RProc {
 typedef struct RProc mrb_proc;
 
 
+//================================================================
+/*! console methods of Object. (see mrbc_console_method)
+*/
+enum MrbcConsoleMethod {
+  MRBC_CONSOLE_PRINT = 1,
+  MRBC_CONSOLE_PUTS = 2,
+};
+
+
 
 int mrbc_obj_is_kind_of(const mrbc_value *obj, const mrb_class *cls);
 mrbc_proc *mrbc_rproc_alloc(struct VM *vm, const char *name);
@@ -83,6 +86,8 @@ mrbc_value mrbc_instance_getiv(mrbc_object *obj, mrbc_sym sym_id);
 mrbc_class *find_class_by_object(struct VM *vm, const mrbc_object *obj);
 mrbc_proc *find_method_by_class(struct VM *vm, const mrbc_class *cls, mrbc_sym sym_id);
 mrbc_proc *find_method(struct VM *vm, const mrbc_object *recv, mrbc_sym sym_id);
+mrbc_proc *find_method_and_owner(const mrbc_class *cls, mrbc_sym sym_id, mrbc_class **owner);
+void mrbc_method_cache_clear(void);
 mrbc_class *mrbc_define_class(struct VM *vm, const char *name, mrbc_class *super);
 mrbc_class *mrbc_get_class_by_name(const char *name);
 void mrbc_define_method(struct VM *vm, mrbc_class *cls, const char *name, mrbc_func_t cfunc);
@@ -91,8 +96,11 @@ mrbc_value mrbc_send(struct VM *vm, mrbc_value *v, int reg_ofs, mrbc_value *recv
 int mrbc_p_sub(const mrbc_value *v);
 int mrbc_print_sub(const mrbc_value *v);
 int mrbc_puts_sub(const mrbc_value *v);
+int mrbc_console_method(const mrbc_proc *m);
 void c_proc_call(struct VM *vm, mrbc_value v[], int argc);
 void c_ineffect(struct VM *vm, mrbc_value v[], int argc);
+void mrbc_set_used_methods(const char * const *names, int size);
+int mrbc_is_used_method(const char *name);
 void mrbc_run_mrblib(const uint8_t bytecode[]);
 void mrbc_init_class(void);
 
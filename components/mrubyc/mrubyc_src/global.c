@@ -15,11 +15,13 @@
 #include "value.h"
 #include "global.h"
 #include "keyvalue.h"
+#include "runtime.h"
 #include "console.h"
 
 
-static mrbc_kv_handle handle_const;	//!< for global(Object) constants.
-static mrbc_kv_handle handle_global;	//!< for global variables.
+// for global(Object) constants and global variables. (see runtime.h)
+#define handle_const	(mrbc_current_runtime->handle_const)
+#define handle_global	(mrbc_current_runtime->handle_global)
 
 
 //================================================================
@@ -14,27 +14,71 @@
 /***** Feature test switches ************************************************/
 /***** System headers *******************************************************/
 #include <stdio.h>
+#include <string.h>
 #include "esp_types.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "soc/timer_group_struct.h"
 #include "driver/periph_ctrl.h"
 #include "driver/timer.h"
+#include "driver/uart.h"
+#include "driver/i2c.h"
+#include "driver/spi_master.h"
+#include "driver/gpio.h"
+#include "driver/pcnt.h"
+#include "driver/adc.h"
+#include "esp_adc_cal.h"
+#include "soc/pcnt_struct.h"
+#include "esp_heap_caps.h"
 
 
 /***** Local headers ********************************************************/
 #include "hal.h"
+#include "../c_bus.h"
+#include "../c_gpio.h"
+#include "../c_adc.h"
 
 
 /***** Constat values *******************************************************/
 #define TIMER_DIVIDER 80
+#define BUS_WORKER_STACK 2048
+#define BUS_WORKER_PRIORITY 11
+#define BUS_I2C_TIMEOUT_MS 100
+#define HAL_SPI_MAX_DEVICES 4
+#define GPIO_PCNT_H_LIM 30000
+#define ADC_WORKER_STACK 2048
+#define ADC_WORKER_PRIORITY 10
+#define ADC_DEFAULT_VREF 1100
+#define ADC_ATTEN ADC_ATTEN_DB_11
 
 /***** Macros ***************************************************************/
 /***** Typedefs *************************************************************/
 /***** Function prototypes **************************************************/
 /***** Local variables ******************************************************/
 static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+#if MRBC_USE_BUS
+static QueueHandle_t bus_queue_;
+static struct {
+  int bus;
+  int cs;
+  spi_device_handle_t handle;
+} spi_dev_[HAL_SPI_MAX_DEVICES];
+#endif
+#if MRBC_USE_GPIO
+static int gpio_isr_installed_;
+static int pcnt_isr_installed_;
+static int8_t pcnt_pin_[PCNT_UNIT_MAX] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+static volatile int32_t pcnt_overflow_[PCNT_UNIT_MAX];
+#endif
+#if MRBC_USE_ADC
+static SemaphoreHandle_t adc_lock_;	//!< held while sweeping.
+static TaskHandle_t adc_task_;
+static volatile TickType_t adc_period_;	//!< 0 is stopped.
+static esp_adc_cal_characteristics_t adc_chars_[2];
+static uint8_t adc_characterized_[2];
+#endif
 
 
 /***** Global variables *****************************************************/
@@ -57,6 +101,177 @@ static void on_timer(void *arg)
 #endif
 
 
+#if MRBC_USE_BUS
+//================================================================
+/*!@brief
+  I2C transfer. write tx, then read rx with repeated start.
+
+*/
+static int bus_i2c_transfer(struct RBusXfer *x)
+{
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+
+  i2c_master_start(cmd);
+  if( x->tx_len > 0 || x->rx_len == 0 ) {
+    i2c_master_write_byte(cmd, (x->addr << 1) | I2C_MASTER_WRITE, true);
+    if( x->tx_len > 0 ) i2c_master_write(cmd, (uint8_t *)x->tx, x->tx_len, true);
+    if( x->rx_len > 0 ) i2c_master_start(cmd);
+  }
+  if( x->rx_len > 0 ) {
+    i2c_master_write_byte(cmd, (x->addr << 1) | I2C_MASTER_READ, true);
+    i2c_master_read(cmd, x->rx, x->rx_len, I2C_MASTER_LAST_NACK);
+  }
+  i2c_master_stop(cmd);
+
+  esp_err_t err = i2c_master_cmd_begin(x->bus, cmd, BUS_I2C_TIMEOUT_MS / portTICK_RATE_MS);
+  i2c_cmd_link_delete(cmd);
+
+  return err == ESP_OK ? x->tx_len + x->rx_len : -1;
+}
+
+
+//================================================================
+/*!@brief
+  SPI transfer. the driver uses DMA if the bus is initialized with
+  a DMA channel.
+
+*/
+static int bus_spi_transfer(struct RBusXfer *x)
+{
+  spi_device_handle_t handle = NULL;
+  int i;
+  for( i = 0; i < HAL_SPI_MAX_DEVICES; i++ ) {
+    if( spi_dev_[i].handle && spi_dev_[i].bus == x->bus &&
+        spi_dev_[i].cs == x->addr ) handle = spi_dev_[i].handle;
+  }
+  if( !handle ) return -1;
+
+  spi_transaction_t t;
+  memset(&t, 0, sizeof(t));
+
+  if( (x->flags & MRBC_BUS_DUPLEX) || x->tx_len == 0 || x->rx_len == 0 ) {
+    // one phase, directly from/to the String buffers.
+    int len = x->tx_len ? x->tx_len : x->rx_len;
+    t.length = len * 8;
+    t.rxlength = x->rx_len * 8;
+    t.tx_buffer = x->tx_len ? x->tx : NULL;
+    t.rx_buffer = x->rx_len ? x->rx : NULL;
+    return spi_device_transmit(handle, &t) == ESP_OK ? len : -1;
+  }
+
+  // tx then rx with CS held, through DMA capable bounce buffer.
+  int len = x->tx_len + x->rx_len;
+  uint8_t *buf = heap_caps_malloc(len * 2, MALLOC_CAP_DMA);
+  if( !buf ) return -1;
+
+  memcpy(buf, x->tx, x->tx_len);
+  memset(buf + x->tx_len, 0xff, x->rx_len);
+  t.length = len * 8;
+  t.tx_buffer = buf;
+  t.rx_buffer = buf + len;
+  esp_err_t err = spi_device_transmit(handle, &t);
+  if( err == ESP_OK ) memcpy(x->rx, buf + len + x->tx_len, x->rx_len);
+  heap_caps_free(buf);
+
+  return err == ESP_OK ? len : -1;
+}
+
+
+//================================================================
+/*!@brief
+  bus worker task. runs the transfers, outside of the VM.
+
+*/
+static void bus_worker(void *arg)
+{
+  struct RBusXfer *x;
+
+  while( 1 ) {
+    if( !xQueueReceive(bus_queue_, &x, portMAX_DELAY) ) continue;
+
+    int result = (x->type == MRBC_BUS_I2C) ? bus_i2c_transfer(x) :
+                                             bus_spi_transfer(x);
+    mrbc_bus_complete(x, result);
+  }
+}
+#endif
+
+
+#if MRBC_USE_GPIO
+//================================================================
+/*!@brief
+  GPIO edge ISR.
+
+*/
+static void IRAM_ATTR on_gpio(void *arg)
+{
+  int pin = (int)arg;
+  mrbc_gpio_event(pin, gpio_get_level(pin), hal_micros());
+}
+
+
+//================================================================
+/*!@brief
+  PCNT ISR. accumulates the counter at high limit. (reset to 0 by hardware)
+
+*/
+static void IRAM_ATTR on_pcnt(void *arg)
+{
+  uint32_t status = PCNT.int_st.val;
+  int unit;
+
+  for( unit = 0; unit < PCNT_UNIT_MAX; unit++ ) {
+    if( !(status & (1 << unit)) ) continue;
+    if( PCNT.status_unit[unit].val & PCNT_STATUS_H_LIM_M ) {
+      pcnt_overflow_[unit] += GPIO_PCNT_H_LIM;
+    }
+  }
+  PCNT.int_clr.val = status;
+}
+
+
+//================================================================
+/*!@brief
+  PCNT unit of the pin, or -1.
+
+*/
+static int pcnt_unit_of(int pin)
+{
+  int unit;
+  for( unit = 0; unit < PCNT_UNIT_MAX; unit++ ) {
+    if( pcnt_pin_[unit] == pin ) return unit;
+  }
+  return -1;
+}
+#endif
+
+
+#if MRBC_USE_ADC
+//================================================================
+/*!@brief
+  ADC worker task. sweeps the channels at the rate of hal_adc_start().
+
+*/
+static void adc_worker(void *arg)
+{
+  TickType_t last = xTaskGetTickCount();
+
+  while( 1 ) {
+    if( !adc_period_ ) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      last = xTaskGetTickCount();
+      continue;
+    }
+    vTaskDelayUntil(&last, adc_period_);
+
+    xSemaphoreTake(adc_lock_, portMAX_DELAY);
+    if( adc_period_ ) mrbc_adc_sweep();
+    xSemaphoreGive(adc_lock_);
+  }
+}
+#endif
+
+
 /***** Global functions *****************************************************/
 #ifndef MRBC_NO_TIMER
 
@@ -109,3 +324,368 @@ void hal_disable_irq(void)
 
 
 #endif /* ifndef MRBC_NO_TIMER */
+
+
+//================================================================
+/*!@brief
+  open UART port.
+  the driver must be installed by the application (uart_driver_install),
+  with pins and buffer sizes of the board.
+
+  @param  port	UART number.
+  @param  baud	baud rate.
+  @retval 0	No error.
+  @retval -1	error. (driver not installed)
+*/
+int hal_uart_open(int port, int baud)
+{
+  size_t len;
+  if( uart_get_buffered_data_len(port, &len) != ESP_OK ) return -1;
+
+  return uart_set_baudrate(port, baud) == ESP_OK ? 0 : -1;
+}
+
+
+//================================================================
+/*!@brief
+  read from UART port. (non-blocking)
+
+  @param  port	UART number.
+  @param  buf	pointer of buffer.
+  @param  nbytes	buffer size.
+  @return	number of bytes read, or 0 if no data.
+*/
+int hal_uart_read(int port, void *buf, int nbytes)
+{
+  size_t len = 0;
+  uart_get_buffered_data_len(port, &len);
+  if( len == 0 ) return 0;
+  if( len > nbytes ) len = nbytes;
+
+  int n = uart_read_bytes(port, buf, len, 0);
+  return n < 0 ? 0 : n;
+}
+
+
+//================================================================
+/*!@brief
+  write to UART port.
+
+  @param  port	UART number.
+  @param  buf	pointer of buffer.
+  @param  nbytes	output byte length.
+  @return	number of bytes written.
+*/
+int hal_uart_write(int port, const void *buf, int nbytes)
+{
+  int n = uart_write_bytes(port, buf, nbytes);
+  return n < 0 ? 0 : n;
+}
+
+
+#if MRBC_USE_BUS
+//================================================================
+/*!@brief
+  open I2C or SPI bus.
+  the driver must be installed by the application, (i2c_driver_install,
+  spi_bus_initialize) with pins of the board. an SPI device is added
+  for each chip select.
+
+  @param  type	MRBC_BUS_I2C or MRBC_BUS_SPI
+  @param  bus	I2C port, or SPI host. (HSPI_HOST, VSPI_HOST)
+  @param  addr	SPI chip select GPIO. (not used for I2C)
+  @param  freq	clock frequency.
+  @param  mode	SPI mode.
+  @retval 0	No error.
+  @retval -1	error.
+*/
+int hal_bus_open(int type, int bus, int addr, uint32_t freq, int mode)
+{
+  if( !bus_queue_ ) {
+    bus_queue_ = xQueueCreate(MRBC_BUS_MAX, sizeof(struct RBusXfer *));
+    if( !bus_queue_ ) return -1;
+    xTaskCreate(bus_worker, "mrbc_bus", BUS_WORKER_STACK, NULL,
+                BUS_WORKER_PRIORITY, NULL);
+  }
+
+  if( type == MRBC_BUS_I2C ) {
+    int period = APB_CLK_FREQ / freq / 2;
+    return i2c_set_period(bus, period, period) == ESP_OK ? 0 : -1;
+  }
+
+  int i, slot = -1;
+  for( i = 0; i < HAL_SPI_MAX_DEVICES; i++ ) {
+    if( spi_dev_[i].handle && spi_dev_[i].bus == bus &&
+        spi_dev_[i].cs == addr ) return 0;
+    if( !spi_dev_[i].handle && slot < 0 ) slot = i;
+  }
+  if( slot < 0 ) return -1;
+
+  spi_device_interface_config_t cfg = {
+    .clock_speed_hz = freq,
+    .mode = mode,
+    .spics_io_num = addr,
+    .queue_size = 1,
+  };
+  if( spi_bus_add_device(bus, &cfg, &spi_dev_[slot].handle) != ESP_OK ) {
+    spi_dev_[slot].handle = NULL;
+    return -1;
+  }
+  spi_dev_[slot].bus = bus;
+  spi_dev_[slot].cs = addr;
+
+  return 0;
+}
+
+
+//================================================================
+/*!@brief
+  start transfer. (run by the bus worker task)
+
+  @retval 0	No error.
+  @retval -1	error.
+*/
+int hal_bus_start(struct RBusXfer *x)
+{
+  return xQueueSend(bus_queue_, &x, 0) == pdTRUE ? 0 : -1;
+}
+#endif
+
+
+#if MRBC_USE_GPIO
+//================================================================
+/*!@brief
+  set input mode of GPIO pin, and the edge interrupt.
+
+  @param  pin	GPIO number.
+  @param  pull	MrbcGpioPull
+  @param  edge	MrbcGpioEdge to report by mrbc_gpio_event().
+  @retval 0	No error.
+  @retval -1	error.
+*/
+int hal_gpio_input(int pin, int pull, int edge)
+{
+  static const gpio_int_type_t intr_types[] = {
+    GPIO_INTR_DISABLE, GPIO_INTR_POSEDGE, GPIO_INTR_NEGEDGE, GPIO_INTR_ANYEDGE,
+  };
+  if( !GPIO_IS_VALID_GPIO(pin) ) return -1;
+
+  // after hal_gpio_counter_open(), that sets pull up.
+  gpio_config_t cfg = {
+    .pin_bit_mask = 1ULL << pin,
+    .mode = GPIO_MODE_INPUT,
+    .pull_up_en = (pull == MRBC_GPIO_PULL_UP),
+    .pull_down_en = (pull == MRBC_GPIO_PULL_DOWN),
+    .intr_type = intr_types[edge & MRBC_GPIO_EDGE_BOTH],
+  };
+  if( gpio_config(&cfg) != ESP_OK ) return -1;
+
+  // not ESP_INTR_FLAG_IRAM, mrbc_gpio_event() runs from flash as on_timer does.
+  if( !gpio_isr_installed_ ) {
+    esp_err_t err = gpio_install_isr_service(0);
+    if( err != ESP_OK && err != ESP_ERR_INVALID_STATE ) return -1;
+    gpio_isr_installed_ = 1;
+  }
+  gpio_isr_handler_remove(pin);
+  if( edge == MRBC_GPIO_EDGE_NONE ) return 0;
+
+  return gpio_isr_handler_add(pin, on_gpio, (void *)pin) == ESP_OK ? 0 : -1;
+}
+
+
+//================================================================
+/*!@brief
+  read GPIO pin level.
+
+*/
+int hal_gpio_read(int pin)
+{
+  return gpio_get_level(pin);
+}
+
+
+//================================================================
+/*!@brief
+  open pulse counter (PCNT) of the pin, counting rising edges.
+
+  @retval 0	No error.
+  @retval -1	error. (no free unit)
+*/
+int hal_gpio_counter_open(int pin)
+{
+  int unit = pcnt_unit_of(pin);
+  if( unit < 0 ) unit = pcnt_unit_of(-1);
+  if( unit < 0 ) return -1;
+
+  pcnt_config_t cfg = {
+    .pulse_gpio_num = pin,
+    .ctrl_gpio_num = PCNT_PIN_NOT_USED,
+    .channel = PCNT_CHANNEL_0,
+    .unit = unit,
+    .pos_mode = PCNT_COUNT_INC,
+    .neg_mode = PCNT_COUNT_DIS,
+    .lctrl_mode = PCNT_MODE_KEEP,
+    .hctrl_mode = PCNT_MODE_KEEP,
+    .counter_h_lim = GPIO_PCNT_H_LIM,
+    .counter_l_lim = 0,
+  };
+  if( pcnt_unit_config(&cfg) != ESP_OK ) return -1;
+
+  if( !pcnt_isr_installed_ ) {
+    if( pcnt_isr_register(on_pcnt, NULL, 0, NULL) != ESP_OK ) return -1;
+    pcnt_isr_installed_ = 1;
+  }
+  pcnt_pin_[unit] = pin;
+  pcnt_event_enable(unit, PCNT_EVT_H_LIM);
+  pcnt_intr_enable(unit);
+  hal_gpio_counter_clear(pin);
+
+  return 0;
+}
+
+
+//================================================================
+/*!@brief
+  read pulse counter.
+
+*/
+int hal_gpio_counter_read(int pin)
+{
+  int unit = pcnt_unit_of(pin);
+  if( unit < 0 ) return 0;
+
+  // read twice, in case the counter reached high limit between.
+  int32_t overflow;
+  int16_t count;
+  do {
+    overflow = pcnt_overflow_[unit];
+    pcnt_get_counter_value(unit, &count);
+  } while( overflow != pcnt_overflow_[unit] );
+
+  return overflow + count;
+}
+
+
+//================================================================
+/*!@brief
+  clear pulse counter.
+
+*/
+void hal_gpio_counter_clear(int pin)
+{
+  int unit = pcnt_unit_of(pin);
+  if( unit < 0 ) return;
+
+  pcnt_counter_pause(unit);
+  pcnt_counter_clear(unit);
+  pcnt_overflow_[unit] = 0;
+  pcnt_counter_resume(unit);
+}
+#endif
+
+
+#if MRBC_USE_ADC
+//================================================================
+/*!@brief
+  open ADC channel, 12 bit and 11dB attenuation. (0 to about 3.3V)
+
+  @param  ch	0-7 are ADC1_CHANNEL_0-7, 10-19 are ADC2_CHANNEL_0-9.
+  @retval 0	No error.
+  @retval -1	error.
+*/
+int hal_adc_open(int ch)
+{
+  int unit;
+  esp_err_t err;
+
+  if( ch >= 0 && ch < ADC1_CHANNEL_MAX ) {
+    unit = 0;
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    err = adc1_config_channel_atten(ch, ADC_ATTEN);
+  } else if( ch >= 10 && ch < 10 + ADC2_CHANNEL_MAX ) {
+    unit = 1;
+    err = adc2_config_channel_atten(ch - 10, ADC_ATTEN);
+  } else {
+    return -1;
+  }
+  if( err != ESP_OK ) return -1;
+
+  if( !adc_characterized_[unit] ) {
+    esp_adc_cal_characterize(unit ? ADC_UNIT_2 : ADC_UNIT_1, ADC_ATTEN,
+			     ADC_WIDTH_BIT_12, ADC_DEFAULT_VREF,
+			     &adc_chars_[unit]);
+    adc_characterized_[unit] = 1;
+  }
+
+  return 0;
+}
+
+
+//================================================================
+/*!@brief
+  read raw value of ADC channel.
+
+  @param  ch	channel. (see hal_adc_open)
+  @return	0 to 4095.
+*/
+int hal_adc_read_raw(int ch)
+{
+  int raw = 0;
+
+  if( ch < 10 ) {
+    raw = adc1_get_raw(ch);
+  } else {
+    // fails while WiFi uses ADC2. keep 0.
+    adc2_get_raw(ch - 10, ADC_WIDTH_BIT_12, &raw);
+  }
+  return raw < 0 ? 0 : raw;
+}
+
+
+//================================================================
+/*!@brief
+  convert raw value to mV, by the eFuse calibration of the chip.
+
+  @param  ch	channel. (see hal_adc_open)
+  @param  raw	0 to 4095.
+  @return	mV.
+*/
+int hal_adc_raw_to_mv(int ch, int raw)
+{
+  return esp_adc_cal_raw_to_voltage(raw, &adc_chars_[ch < 10 ? 0 : 1]);
+}
+
+
+//================================================================
+/*!@brief
+  start or stop the sweeps. (run by the ADC worker task)
+  when stopped, no sweep is in progress at return.
+
+  @param  rate_hz	sweeps per second, or 0 to stop.
+  @retval 0	No error.
+  @retval -1	error.
+*/
+int hal_adc_start(int rate_hz)
+{
+  if( !adc_lock_ ) {
+    if( rate_hz <= 0 ) return 0;
+    adc_lock_ = xSemaphoreCreateMutex();
+    if( !adc_lock_ ) return -1;
+    xTaskCreate(adc_worker, "mrbc_adc", ADC_WORKER_STACK, NULL,
+                ADC_WORKER_PRIORITY, &adc_task_);
+  }
+
+  TickType_t period = 0;
+  if( rate_hz > 0 ) {
+    period = configTICK_RATE_HZ / rate_hz;
+    if( period == 0 ) period = 1;
+  }
+
+  xSemaphoreTake(adc_lock_, portMAX_DELAY);
+  adc_period_ = period;
+  xSemaphoreGive(adc_lock_);
+  if( period ) xTaskNotifyGive(adc_task_);
+
+  return 0;
+}
+#endif
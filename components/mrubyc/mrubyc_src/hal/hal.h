@@ -23,6 +23,8 @@ extern "C" {
 #include <unistd.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_timer.h"
+#include "xtensa/hal.h"
 
 
 /***** Local headers ********************************************************/
@@ -36,8 +38,27 @@ extern "C" {
 /***** Typedefs *************************************************************/
 /***** Global variables *****************************************************/
 /***** Function prototypes **************************************************/
+struct RBusXfer;
 void mrbc_tick(void);
 
+int hal_uart_open(int port, int baud);
+int hal_uart_read(int port, void *buf, int nbytes);
+int hal_uart_write(int port, const void *buf, int nbytes);
+
+int hal_bus_open(int type, int bus, int addr, uint32_t freq, int mode);
+int hal_bus_start(struct RBusXfer *x);
+
+int hal_gpio_input(int pin, int pull, int edge);
+int hal_gpio_read(int pin);
+int hal_gpio_counter_open(int pin);
+int hal_gpio_counter_read(int pin);
+void hal_gpio_counter_clear(int pin);
+
+int hal_adc_open(int ch);
+int hal_adc_read_raw(int ch);
+int hal_adc_raw_to_mv(int ch, int raw);
+int hal_adc_start(int rate_hz);
+
 #ifndef MRBC_NO_TIMER
 void hal_init(void);
 void hal_enable_irq(void);
@@ -79,6 +100,26 @@ inline static int hal_flush(int fd)
   return fsync(1);
 }
 
+//================================================================
+/*!@brief
+  Get elapsed time in micro seconds. (wrap around 32bit)
+
+*/
+inline static uint32_t hal_micros(void)
+{
+  return (uint32_t)esp_timer_get_time();
+}
+
+//================================================================
+/*!@brief
+  Get CPU cycle counter. (CCOUNT register, wrap around 32bit)
+
+*/
+inline static uint32_t hal_cycles(void)
+{
+  return xthal_get_ccount();
+}
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,773 @@
+/*! @file
+  @brief
+  Hardware abstraction layer
+        for POSIX
+
+  <pre>
+  Copyright (C) 2016-2018 Kyushu Institute of Technology.
+  Copyright (C) 2016-2018 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <signal.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/***** Local headers ********************************************************/
+#include "hal.h"
+#include "../c_bus.h"
+#include "../c_gpio.h"
+#include "../c_adc.h"
+
+
+/***** Constat values *******************************************************/
+#define BUS_SIM_MAX_DEVICES 8
+#define BUS_SIM_MAX_RULES 8
+#define BUS_SIM_MAX_CMD 16
+#define BUS_SIM_MAX_RES 32
+#define GPIO_SIM_MAX_PINS 256
+#define ADC_SIM_MAX_CHANNELS 32
+#define ADC_SIM_FULL_SCALE_MV 3300
+
+
+/***** Macros ***************************************************************/
+/***** Typedefs *************************************************************/
+//================================================================
+/*!@brief
+  Simulated bus device.
+*/
+typedef struct BUS_SIM_DEVICE {
+  uint8_t type;			//!< 0 is unused slot.
+  uint8_t bus;
+  uint16_t addr;
+  uint8_t ptr;			//!< register pointer.
+  int8_t pending;		//!< rule to respond at next read, or -1.
+  uint8_t n_rules;
+  struct {
+    uint8_t cmd_len;
+    uint8_t res_len;
+    uint8_t cmd[BUS_SIM_MAX_CMD];
+    uint8_t res[BUS_SIM_MAX_RES];
+  } rules[BUS_SIM_MAX_RULES];
+  uint8_t regs[256];
+} bus_sim_device;
+
+//================================================================
+/*!@brief
+  Scheduled level change of simulated GPIO.
+*/
+typedef struct GPIO_SIM_STEP {
+  uint32_t delay_us;		//!< from the previous step.
+  uint8_t pin;
+  uint8_t level;
+} gpio_sim_step;
+
+
+/***** Function prototypes **************************************************/
+/***** Local variables ******************************************************/
+#ifndef MRBC_NO_TIMER
+static sigset_t sigset_, sigset2_;
+#endif
+static int uart_fd_[HAL_UART_MAX_PORT] = { -1, -1, -1, -1 };
+#if MRBC_USE_BUS
+static bus_sim_device bus_sim_[BUS_SIM_MAX_DEVICES];
+#endif
+#if MRBC_USE_GPIO
+static uint8_t gpio_level_[GPIO_SIM_MAX_PINS];
+static uint8_t gpio_edge_[GPIO_SIM_MAX_PINS];	//!< MrbcGpioEdge to report.
+static gpio_sim_step *gpio_steps_;
+static int gpio_n_steps_;
+static int gpio_step_;
+static uint32_t gpio_step_us_;	//!< hal_micros() of the previous step.
+#endif
+#if MRBC_USE_ADC
+static uint16_t adc_mv_[ADC_SIM_MAX_CHANNELS];
+static uint16_t adc_noise_mv_[ADC_SIM_MAX_CHANNELS];
+static uint32_t adc_period_us_;	//!< 0 is stopped.
+static uint32_t adc_sweep_us_;	//!< hal_micros() of the previous sweep.
+static uint32_t adc_rand_ = 1;
+#endif
+
+
+/***** Global variables *****************************************************/
+/***** Signal catching functions ********************************************/
+#ifndef MRBC_NO_TIMER
+//================================================================
+/*!@brief
+  alarm signal handler
+
+*/
+static void sig_alarm(int dummy)
+{
+  hal_sim_poll();
+  mrbc_tick();
+}
+#endif
+
+
+/***** Local functions ******************************************************/
+#if MRBC_USE_BUS
+//================================================================
+/*!@brief
+  find simulated device.
+
+*/
+static bus_sim_device *bus_sim_find(int type, int bus, int addr)
+{
+  int i;
+  for( i = 0; i < BUS_SIM_MAX_DEVICES; i++ ) {
+    bus_sim_device *d = &bus_sim_[i];
+    if( d->type == type && d->bus == bus && (addr < 0 || d->addr == addr) ) {
+      return d;
+    }
+  }
+  return NULL;
+}
+
+
+//================================================================
+/*!@brief
+  parse hex bytes. (e.g. "0x61 02 ff")
+
+  @return	number of bytes, or -1 if error.
+*/
+static int bus_sim_hex(char *str, uint8_t *buf, int size)
+{
+  int n = 0;
+  char *save;
+  char *tok = strtok_r(str, " \t", &save);
+
+  while( tok ) {
+    char *end;
+    long b = strtol(tok, &end, 16);
+    if( *end != '\0' || b < 0 || b > 0xff || n >= size ) return -1;
+    buf[n++] = b;
+    tok = strtok_r(NULL, " \t", &save);
+  }
+  return n;
+}
+#endif
+
+
+#if MRBC_USE_GPIO
+//================================================================
+/*!@brief
+  change the level of simulated GPIO pin, and report the edge.
+
+*/
+static void gpio_sim_set(int pin, int level, uint32_t us)
+{
+  if( gpio_level_[pin] == level ) return;
+
+  gpio_level_[pin] = level;
+  if( gpio_edge_[pin] & (level ? MRBC_GPIO_EDGE_RISING : MRBC_GPIO_EDGE_FALLING) ) {
+    mrbc_gpio_event(pin, level, us);
+  }
+}
+#endif
+
+
+/***** Global functions *****************************************************/
+#ifndef MRBC_NO_TIMER
+
+//================================================================
+/*!@brief
+  initialize
+
+*/
+void hal_init(void)
+{
+  sigemptyset(&sigset_);
+  sigaddset(&sigset_, SIGALRM);
+
+  // set signal handler
+  struct sigaction sa;
+  sa.sa_handler = sig_alarm;
+  sa.sa_flags   = SA_RESTART;
+  sa.sa_mask    = sigset_;
+  sigaction(SIGALRM, &sa, 0);
+
+  // set interval timer
+  struct itimerval tval;
+  int sec  = 0;
+  int usec = 1000;		// 1ms.
+  tval.it_interval.tv_sec  = sec;
+  tval.it_interval.tv_usec = usec;
+  tval.it_value.tv_sec     = sec;
+  tval.it_value.tv_usec    = usec;
+  setitimer(ITIMER_REAL, &tval, 0);
+}
+
+
+//================================================================
+/*!@brief
+  enable interrupt
+
+*/
+void hal_enable_irq(void)
+{
+  sigprocmask(SIG_SETMASK, &sigset2_, 0);
+}
+
+
+//================================================================
+/*!@brief
+  disable interrupt
+
+*/
+void hal_disable_irq(void)
+{
+  sigprocmask(SIG_BLOCK, &sigset_, &sigset2_);
+}
+
+#endif /* ifndef MRBC_NO_TIMER */
+
+
+//================================================================
+/*!@brief
+  attach a device (tty, pty) to UART port.
+
+  @param  port	port number. (0..HAL_UART_MAX_PORT-1)
+  @param  path	device path. (e.g. "/dev/pts/3")
+  @retval 0	No error.
+  @retval -1	error.
+*/
+int hal_uart_attach(int port, const char *path)
+{
+  if( port < 0 || port >= HAL_UART_MAX_PORT ) return -1;
+
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if( fd < 0 ) return -1;
+  if( uart_fd_[port] >= 0 ) close(uart_fd_[port]);
+  uart_fd_[port] = fd;
+
+  return 0;
+}
+
+
+//================================================================
+/*!@brief
+  open UART port. set raw mode and baud rate if the device is a tty.
+
+  @param  port	port number.
+  @param  baud	baud rate.
+  @retval 0	No error.
+  @retval -1	error. (not attached)
+*/
+int hal_uart_open(int port, int baud)
+{
+  if( port < 0 || port >= HAL_UART_MAX_PORT ) return -1;
+  int fd = uart_fd_[port];
+  if( fd < 0 ) return -1;
+
+  struct termios tio;
+  if( tcgetattr(fd, &tio) != 0 ) return 0;	// not a tty.
+
+  static const struct { int baud; speed_t speed; } speeds[] = {
+    { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 },
+    { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+    { 115200, B115200 },
+  };
+  int i;
+  for( i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++ ) {
+    if( speeds[i].baud == baud ) {
+      cfsetispeed(&tio, speeds[i].speed);
+      cfsetospeed(&tio, speeds[i].speed);
+      break;
+    }
+  }
+  cfmakeraw(&tio);
+  tcsetattr(fd, TCSANOW, &tio);
+
+  return 0;
+}
+
+
+//================================================================
+/*!@brief
+  read from UART port. (non-blocking)
+
+  @param  port	port number.
+  @param  buf	pointer of buffer.
+  @param  nbytes	buffer size.
+  @return	number of bytes read, or 0 if no data.
+*/
+int hal_uart_read(int port, void *buf, int nbytes)
+{
+  if( port < 0 || port >= HAL_UART_MAX_PORT || uart_fd_[port] < 0 ) return 0;
+
+  int n = read(uart_fd_[port], buf, nbytes);
+  return n < 0 ? 0 : n;
+}
+
+
+//================================================================
+/*!@brief
+  write to UART port.
+
+  @param  port	port number.
+  @param  buf	pointer of buffer.
+  @param  nbytes	output byte length.
+  @return	number of bytes written.
+*/
+int hal_uart_write(int port, const void *buf, int nbytes)
+{
+  if( port < 0 || port >= HAL_UART_MAX_PORT || uart_fd_[port] < 0 ) return 0;
+
+  int n = write(uart_fd_[port], buf, nbytes);
+  return n < 0 ? 0 : n;
+}
+
+
+#if MRBC_USE_BUS
+//================================================================
+/*!@brief
+  attach a simulated device to the bus.
+
+  The device has 256 registers. The first byte written sets the
+  register pointer, the following bytes are written to the registers,
+  and reads return the registers, incrementing the pointer.
+  On SPI, bit 7 of the first byte is the read flag. (e.g. BME280)
+
+  The script sets registers, and command/response rules.
+  A rule matches the whole bytes written, then the next read returns
+  the response, instead of the registers. (e.g. SCD30)
+
+    # comment
+    reg 0xd0 60			register 0xd0 = 0x60
+    reg 0xf7 50 00 00 80 00	registers 0xf7.. (burst)
+    on 02 02 -> 00 01		command 0x0202, response 0x00 0x01
+
+  Transfers complete inside hal_bus_start(), so without delay.
+
+  @param  type	MRBC_BUS_I2C or MRBC_BUS_SPI
+  @param  bus	bus number.
+  @param  addr	I2C address, or SPI chip select.
+  @param  script	device script, or NULL.
+  @retval 0	No error.
+  @retval -1	error. (too many devices, or syntax error)
+*/
+int hal_bus_sim_attach(int type, int bus, int addr, const char *script)
+{
+  bus_sim_device *d = bus_sim_find(type, bus, addr);
+  if( !d ) d = bus_sim_find(0, 0, -1);
+  if( !d ) return -1;
+
+  memset(d, 0, sizeof(bus_sim_device));
+  d->type = type;
+  d->bus = bus;
+  d->addr = addr;
+  d->pending = -1;
+  if( !script ) return 0;
+
+  char *buf = strdup(script);
+  char *save;
+  char *line = strtok_r(buf, "\n", &save);
+  int ret = 0;
+
+  for( ; line != NULL && ret == 0; line = strtok_r(NULL, "\n", &save) ) {
+    char *p = strchr(line, '#');
+    if( p ) *p = '\0';
+    p = line + strspn(line, " \t");
+    if( *p == '\0' ) continue;
+
+    if( strncmp(p, "reg ", 4) == 0 ) {
+      uint8_t bytes[257];
+      int n = bus_sim_hex(p + 4, bytes, sizeof(bytes));
+      if( n < 1 || bytes[0] + n - 1 > 256 ) { ret = -1; break; }
+      memcpy(d->regs + bytes[0], bytes + 1, n - 1);
+
+    } else if( strncmp(p, "on ", 3) == 0 && d->n_rules < BUS_SIM_MAX_RULES ) {
+      char *res = strstr(p, "->");
+      if( !res ) { ret = -1; break; }
+      *res = '\0';
+      int n1 = bus_sim_hex(p + 3, d->rules[d->n_rules].cmd, BUS_SIM_MAX_CMD);
+      int n2 = bus_sim_hex(res + 2, d->rules[d->n_rules].res, BUS_SIM_MAX_RES);
+      if( n1 <= 0 || n2 < 0 ) { ret = -1; break; }
+      d->rules[d->n_rules].cmd_len = n1;
+      d->rules[d->n_rules].res_len = n2;
+      d->n_rules++;
+
+    } else {
+      ret = -1;
+    }
+  }
+  free(buf);
+
+  if( ret != 0 ) memset(d, 0, sizeof(bus_sim_device));
+  return ret;
+}
+
+
+//================================================================
+/*!@brief
+  registers of the simulated device.
+  the application can change them, to give signals.
+
+  @return	pointer to 256 registers, or NULL if not attached.
+*/
+uint8_t *hal_bus_sim_regs(int type, int bus, int addr)
+{
+  bus_sim_device *d = bus_sim_find(type, bus, addr);
+  return d ? d->regs : NULL;
+}
+
+
+//================================================================
+/*!@brief
+  open the bus. (simulated)
+
+  @retval 0	No error.
+  @retval -1	error. (no device attached)
+*/
+int hal_bus_open(int type, int bus, int addr, uint32_t freq, int mode)
+{
+  if( type == MRBC_BUS_I2C ) addr = -1;		// any device on the bus.
+  return bus_sim_find(type, bus, addr) ? 0 : -1;
+}
+
+
+//================================================================
+/*!@brief
+  start transfer. (simulated, completes immediately)
+
+  @retval 0	No error.
+  @retval -1	error. (no device, as NACK)
+*/
+int hal_bus_start(struct RBusXfer *x)
+{
+  bus_sim_device *d = bus_sim_find(x->type, x->bus, x->addr);
+  if( !d ) return -1;
+
+  int flag_write = 1;
+  int i;
+
+  // write
+  if( x->tx_len > 0 ) {
+    d->pending = -1;
+    for( i = 0; i < d->n_rules; i++ ) {
+      if( d->rules[i].cmd_len == x->tx_len &&
+          memcmp(d->rules[i].cmd, x->tx, x->tx_len) == 0 ) {
+        d->pending = i;
+        break;
+      }
+    }
+
+    d->ptr = x->tx[0];
+    if( x->type == MRBC_BUS_SPI ) {
+      flag_write = !(x->tx[0] & 0x80);
+      d->ptr &= 0x7f;
+    }
+  }
+
+  if( x->flags & MRBC_BUS_DUPLEX ) {
+    if( x->rx_len > 0 ) x->rx[0] = 0xff;
+    for( i = 1; i < x->tx_len; i++ ) {
+      uint8_t b = d->regs[d->ptr];
+      if( flag_write ) d->regs[d->ptr] = x->tx[i];
+      if( i < x->rx_len ) x->rx[i] = b;
+      d->ptr++;
+    }
+    mrbc_bus_complete(x, x->tx_len);
+    return 0;
+  }
+
+  if( d->pending < 0 && flag_write ) {
+    for( i = 1; i < x->tx_len; i++ ) d->regs[d->ptr++] = x->tx[i];
+  }
+
+  // read
+  if( x->rx_len > 0 ) {
+    if( d->pending >= 0 ) {
+      int n = d->rules[d->pending].res_len;
+      for( i = 0; i < x->rx_len; i++ ) {
+        x->rx[i] = i < n ? d->rules[d->pending].res[i] : 0xff;
+      }
+      d->pending = -1;
+    } else {
+      for( i = 0; i < x->rx_len; i++ ) x->rx[i] = d->regs[d->ptr++];
+    }
+  }
+
+  mrbc_bus_complete(x, x->tx_len + x->rx_len);
+  return 0;
+}
+#endif
+
+
+#if MRBC_USE_GPIO
+//================================================================
+/*!@brief
+  set input mode of GPIO pin. (simulated)
+
+  The pin starts at the pulled level, or low.
+
+  @param  pin	GPIO number.
+  @param  pull	MrbcGpioPull
+  @param  edge	MrbcGpioEdge to report by mrbc_gpio_event().
+  @retval 0	No error.
+  @retval -1	error.
+*/
+int hal_gpio_input(int pin, int pull, int edge)
+{
+  if( pin < 0 || pin >= GPIO_SIM_MAX_PINS ) return -1;
+
+  gpio_level_[pin] = (pull == MRBC_GPIO_PULL_UP);
+  gpio_edge_[pin] = edge;
+  return 0;
+}
+
+
+//================================================================
+/*!@brief
+  read GPIO pin level. (simulated)
+
+*/
+int hal_gpio_read(int pin)
+{
+  if( pin < 0 || pin >= GPIO_SIM_MAX_PINS ) return 0;
+  return gpio_level_[pin];
+}
+
+
+//================================================================
+/*!@brief
+  pulse counter. not simulated, c_gpio.c counts edges instead.
+
+  @retval -1	no counter.
+*/
+int hal_gpio_counter_open(int pin)
+{
+  return -1;
+}
+
+int hal_gpio_counter_read(int pin)
+{
+  return 0;
+}
+
+void hal_gpio_counter_clear(int pin)
+{
+}
+
+
+//================================================================
+/*!@brief
+  change the level of simulated GPIO pin, as the interrupt handler.
+
+  @param  pin	GPIO number.
+  @param  level	0 or 1.
+*/
+void hal_gpio_sim_inject(int pin, int level)
+{
+  if( pin < 0 || pin >= GPIO_SIM_MAX_PINS ) return;
+  gpio_sim_set(pin, !!level, hal_micros());
+}
+
+
+//================================================================
+/*!@brief
+  play level changes of simulated GPIO pins.
+
+  A line is a step, delay from the previous step (us), pin and level.
+  hal_sim_poll() injects them in time, at 1ms resolution.
+  (e.g.) a bouncing button, then a 10kHz burst.
+
+    # delay pin level
+    0 4 0
+    200 4 1
+    150 4 0
+    1000 5 1
+    50 5 0
+    50 5 1
+
+  @param  script	steps, or NULL to stop.
+  @retval 0	No error.
+  @retval -1	error. (syntax error, or ENOMEM)
+*/
+int hal_gpio_sim_play(const char *script)
+{
+  hal_disable_irq();
+  free(gpio_steps_);
+  gpio_steps_ = NULL;
+  gpio_n_steps_ = 0;
+  gpio_step_ = 0;
+  hal_enable_irq();
+  if( !script ) return 0;
+
+  int size = 1;
+  const char *p;
+  for( p = script; *p; p++ ) if( *p == '\n' ) size++;
+  gpio_sim_step *steps = malloc(sizeof(gpio_sim_step) * size);
+  if( !steps ) return -1;
+
+  char *buf = strdup(script);
+  char *save;
+  char *line = strtok_r(buf, "\n", &save);
+  int n = 0;
+
+  for( ; line != NULL; line = strtok_r(NULL, "\n", &save) ) {
+    char *c = strchr(line, '#');
+    if( c ) *c = '\0';
+    if( line[strspn(line, " \t")] == '\0' ) continue;
+
+    unsigned long delay_us;
+    int pin, level;
+    char extra;
+    if( sscanf(line, "%lu %d %d %c", &delay_us, &pin, &level, &extra) != 3 ||
+        pin < 0 || pin >= GPIO_SIM_MAX_PINS ) {
+      n = -1;
+      break;
+    }
+    steps[n].delay_us = delay_us;
+    steps[n].pin = pin;
+    steps[n].level = !!level;
+    n++;
+  }
+  free(buf);
+
+  if( n < 0 ) {
+    free(steps);
+    return -1;
+  }
+
+  hal_disable_irq();
+  gpio_steps_ = steps;
+  gpio_n_steps_ = n;
+  gpio_step_us_ = hal_micros();
+  hal_enable_irq();
+
+  return 0;
+}
+#endif
+
+
+#if MRBC_USE_ADC
+//================================================================
+/*!@brief
+  open simulated ADC channel.
+
+  @param  ch	channel.
+  @retval 0	No error.
+  @retval -1	error.
+*/
+int hal_adc_open(int ch)
+{
+  return (ch >= 0 && ch < ADC_SIM_MAX_CHANNELS) ? 0 : -1;
+}
+
+
+//================================================================
+/*!@brief
+  read raw value of simulated ADC channel, with the noise.
+
+  @param  ch	channel.
+  @return	0 to 4095.
+*/
+int hal_adc_read_raw(int ch)
+{
+  int mv = adc_mv_[ch];
+
+  if( adc_noise_mv_[ch] ) {
+    adc_rand_ = adc_rand_ * 1103515245 + 12345;
+    int span = adc_noise_mv_[ch] * 2 + 1;
+    mv += (int)((adc_rand_ >> 16) % span) - adc_noise_mv_[ch];
+  }
+  if( mv < 0 ) mv = 0;
+  if( mv > ADC_SIM_FULL_SCALE_MV ) mv = ADC_SIM_FULL_SCALE_MV;
+
+  return mv * 4095 / ADC_SIM_FULL_SCALE_MV;
+}
+
+
+//================================================================
+/*!@brief
+  convert raw value to mV. (linear)
+
+  @param  ch	channel.
+  @param  raw	0 to 4095.
+  @return	mV.
+*/
+int hal_adc_raw_to_mv(int ch, int raw)
+{
+  return raw * ADC_SIM_FULL_SCALE_MV / 4095;
+}
+
+
+//================================================================
+/*!@brief
+  start or stop the sweeps. hal_sim_poll() runs them.
+
+  @param  rate_hz	sweeps per second, or 0 to stop.
+  @retval 0	No error.
+*/
+int hal_adc_start(int rate_hz)
+{
+  hal_disable_irq();
+  adc_period_us_ = rate_hz > 0 ? 1000000 / rate_hz : 0;
+  adc_sweep_us_ = hal_micros();
+  hal_enable_irq();
+
+  return 0;
+}
+
+
+//================================================================
+/*!@brief
+  set the input of simulated ADC channel.
+
+  @param  ch		channel.
+  @param  mv		input voltage.
+  @param  noise_mv	uniform noise added to each sample, +/-.
+*/
+void hal_adc_sim_set(int ch, int mv, int noise_mv)
+{
+  if( ch < 0 || ch >= ADC_SIM_MAX_CHANNELS ) return;
+  adc_mv_[ch] = mv < 0 ? 0 : mv;
+  adc_noise_mv_[ch] = noise_mv < 0 ? 0 : noise_mv;
+}
+#endif
+
+
+//================================================================
+/*!@brief
+  run the simulated devices that are due. (GPIO steps and ADC sweeps)
+  called from the timer, or hal_idle_cpu() if MRBC_NO_TIMER.
+
+*/
+void hal_sim_poll(void)
+{
+#if MRBC_USE_GPIO
+  uint32_t now = hal_micros();
+
+  while( gpio_step_ < gpio_n_steps_ ) {
+    const gpio_sim_step *st = &gpio_steps_[gpio_step_];
+    if( (uint32_t)(now - gpio_step_us_) < st->delay_us ) break;
+
+    // the edge is stamped at its scheduled time, not at the poll.
+    gpio_step_us_ += st->delay_us;
+    gpio_sim_set(st->pin, st->level, gpio_step_us_);
+    gpio_step_++;
+  }
+#endif
+
+#if MRBC_USE_ADC
+  if( adc_period_us_ ) {
+    uint32_t now_us = hal_micros();
+    if( (uint32_t)(now_us - adc_sweep_us_) >= adc_period_us_ ) {
+      // one sweep per poll, late sweeps are dropped.
+      adc_sweep_us_ = now_us;
+      mrbc_adc_sweep();
+    }
+  }
+#endif
+}
@@ -0,0 +1,151 @@
+/*! @file
+  @brief
+  Hardware abstraction layer
+        for POSIX
+
+  <pre>
+  Copyright (C) 2016-2018 Kyushu Institute of Technology.
+  Copyright (C) 2016-2018 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef MRBC_SRC_HAL_H_
+#define MRBC_SRC_HAL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***** Feature test switches ************************************************/
+/***** System headers *******************************************************/
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+
+/***** Local headers ********************************************************/
+/***** Constant values ******************************************************/
+#define HAL_UART_MAX_PORT 4
+
+
+/***** Macros ***************************************************************/
+#ifndef MRBC_SCHEDULER_EXIT
+#define MRBC_SCHEDULER_EXIT 1
+#endif
+
+
+/***** Typedefs *************************************************************/
+/***** Global variables *****************************************************/
+/***** Function prototypes **************************************************/
+struct RBusXfer;
+void mrbc_tick(void);
+
+int hal_uart_attach(int port, const char *path);
+int hal_uart_open(int port, int baud);
+int hal_uart_read(int port, void *buf, int nbytes);
+int hal_uart_write(int port, const void *buf, int nbytes);
+
+int hal_bus_open(int type, int bus, int addr, uint32_t freq, int mode);
+int hal_bus_start(struct RBusXfer *x);
+int hal_bus_sim_attach(int type, int bus, int addr, const char *script);
+uint8_t *hal_bus_sim_regs(int type, int bus, int addr);
+
+int hal_gpio_input(int pin, int pull, int edge);
+int hal_gpio_read(int pin);
+int hal_gpio_counter_open(int pin);
+int hal_gpio_counter_read(int pin);
+void hal_gpio_counter_clear(int pin);
+void hal_gpio_sim_inject(int pin, int level);
+int hal_gpio_sim_play(const char *script);
+
+int hal_adc_open(int ch);
+int hal_adc_read_raw(int ch);
+int hal_adc_raw_to_mv(int ch, int raw);
+int hal_adc_start(int rate_hz);
+void hal_adc_sim_set(int ch, int mv, int noise_mv);
+
+void hal_sim_poll(void);
+
+#if defined(MRBC_VIRTUAL_TIME)
+// given by the application, to run on its own clock. (e.g. host/fleet_sim.c)
+uint32_t hal_micros(void);
+void hal_idle_cpu(void);
+#endif
+
+#ifndef MRBC_NO_TIMER
+void hal_init(void);
+void hal_enable_irq(void);
+void hal_disable_irq(void);
+# define hal_idle_cpu()    sleep(1) // maybe interrupt by SIGALRM
+
+#else // MRBC_NO_TIMER
+# define hal_init()        ((void)0)
+# define hal_enable_irq()  ((void)0)
+# define hal_disable_irq() ((void)0)
+# if !defined(MRBC_VIRTUAL_TIME)
+# define hal_idle_cpu()    (usleep(1000), hal_sim_poll(), mrbc_tick())
+# endif
+
+#endif
+
+
+/***** Inline functions *****************************************************/
+
+//================================================================
+/*!@brief
+  Write
+
+  @param  fd    dummy, but 1.
+  @param  buf   pointer of buffer.
+  @param  nbytes        output byte length.
+*/
+inline static int hal_write(int fd, const void *buf, int nbytes)
+{
+  return write(1, buf, nbytes);
+}
+
+//================================================================
+/*!@brief
+  Flush write baffer
+
+  @param  fd    dummy, but 1.
+*/
+inline static int hal_flush(int fd)
+{
+  return fsync(1);
+}
+
+#if !defined(MRBC_VIRTUAL_TIME)
+//================================================================
+/*!@brief
+  Get elapsed time in micro seconds. (wrap around 32bit)
+
+*/
+inline static uint32_t hal_micros(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+#endif
+
+//================================================================
+/*!@brief
+  Get CPU cycle counter. (wrap around 32bit)
+  No portable counter, returns nano seconds instead.
+
+*/
+inline static uint32_t hal_cycles(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // ifndef MRBC_HAL_H_
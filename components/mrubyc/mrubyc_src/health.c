@@ -0,0 +1,153 @@
+/*! @file
+  @brief
+  Health record of the device.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  The record is written without allocation, so that it can be made
+  when the heap is exhausted. (see mrbc_health_record)
+  </pre>
+*/
+
+#include "vm_config.h"
+#include <stdint.h>
+#include <string.h>
+
+#include "value.h"
+#include "alloc.h"
+#include "vm.h"
+#include "class.h"
+#include "symbol.h"
+#include "console.h"
+#include "c_string.h"
+#include "rrt0.h"
+#include "runtime.h"
+#include "health.h"
+#include "hal/hal.h"
+
+
+#if MRBC_USE_HEALTH
+
+//================================================================
+/*! output unsigned decimal, without allocation. (cf. mrbc_printf_int)
+*/
+static void put_uint(mrbc_printf *pf, uint32_t value)
+{
+  char buf[10];
+  int i = sizeof(buf);
+
+  do {
+    buf[--i] = '0' + value % 10;
+    value /= 10;
+  } while( value != 0 );
+
+  mrbc_printf_bstr( pf, buf + i, sizeof(buf) - i, ' ' );
+}
+
+
+//================================================================
+/*! output tasks in the queue, and clear their counters.
+*/
+static void put_tasks(mrbc_printf *pf, mrbc_tcb *tcb, uint32_t interval_us, int *n)
+{
+  for( ; tcb != NULL; tcb = tcb->next ) {
+    if( (*n)++ ) mrbc_printf_char( pf, ',' );
+    put_uint( pf, tcb->vm.vm_id );
+    mrbc_printf_char( pf, ':' );
+    put_uint( pf, interval_us ? (uint64_t)tcb->run_us * 1000 / interval_us : 0 );
+    mrbc_printf_char( pf, ':' );
+    put_uint( pf, tcb->switches );
+
+    tcb->run_us = 0;
+    tcb->switches = 0;
+  }
+}
+
+
+//================================================================
+/*! make the health record. (see health.h)
+
+  @param  buf	output buffer.
+  @param  size	buffer size, MRBC_HEALTH_RECORD_SIZE. (truncated if short)
+  @return	length.
+*/
+int mrbc_health_record(char *buf, int size)
+{
+  mrbc_runtime *rt = mrbc_current_runtime;
+  int total, used, free, fragmentation, sym_used;
+  mrbc_printf pf;
+
+  mrbc_alloc_statistics( &total, &used, &free, &fragmentation );
+  int largest = mrbc_alloc_largest_free();
+  mrbc_symbol_statistics( &sym_used );
+
+  mrbc_printf_init( &pf, buf, size, NULL );
+  mrbc_printf_str( &pf, "up=", ' ' );
+  put_uint( &pf, rt->tick / 1000 );
+  mrbc_printf_str( &pf, "&heap=", ' ' );
+  put_uint( &pf, used );
+  mrbc_printf_char( &pf, ',' );
+  put_uint( &pf, free );
+  mrbc_printf_char( &pf, ',' );
+  put_uint( &pf, fragmentation );
+  mrbc_printf_char( &pf, ',' );
+  put_uint( &pf, largest );
+  mrbc_printf_str( &pf, "&sym=", ' ' );
+  put_uint( &pf, sym_used );
+  mrbc_printf_char( &pf, ',' );
+  put_uint( &pf, MAX_SYMBOLS_COUNT );
+
+  // counters of the tick handler and the scheduler.
+  hal_disable_irq();
+  uint32_t now_us = hal_micros();
+  uint32_t interval_us = now_us - rt->health_us;
+  rt->health_us = now_us;
+
+  mrbc_printf_str( &pf, "&overruns=", ' ' );
+  put_uint( &pf, rt->tick_overruns );
+  rt->tick_overruns = 0;
+
+  int n = 0;
+  mrbc_printf_str( &pf, "&tasks=", ' ' );
+  put_tasks( &pf, rt->q_ready, interval_us, &n );
+  put_tasks( &pf, rt->q_waiting, interval_us, &n );
+  put_tasks( &pf, rt->q_suspended, interval_us, &n );
+  hal_enable_irq();
+
+  mrbc_printf_end( &pf );
+  return mrbc_printf_len( &pf );
+}
+
+
+//================================================================
+/*! (method) VM.health
+
+  return the health record String, or nil if no memory.
+*/
+static void c_vm_health(struct VM *vm, mrbc_value v[], int argc)
+{
+  char buf[MRBC_HEALTH_RECORD_SIZE];
+  int len = mrbc_health_record( buf, sizeof(buf) );
+
+  mrbc_value ret = mrbc_string_new( vm, buf, len );
+  if( ret.string == NULL ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  SET_RETURN( ret );
+}
+
+
+//================================================================
+/*! define methods to VM class.
+*/
+void mrbc_health_define_methods(struct RClass *cls)
+{
+  mrbc_define_method(0, cls, "health", c_vm_health);
+}
+
+#endif // MRBC_USE_HEALTH
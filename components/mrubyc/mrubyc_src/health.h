@@ -0,0 +1,54 @@
+/*! @file
+  @brief
+  Health record of the device.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  One line of heap, task, symbol table and tick statistics, sent with
+  the sensor readings. Enabled by MRBC_USE_HEALTH.
+
+    up=s&heap=used,free,frag,largest&sym=used,max&overruns=n&tasks=id:cpu:sw,...
+
+    up		uptime in seconds.
+    heap	bytes used and free, number of used/free boundaries,
+		(see mrbc_alloc_statistics) and the largest allocatable size.
+    sym		symbol table entries, used and MAX_SYMBOLS_COUNT.
+    overruns	ticks late by one period or more. (see mrbc_tick)
+    tasks	vm_id, CPU time in per mille and switches of each task,
+		except dormant tasks.
+
+  overruns and tasks are counted from the previous record.
+
+  (e.g.)
+    puts "HEALTH:#{VM.health}"
+  </pre>
+*/
+
+#ifndef MRBC_SRC_HEALTH_H_
+#define MRBC_SRC_HEALTH_H_
+
+#include <stdint.h>
+#include "vm_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if MRBC_USE_HEALTH
+#define MRBC_HEALTH_RECORD_SIZE (80 + 16 * MAX_VM_COUNT)
+
+struct RClass;
+
+int mrbc_health_record(char *buf, int size);
+void mrbc_health_define_methods(struct RClass *cls);
+#endif
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -104,6 +104,16 @@ static int load_header(struct VM *vm, const uint8_t **pos)
    (loop n of symbol)
      0000	length
      ...	symbol data
+
+  In a linked image, (see mrbc_load_mrb)
+     03		type of string POOL
+     0002	length
+     0000	index of the shared string
+
+   8000_0000	n of symbol | 0x8000_0000
+   0000_0000	distance back to the symbol table
+   (loop n of symbol)
+     0000	index of the shared symbol, FFFF is null
   </pre>
 */
 static mrbc_irep * load_irep_1(struct VM *vm, const uint8_t **pos)
@@ -164,6 +174,13 @@ static mrbc_irep * load_irep_1(struct VM *vm, const uint8_t **pos)
       obj->tt = MRBC_TT_STRING;
       obj->str = (char*)p;
     } break;
+
+    case 3: { // linked image, index of the shared string.
+      const uint8_t *tbl = vm->mrb + MRBC_IMAGE_HEADER_SIZE +
+	4 * bin_to_uint16(vm->mrb + 14);
+      obj->tt = MRBC_TT_STRING;
+      obj->str = (char*)tbl + bin_to_uint32(tbl + 4 * bin_to_uint16(p)) + 2;
+    } break;
 #endif
     case 1: { // IREP_TT_FIXNUM
       char buf[obj_size+1];
@@ -191,8 +208,12 @@ static mrbc_irep * load_irep_1(struct VM *vm, const uint8_t **pos)
 
   // SYMS BLOCK
   irep->ptr_to_sym = (uint8_t*)p;
-  int slen = bin_to_uint32(p);		p += 4;
-  while( --slen >= 0 ) {
+  uint32_t slen = bin_to_uint32(p);	p += 4;
+  if( slen & MRBC_IMAGE_SYMS_LINKED ) {
+    p += 4 + 2 * (slen & ~MRBC_IMAGE_SYMS_LINKED);
+    slen = 0;
+  }
+  while( slen-- > 0 ) {
     int s = bin_to_uint16(p);		p += 2;
     p += s+1;
   }
@@ -281,6 +302,29 @@ static int load_lvar(struct VM *vm, const uint8_t **pos)
 }
 
 
+//================================================================
+/*!@brief
+  Load a script of linked image.
+
+  @param  vm    Pointer to VM.
+  @param  ptr	Pointer to "MRBS" of the script.
+  @return int	zero if no error.
+*/
+static int load_linked(struct VM *vm, const uint8_t *ptr)
+{
+  vm->mrb = ptr - bin_to_uint32(ptr + 4);
+  if( memcmp(vm->mrb, "MRBL0001", 8) != 0 ) {
+    mrbc_raise(vm, E_BYTECODE_ERROR, NULL);
+    return -1;
+  }
+
+  ptr += 8;
+  vm->irep = load_irep_0(vm, &ptr);
+
+  return vm->irep ? 0 : -1;
+}
+
+
 //================================================================
 /*!@brief
   Load the VM bytecode.
@@ -288,12 +332,34 @@ static int load_lvar(struct VM *vm, const uint8_t **pos)
   @param  vm    Pointer to VM.
   @param  ptr	Pointer to bytecode.
 
+  <pre>
+  ptr is a RITE binary, or a script of linked image by tools/link_mrb.rb.
+  The scripts of an image share one symbol and string pool.
+
+  Structure of linked image
+   "MRBL"	identifier
+   "0001"	version
+   0000_0000	total size
+   0000		n of script
+   0000		n of symbol
+   0000		n of string
+   (0000_0000)	offset of each symbol, from the symbol table.
+   (0000_0000)	offset of each string, from the string table.
+   (0000 ... 00)	length, data and '\0' of each symbol, then string.
+   (loop n of script)
+     "MRBS"	identifier
+     0000_0000	offset from the image top
+     ...	IREP records. (see load_irep_1)
+   "END\0"
+  </pre>
 */
 int mrbc_load_mrb(struct VM *vm, const uint8_t *ptr)
 {
   int ret = -1;
-  vm->mrb = ptr;
 
+  if( memcmp(ptr, "MRBS", 4) == 0 ) return load_linked(vm, ptr);
+
+  vm->mrb = ptr;
   ret = load_header(vm, &ptr);
   while( ret == 0 ) {
     if( memcmp(ptr, "IREP", 4) == 0 ) {
@@ -305,7 +371,138 @@ int mrbc_load_mrb(struct VM *vm, const uint8_t *ptr)
     else if( memcmp(ptr, "END\0", 4) == 0 ) {
       break;
     }
+    else {			// e.g. DBG section. (mrbc -g)
+      ptr += bin_to_uint32(ptr+4);
+    }
   }
 
   return ret;
 }
+
+
+
+//================================================================
+/*!@brief
+  Find the IREP index in depth first order, same as the order of records.
+
+  @param  irep	root IREP.
+  @param  target	IREP to find.
+  @param  idx	counter.
+  @return int	index or -1 if not found.
+*/
+static int irep_index(const mrbc_irep *irep, const mrbc_irep *target, int *idx)
+{
+  int i;
+
+  if( irep == target ) return *idx;
+  (*idx)++;
+  for( i = 0; i < irep->rlen; i++ ) {
+    int ret = irep_index( irep->reps[i], target, idx );
+    if( ret >= 0 ) return ret;
+  }
+  return -1;
+}
+
+
+//================================================================
+/*!@brief
+  Get the source position from DBG section. (mrbc -g)
+
+  Debug information is read from the bytecode directly when it is needed,
+  and not loaded to RAM.
+
+  @param  vm	Pointer to VM.
+  @param  irep	IREP of the VM.
+  @param  pc	offset of the instruction in irep->code.
+  @param  fname	(out) file name, NOT null terminated.
+  @param  fname_len	(out) length of file name.
+  @return int	line number, or zero if not found.
+
+  <pre>
+  Structure
+   "DBG\0"	identifier
+   0000_0000	section size
+   0000		number of file names
+   (0000 name)	length and file name, repeated.
+   records in the order of IREP, each
+    0000_0000	record size
+    0000		number of files
+     0000_0000	start position
+     0000	file name index
+     0000_0000	number of line entries
+     00		line type. 0:array of line, 1:flat map
+     (0000)	line of each code byte, or
+     (0000_0000 0000)	start position and line.
+  </pre>
+*/
+int mrbc_debug_get_line(const struct VM *vm, const mrbc_irep *irep, int pc,
+			const char **fname, int *fname_len)
+{
+  const uint8_t *p;
+  const uint8_t *names;
+  int n = 0;
+  int idx, i;
+
+  if( !vm->mrb || !vm->irep ) return 0;
+  if( memcmp(vm->mrb, "RITE", 4) != 0 ) return 0;	// linked image.
+  idx = irep_index( vm->irep, irep, &n );
+  if( idx < 0 ) return 0;
+
+  // find DBG section.
+  p = vm->mrb + 22;		// 22 = sizeof(RITE header)
+  while( memcmp(p, "DBG\0", 4) != 0 ) {
+    if( memcmp(p, "END\0", 4) == 0 ) return 0;
+    p += bin_to_uint32(p+4);
+  }
+  p += 8;
+
+  // file names table.
+  names = p + 2;
+  p = names;
+  for( i = bin_to_uint16(names-2); i > 0; i-- ) {
+    p += 2 + bin_to_uint16(p);
+  }
+
+  // skip records of other IREPs.
+  for( ; idx > 0; idx-- ) {
+    p += bin_to_uint32(p);
+  }
+
+  int n_files = bin_to_uint16(p+4);
+  int line = 0;
+  int fidx = -1;
+  p += 6;
+  for( i = 0; i < n_files; i++ ) {
+    int start_pos = bin_to_uint32(p);
+    int n_lines = bin_to_uint32(p+6);
+    int line_type = p[10];
+    const uint8_t *lines = p + 11;
+
+    if( pc >= start_pos ) {
+      fidx = bin_to_uint16(p+4);
+      if( line_type == 0 ) {
+	if( pc - start_pos < n_lines ) {
+	  line = bin_to_uint16(lines + (pc - start_pos) * 2);
+	}
+      } else {
+	int j;
+	for( j = 0; j < n_lines; j++ ) {
+	  if( bin_to_uint32(lines + j * 6) > pc ) break;
+	  line = bin_to_uint16(lines + j * 6 + 4);
+	}
+      }
+    }
+    p = lines + n_lines * (line_type == 0 ? 2 : 6);
+  }
+  if( fidx < 0 ) return 0;
+
+  // file name.
+  p = names;
+  for( ; fidx > 0; fidx-- ) {
+    p += 2 + bin_to_uint16(p);
+  }
+  *fname_len = bin_to_uint16(p);
+  *fname = (const char *)p + 2;
+
+  return line;
+}
@@ -20,8 +20,15 @@
 extern "C" {
 #endif
 
+// linked image. (see mrbc_load_mrb, tools/link_mrb.rb)
+#define MRBC_IMAGE_HEADER_SIZE 18
+#define MRBC_IMAGE_SYMS_LINKED 0x80000000
+#define MRBC_IMAGE_NULL_SYM 0xffff
+
 struct VM;
+struct IREP;
 int mrbc_load_mrb(struct VM *vm, const uint8_t *ptr);
+int mrbc_debug_get_line(const struct VM *vm, const struct IREP *irep, int pc, const char **fname, int *fname_len);
 
 
 #ifdef __cplusplus
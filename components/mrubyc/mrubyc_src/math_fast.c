@@ -0,0 +1,235 @@
+/*! @file
+  @brief
+  Fast approximate math functions in float32.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  The FPU of ESP32 is single precision, so libm in double is done by
+  software. These functions use float only, reduce the argument by
+  the exponent bits or by pi/2, and evaluate a short polynomial.
+  Its degree is chosen by MRBC_MATH_FAST_DIGITS, to keep the relative
+  error under 10^-DIGITS. (absolute error for sin and cos)
+  see host/math_bench.c for the accuracy and speed against libm.
+  </pre>
+*/
+
+#include "vm_config.h"
+#include <stdint.h>
+#include <math.h>
+#include "math_fast.h"
+
+#if MRBC_USE_MATH_FAST
+
+#if MRBC_MATH_FAST_DIGITS < 3 || MRBC_MATH_FAST_DIGITS > 6
+# error "MRBC_MATH_FAST_DIGITS must be 3..6"
+#endif
+
+#define LN2_F		0.69314718f
+#define LN2_HI		0.693145751953125f	// log(2) = HI + LO, k*HI is exact.
+#define LN2_LO		1.42860677e-06f
+#define INV_LN2_F	1.44269504f
+#define PI_2_HI		1.5703125f		// pi/2 = HI + MID + LO
+#define PI_2_MID	4.83751297e-04f
+#define PI_2_LO		7.54978995e-08f
+#define INV_PI_2	0.63661977f
+#define TRIG_MAX	65536.0f	// use libm above this.
+#define ROUND_MAGIC	12582912.0f	// 1.5 * 2^23, rounds to integer.
+
+typedef union {
+  float f;
+  uint32_t u;
+  int32_t i;
+} float_bits;
+
+
+//================================================================
+/*! natural logarithm.
+
+  x = m * 2^e (sqrt(1/2) <= m < sqrt(2)), t = (m-1)/(m+1)
+  log(x) = e*log(2) + 2*(t + t^3/3 + t^5/5 + ...)
+*/
+float mrbc_fast_logf(float x)
+{
+  float_bits b = {.f = x};
+
+  if( b.i <= 0 ) return (x == 0) ? -INFINITY : NAN;
+  if( b.u >= 0x7f800000 ) return x;		// inf, nan
+  if( b.u < 0x00800000 ) {			// subnormal
+    b.f = x * 16777216.0f;			// 2^24
+    b.i -= 24 << 23;
+  }
+
+  int32_t e = ((b.i - 0x3f3504f3) >> 23);	// 0x3f3504f3 = sqrt(1/2)
+  b.u -= (uint32_t)e << 23;
+  float t = (b.f - 1) / (b.f + 1);
+  float t2 = t * t;
+
+#if MRBC_MATH_FAST_DIGITS <= 3
+  float p = 2 + t2 * (2.0f/3);
+#elif MRBC_MATH_FAST_DIGITS <= 4
+  float p = 2 + t2 * ((2.0f/3) + t2 * (2.0f/5));
+#else
+  float p = 2 + t2 * ((2.0f/3) + t2 * ((2.0f/5) + t2 * (2.0f/7)));
+#endif
+
+  return e * LN2_F + t * p;
+}
+
+
+//================================================================
+/*! exponential.
+
+  x = k*log(2) + r (|r| <= log(2)/2)
+  exp(x) = 2^k * (1 + r + r^2/2! + ...)
+*/
+float mrbc_fast_expf(float x)
+{
+  if( x != x ) return x;			// nan
+  if( x > 88.72f ) return INFINITY;
+  if( x < -87.33f ) return 0;
+
+  float_bits kb = {.f = x * INV_LN2_F + ROUND_MAGIC};
+  int32_t k = kb.i - 0x4b400000;		// round(x / log(2))
+  float kf = kb.f - ROUND_MAGIC;
+  float r = (x - kf * LN2_HI) - kf * LN2_LO;
+
+#if MRBC_MATH_FAST_DIGITS <= 3
+  float p = 1 + r * (1 + r * (1.0f/2 + r * (1.0f/6)));
+#elif MRBC_MATH_FAST_DIGITS <= 4
+  float p = 1 + r * (1 + r * (1.0f/2 + r * (1.0f/6 + r * (1.0f/24))));
+#elif MRBC_MATH_FAST_DIGITS <= 5
+  float p = 1 + r * (1 + r * (1.0f/2 + r * (1.0f/6 + r * (1.0f/24 +
+	    r * (1.0f/120)))));
+#else
+  float p = 1 + r * (1 + r * (1.0f/2 + r * (1.0f/6 + r * (1.0f/24 +
+	    r * (1.0f/120 + r * (1.0f/720))))));
+#endif
+
+  // 2^k, k may be -126..128, in two steps.
+  float_bits s1 = {.u = (uint32_t)(k / 2 + 127) << 23};
+  float_bits s2 = {.u = (uint32_t)(k - k / 2 + 127) << 23};
+  return p * s1.f * s2.f;
+}
+
+
+//================================================================
+/*! power. exp(y * log(x)), or multiplication if y is small integer.
+  the error is bigger by |y * log(x)| (float rounding of the product)
+*/
+float mrbc_fast_powf(float x, float y)
+{
+  // range check first, (int32_t) of nan, inf or over 2^31 is undefined.
+  if( fabsf(y) <= 32 && y == (float)(int32_t)y ) {
+    int32_t n = (int32_t)y;
+    float r = 1;
+    float b = (n < 0) ? 1 / x : x;
+    uint32_t m = (n < 0) ? -n : n;
+    while( m ) {
+      if( m & 1 ) r *= b;
+      b *= b;
+      m >>= 1;
+    }
+    return r;
+  }
+
+  if( x > 0 ) return mrbc_fast_expf( y * mrbc_fast_logf(x) );
+  if( x == 0 ) return (y > 0) ? 0 : INFINITY;
+
+  // negative ** integer. (all floats over 2^24 are even integers)
+  int odd = 0;
+  if( fabsf(y) < 16777216.0f ) {
+    if( y != (float)(int32_t)y ) return NAN;
+    odd = (int32_t)y & 1;
+  }
+  float r = mrbc_fast_expf( y * mrbc_fast_logf(-x) );
+  return odd ? -r : r;
+}
+
+
+//================================================================
+/*! square root. 1/sqrt(x) by the exponent bits and Newton's method.
+*/
+float mrbc_fast_sqrtf(float x)
+{
+  float_bits b = {.f = x};
+
+  if( b.i <= 0 ) return (x == 0) ? x : NAN;
+  if( b.u >= 0x7f800000 ) return x;		// inf, nan
+  if( b.u < 0x00800000 ) {			// subnormal
+    return mrbc_fast_sqrtf( x * 16777216.0f ) * (1.0f / 4096);
+  }
+
+  float h = x * 0.5f;
+  b.u = 0x5f375a86 - (b.u >> 1);
+  b.f = b.f * (1.5f - h * b.f * b.f);
+  b.f = b.f * (1.5f - h * b.f * b.f);
+#if MRBC_MATH_FAST_DIGITS >= 6
+  b.f = b.f * (1.5f - h * b.f * b.f);
+#endif
+
+  return x * b.f;
+}
+
+
+//================================================================
+/*! sin and cos of r (|r| <= pi/4)
+*/
+static inline float sin_poly(float r)
+{
+  float r2 = r * r;
+#if MRBC_MATH_FAST_DIGITS <= 4
+  return r * (1 - r2 * (1.0f/6 - r2 * (1.0f/120)));
+#else
+  return r * (1 - r2 * (1.0f/6 - r2 * (1.0f/120 - r2 * (1.0f/5040))));
+#endif
+}
+
+static inline float cos_poly(float r)
+{
+  float r2 = r * r;
+#if MRBC_MATH_FAST_DIGITS <= 3
+  return 1 - r2 * (1.0f/2 - r2 * (1.0f/24));
+#elif MRBC_MATH_FAST_DIGITS <= 5
+  return 1 - r2 * (1.0f/2 - r2 * (1.0f/24 - r2 * (1.0f/720)));
+#else
+  return 1 - r2 * (1.0f/2 - r2 * (1.0f/24 - r2 * (1.0f/720 -
+	 r2 * (1.0f/40320))));
+#endif
+}
+
+
+//================================================================
+/*! sin and cos. x = q*pi/2 + r (|r| <= pi/4)
+  no branch by the quadrant, it is random in most uses.
+*/
+static float sin_quadrant(float x, int q_ofs)
+{
+  float_bits qb = {.f = x * INV_PI_2 + ROUND_MAGIC};
+  int32_t q = qb.i - 0x4b400000 + q_ofs;
+  float qf = qb.f - ROUND_MAGIC;
+  float r = ((x - qf * PI_2_HI) - qf * PI_2_MID) - qf * PI_2_LO;
+
+  float s = sin_poly(r);
+  float c = cos_poly(r);
+  float_bits v = {.f = (q & 1) ? c : s};
+  v.u ^= (uint32_t)(q & 2) << 30;		// negate in quadrant 2, 3
+  return v.f;
+}
+
+float mrbc_fast_sinf(float x)
+{
+  if( !(fabsf(x) <= TRIG_MAX) ) return sinf(x);	// and nan, inf
+  return sin_quadrant(x, 0);
+}
+
+float mrbc_fast_cosf(float x)
+{
+  if( !(fabsf(x) <= TRIG_MAX) ) return cosf(x);
+  return sin_quadrant(x, 1);
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*! @file
+  @brief
+  Fast approximate math functions in float32.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_MATH_FAST_H_
+#define MRBC_SRC_MATH_FAST_H_
+
+#include "vm_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if MRBC_USE_MATH_FAST
+float mrbc_fast_logf(float x);
+float mrbc_fast_expf(float x);
+float mrbc_fast_powf(float x, float y);
+float mrbc_fast_sqrtf(float x);
+float mrbc_fast_sinf(float x);
+float mrbc_fast_cosf(float x);
+
+#define MRBC_MATH_LOG(x)	mrbc_fast_logf(x)
+#define MRBC_MATH_EXP(x)	mrbc_fast_expf(x)
+#define MRBC_MATH_POW(x,y)	mrbc_fast_powf((x),(y))
+#define MRBC_MATH_SQRT(x)	mrbc_fast_sqrtf(x)
+#define MRBC_MATH_SIN(x)	mrbc_fast_sinf(x)
+#define MRBC_MATH_COS(x)	mrbc_fast_cosf(x)
+
+#else
+#define MRBC_MATH_LOG(x)	log(x)
+#define MRBC_MATH_EXP(x)	exp(x)
+#define MRBC_MATH_POW(x,y)	pow((x),(y))
+#define MRBC_MATH_SQRT(x)	sqrt(x)
+#define MRBC_MATH_SIN(x)	sin(x)
+#define MRBC_MATH_COS(x)	cos(x)
+#endif
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
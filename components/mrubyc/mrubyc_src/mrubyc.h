@@ -28,6 +28,10 @@
 #include "c_numeric.h"
 #include "c_range.h"
 #include "c_string.h"
+#include "c_serial.h"
+#include "c_bus.h"
+#include "c_gpio.h"
+#include "c_adc.h"
 
 #include "load.h"
 #include "console.h"
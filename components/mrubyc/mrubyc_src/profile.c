@@ -0,0 +1,296 @@
+/*! @file
+  @brief
+  Per-method call counters and cycle profiler.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Count calls, inclusive/exclusive cycles and allocations
+  for each (class, method). Enabled by MRBC_USE_PROFILE.
+
+  Cycles are measured by hal_cycles(), so they include the time of
+  other tasks running while the method is preempted.
+  Block frames are not profiled, their cycles are exclusive cycles
+  of the method that called the block.
+
+  (e.g.)
+    VM.method_profile(5).each {|cls, mid, calls, incl, excl, allocs| ... }
+    VM.method_profile_reset
+  </pre>
+*/
+
+#include "vm_config.h"
+#include <stdint.h>
+#include <string.h>
+
+#include "value.h"
+#include "alloc.h"
+#include "vm.h"
+#include "class.h"
+#include "symbol.h"
+#include "console.h"
+#include "c_array.h"
+#include "profile.h"
+#include "hal/hal.h"
+
+
+#if MRBC_USE_PROFILE
+
+#if !defined(MRBC_PROFILE_TABLE_SIZE)
+#define MRBC_PROFILE_TABLE_SIZE 64
+#endif
+
+//================================================================
+/*!@brief
+  Profile entry.
+*/
+typedef struct RProfileEntry {
+  const struct RClass *cls;	//!< NULL is unused entry.
+  mrbc_sym sym_id;
+  uint32_t calls;
+  uint32_t allocs;
+  uint64_t incl_cycles;
+  uint64_t excl_cycles;
+} mrbc_profile_entry;
+
+static mrbc_profile_entry profile_table[MRBC_PROFILE_TABLE_SIZE];
+static uint32_t profile_dropped;	//!< calls not counted, table full.
+
+
+//================================================================
+/*! find or add entry.
+
+  @return	index or -1 if table is full.
+*/
+static int find_entry(const struct RClass *cls, mrbc_sym sym_id)
+{
+  unsigned int i = ((uintptr_t)cls / 4 + sym_id * 31) % MRBC_PROFILE_TABLE_SIZE;
+  int n;
+
+  for( n = 0; n < MRBC_PROFILE_TABLE_SIZE; n++ ) {
+    mrbc_profile_entry *e = &profile_table[i];
+    if( e->cls == cls && e->sym_id == sym_id ) return i;
+    if( e->cls == NULL ) {
+      e->cls = cls;
+      e->sym_id = sym_id;
+      return i;
+    }
+    if( ++i >= MRBC_PROFILE_TABLE_SIZE ) i = 0;
+  }
+  return -1;
+}
+
+
+//================================================================
+/*! clear all entries.
+*/
+void mrbc_profile_clear(void)
+{
+  memset( profile_table, 0, sizeof(profile_table) );
+  profile_dropped = 0;
+}
+
+
+//================================================================
+/*! begin method call.
+
+  @param  frame		profile frame of this call.
+  @param  cls		class of the receiver.
+  @param  sym_id	method name.
+*/
+void mrbc_profile_begin(mrbc_profile_frame *frame, const struct RClass *cls, int sym_id)
+{
+  uint32_t bytes;
+
+  frame->idx = find_entry( cls, sym_id );
+  if( frame->idx < 0 ) {
+    profile_dropped++;
+    return;
+  }
+  profile_table[frame->idx].calls++;
+  frame->child_cycles = 0;
+  mrbc_alloc_counters( &frame->allocs, &bytes );
+  frame->cycles = hal_cycles();
+}
+
+
+//================================================================
+/*! end method call.
+
+  @param  frame		profile frame of this call.
+  @param  caller	callinfo of the caller. (or callee's callinfo->prev)
+*/
+void mrbc_profile_end(mrbc_profile_frame *frame, struct CALLINFO *caller)
+{
+  uint32_t cycles = hal_cycles() - frame->cycles;
+  uint32_t allocs, bytes;
+
+  if( frame->idx < 0 ) return;
+  mrbc_alloc_counters( &allocs, &bytes );
+
+  mrbc_profile_entry *e = &profile_table[frame->idx];
+  e->incl_cycles += cycles;
+  e->excl_cycles += cycles - frame->child_cycles;
+  e->allocs += allocs - frame->allocs;
+
+  // add to the nearest profiled caller.
+  for( ; caller != NULL; caller = caller->prev ) {
+    if( caller->prof.idx >= 0 ) {
+      caller->prof.child_cycles += cycles;
+      break;
+    }
+  }
+}
+
+
+//================================================================
+/*! sort entries by exclusive cycles.
+
+  @param  idx	(out) indexes of entries.
+  @param  n	max number of entries.
+  @return	number of entries.
+*/
+static int sort_entries(int16_t *idx, int n)
+{
+  int i, j, cnt = 0;
+
+  for( i = 0; i < MRBC_PROFILE_TABLE_SIZE; i++ ) {
+    if( profile_table[i].cls == NULL ) continue;
+
+    // insertion sort, keep top n.
+    for( j = cnt; j > 0; j-- ) {
+      if( profile_table[idx[j-1]].excl_cycles >= profile_table[i].excl_cycles ) break;
+      if( j < n ) idx[j] = idx[j-1];
+    }
+    if( j < n ) idx[j] = i;
+    if( cnt < n ) cnt++;
+  }
+  return cnt;
+}
+
+
+//================================================================
+/*! print top n entries to console.
+
+  @param  n	number of entries.
+*/
+void mrbc_profile_print(int n)
+{
+  int16_t idx[MRBC_PROFILE_TABLE_SIZE];
+  int i;
+
+  if( n > MRBC_PROFILE_TABLE_SIZE ) n = MRBC_PROFILE_TABLE_SIZE;
+  n = sort_entries( idx, n );
+
+  console_printf("method\t%8s %10s %10s %8s\n",
+		 "calls", "incl(kc)", "excl(kc)", "allocs");
+  for( i = 0; i < n; i++ ) {
+    mrbc_profile_entry *e = &profile_table[idx[i]];
+    console_printf("%s#%s", symid_to_str(e->cls->sym_id), symid_to_str(e->sym_id));
+    console_printf("\t%8d %10d %10d %8d\n", e->calls,
+		   (int)(e->incl_cycles / 1000), (int)(e->excl_cycles / 1000),
+		   e->allocs);
+  }
+  if( profile_dropped ) {
+    console_printf("(%d calls not counted, table full)\n", profile_dropped);
+  }
+}
+
+
+//================================================================
+/*! 64bit counter to value, Float if it overflows Fixnum.
+*/
+static mrbc_value counter_value(uint64_t n)
+{
+#if MRBC_USE_FLOAT
+  if( n > INT32_MAX ) return mrbc_float_value( (double)n );
+#endif
+  return mrbc_fixnum_value( (mrbc_int)n );
+}
+
+
+//================================================================
+/*! (method) VM.method_profile(n = 10)
+
+  returns [[class, method, calls, incl_cycles, excl_cycles, allocs], ...]
+  sorted by exclusive cycles.
+*/
+static void c_vm_method_profile(struct VM *vm, mrbc_value v[], int argc)
+{
+  int16_t idx[MRBC_PROFILE_TABLE_SIZE];
+  int n = 10;
+  int i;
+
+  if( argc >= 1 && v[1].tt == MRBC_TT_FIXNUM ) n = GET_INT_ARG(1);
+  if( n < 0 ) n = 0;
+  if( n > MRBC_PROFILE_TABLE_SIZE ) n = MRBC_PROFILE_TABLE_SIZE;
+  n = sort_entries( idx, n );
+
+  mrbc_value ret = mrbc_array_new( vm, n );
+  if( ret.array == NULL ) return;	// ENOMEM
+
+  for( i = 0; i < n; i++ ) {
+    mrbc_profile_entry *e = &profile_table[idx[i]];
+    mrbc_value item = mrbc_array_new( vm, 6 );
+    if( item.array == NULL ) break;	// ENOMEM
+
+    mrbc_value val = {.tt = MRBC_TT_SYMBOL};
+    val.i = e->cls->sym_id;
+    mrbc_array_set( &item, 0, &val );
+    val.i = e->sym_id;
+    mrbc_array_set( &item, 1, &val );
+    val = mrbc_fixnum_value( e->calls );
+    mrbc_array_set( &item, 2, &val );
+    val = counter_value( e->incl_cycles );
+    mrbc_array_set( &item, 3, &val );
+    val = counter_value( e->excl_cycles );
+    mrbc_array_set( &item, 4, &val );
+    val = mrbc_fixnum_value( e->allocs );
+    mrbc_array_set( &item, 5, &val );
+
+    mrbc_array_push( &ret, &item );
+  }
+
+  SET_RETURN( ret );
+}
+
+
+//================================================================
+/*! (method) VM.method_profile_reset
+*/
+static void c_vm_method_profile_reset(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_profile_clear();
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! (method) VM.method_profile_print(n = 10)
+*/
+static void c_vm_method_profile_print(struct VM *vm, mrbc_value v[], int argc)
+{
+  int n = 10;
+
+  if( argc >= 1 && v[1].tt == MRBC_TT_FIXNUM ) n = GET_INT_ARG(1);
+  mrbc_profile_print( n );
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! define profile methods to VM class.
+
+  @param  cls	VM class.
+*/
+void mrbc_profile_define_methods(struct RClass *cls)
+{
+  mrbc_define_method(0, cls, "method_profile", c_vm_method_profile);
+  mrbc_define_method(0, cls, "method_profile_reset", c_vm_method_profile_reset);
+  mrbc_define_method(0, cls, "method_profile_print", c_vm_method_profile_print);
+}
+
+#endif // MRBC_USE_PROFILE
@@ -0,0 +1,54 @@
+/*! @file
+  @brief
+  Per-method call counters and cycle profiler.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Count calls, inclusive/exclusive cycles and allocations
+  for each (class, method). Enabled by MRBC_USE_PROFILE.
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_PROFILE_H_
+#define MRBC_SRC_PROFILE_H_
+
+#include <stdint.h>
+#include "vm_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//================================================================
+/*!@brief
+  Profile frame. one for each method call.
+*/
+typedef struct RProfileFrame {
+  int16_t  idx;			//!< index of entry, -1 is not profiled.
+  uint32_t cycles;		//!< hal_cycles() at the call.
+  uint32_t child_cycles;	//!< inclusive cycles of profiled callees.
+  uint32_t allocs;		//!< allocation counter at the call.
+} mrbc_profile_frame;
+
+
+#if MRBC_USE_PROFILE
+struct RClass;
+struct CALLINFO;
+
+void mrbc_profile_clear(void);
+void mrbc_profile_begin(mrbc_profile_frame *frame, const struct RClass *cls, int sym_id);
+void mrbc_profile_end(mrbc_profile_frame *frame, struct CALLINFO *caller);
+void mrbc_profile_print(int n);
+void mrbc_profile_define_methods(struct RClass *cls);
+#endif
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -26,12 +26,23 @@
 #include "class.h"
 #include "vm.h"
 #include "console.h"
+#include "c_hash.h"
+#include "symbol.h"
 #include "rrt0.h"
+#include "runtime.h"
+#include "trace.h"
+#include "profile.h"
+#include "health.h"
+#include "c_serial.h"
+#include "c_bus.h"
+#include "c_gpio.h"
+#include "c_adc.h"
 #include "hal/hal.h"
 
 
 /***** Constat values *******************************************************/
 const int TIMESLICE_TICK = 10; // 10 * 1ms(HardwareTimer)  255 max
+const int TICK_US = 1000;	// 1ms(HardwareTimer)
 
 
 /***** Macros ***************************************************************/
@@ -39,24 +50,50 @@ const int TIMESLICE_TICK = 10; // 10 * 1ms(HardwareTimer)  255 max
 #define MRBC_SCHEDULER_EXIT 0
 #endif
 
-#define VM2TCB(p) ((mrbc_tcb *)((uint8_t *)p - offsetof(mrbc_tcb, vm)))
 #define MRBC_MUTEX_TRACE(...) ((void)0)
 
 
 /***** Typedefs *************************************************************/
 /***** Function prototypes **************************************************/
 /***** Local variables ******************************************************/
-static mrbc_tcb *q_dormant_;
-static mrbc_tcb *q_ready_;
-static mrbc_tcb *q_waiting_;
-static mrbc_tcb *q_suspended_;
-static volatile uint32_t tick_;
+// task queues and tick counter. (see runtime.h)
+#define q_dormant_	(mrbc_current_runtime->q_dormant)
+#define q_ready_	(mrbc_current_runtime->q_ready)
+#define q_waiting_	(mrbc_current_runtime->q_waiting)
+#define q_suspended_	(mrbc_current_runtime->q_suspended)
+#define tick_		(mrbc_current_runtime->tick)
 
 
 /***** Global variables *****************************************************/
 /***** Signal catching functions ********************************************/
 /***** Local functions ******************************************************/
 
+//================================================================
+/*! Task order in the queue
+
+  @param        p_tcb	TCB to be inserted.
+  @param        p	TCB in the queue.
+  @param        edf	inserting into the ready queue.
+  @retval       non-zero if p_tcb goes before p.
+
+  By priority_preemption. In the ready queue, periodic tasks (Task.periodic)
+  go by absolute deadline before other tasks of the same priority.
+ */
+static inline int q_precedes(const mrbc_tcb *p_tcb, const mrbc_tcb *p, int edf)
+{
+  if( p_tcb->priority_preemption != p->priority_preemption ) {
+    return p_tcb->priority_preemption < p->priority_preemption;
+  }
+#if MRBC_USE_EDF
+  if( edf && p_tcb->period != 0 ) {
+    if( p->period == 0 ) return 1;
+    return (int32_t)(p_tcb->deadline_tick - p->deadline_tick) < 0;
+  }
+#endif
+  return 0;
+}
+
+
 //================================================================
 /*! Insert to task queue
 
@@ -66,16 +103,18 @@ static volatile uint32_t tick_;
   TCBはフリーの状態でなければならない。（別なQueueに入っていてはならない）
   Queueはpriority_preemption順にソート済みとなる。
   挿入するTCBとQueueに同じpriority_preemption値がある場合は、同値の最後に挿入される。
+  (EDF, see q_precedes)
 
  */
 static void q_insert_task(mrbc_tcb *p_tcb)
 {
   mrbc_tcb **pp_q;
+  int edf = 0;
 
   switch( p_tcb->state ) {
   case TASKSTATE_DORMANT: pp_q   = &q_dormant_; break;
   case TASKSTATE_READY:
-  case TASKSTATE_RUNNING: pp_q   = &q_ready_; break;
+  case TASKSTATE_RUNNING: pp_q   = &q_ready_; edf = 1; break;
   case TASKSTATE_WAITING: pp_q   = &q_waiting_; break;
   case TASKSTATE_SUSPENDED: pp_q = &q_suspended_; break;
   default:
@@ -84,8 +123,7 @@ static void q_insert_task(mrbc_tcb *p_tcb)
   }
 
   // case insert on top.
-  if((*pp_q == NULL) ||
-     (p_tcb->priority_preemption < (*pp_q)->priority_preemption)) {
+  if((*pp_q == NULL) || q_precedes(p_tcb, *pp_q, edf)) {
     p_tcb->next = *pp_q;
     *pp_q       = p_tcb;
     assert(p_tcb->next != p_tcb);
@@ -95,8 +133,7 @@ static void q_insert_task(mrbc_tcb *p_tcb)
   // find insert point in sorted linked list.
   mrbc_tcb *p = *pp_q;
   while( 1 ) {
-    if((p->next == NULL) ||
-       (p_tcb->priority_preemption < p->next->priority_preemption)) {
+    if((p->next == NULL) || q_precedes(p_tcb, p->next, edf)) {
       p_tcb->next = p->next;
       p->next     = p_tcb;
       assert(p->next != p);
@@ -325,6 +362,118 @@ static void c_vm_tick(mrbc_vm *vm, mrbc_value v[], int argc)
 }
 
 
+//================================================================
+/*! vm cycles (CPU cycle counter, wrap around 32bit)
+*/
+static void c_vm_cycles(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN(hal_cycles());
+}
+
+
+//================================================================
+/*! vm micros (wrap around 32bit)
+*/
+static void c_vm_micros(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN(hal_micros());
+}
+
+
+#if MRBC_USE_SCRATCH
+//================================================================
+/*! open the scratch arena of this task.
+
+  VM.scratch( bytes = MRBC_SCRATCH_SIZE )  # 0 closes it.
+  return false if no memory, or objects in the arena are still alive.
+*/
+static void c_vm_scratch(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  mrbc_int size = MRBC_SCRATCH_SIZE;
+  if( argc >= 1 && v[1].tt == MRBC_TT_FIXNUM ) size = GET_INT_ARG(1);
+
+  int ret = (size <= 0) ? mrbc_scratch_close(vm) : mrbc_scratch_open(vm, size);
+  if( ret == 0 ) {
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
+}
+
+
+//================================================================
+/*! number of objects taken from the scratch arena.
+*/
+static void c_vm_scratch_count(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN(mrbc_scratch_count(vm));
+}
+#endif
+
+
+#if MRBC_USE_EDF
+//================================================================
+/*! finish the job, and wait for the next release.
+
+  Task.periodic( period_ms, deadline_ms = period_ms )
+  return false if the last job missed its deadline.
+
+  (e.g.)
+  while true
+    Task.periodic(1000, 200)	# every second, in 200 ms.
+    ...
+  end
+*/
+static void c_task_periodic(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  if( argc < 1 || v[1].tt != MRBC_TT_FIXNUM || v[1].i <= 0 ) return;	// error.
+  mrbc_int deadline = 0;
+  if( argc >= 2 && v[2].tt == MRBC_TT_FIXNUM && v[2].i > 0 ) deadline = v[2].i;
+
+  if( mrbc_task_periodic(VM2TCB(vm), GET_INT_ARG(1), deadline) == 0 ) {
+    SET_TRUE_RETURN();
+  } else {
+    SET_FALSE_RETURN();
+  }
+}
+
+
+//================================================================
+/*! set hash[:key] = value
+*/
+static void set_item( mrbc_value *hash, const char *key, mrbc_int value )
+{
+  mrbc_value k = {.tt = MRBC_TT_SYMBOL};
+  mrbc_value v = mrbc_fixnum_value( value );
+
+  k.i = str_to_symid( key );
+  mrbc_hash_set( hash, &k, &v );
+}
+
+
+//================================================================
+/*! statistics of the task.
+
+  Task.stats( tcb = get_tcb )
+  return {:period, :deadline, :jobs, :misses}
+*/
+static void c_task_stats(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  mrbc_tcb *tcb = VM2TCB(vm);
+  if( argc >= 1 && v[1].tt == MRBC_TT_HANDLE ) tcb = (mrbc_tcb *)(v[1].handle);
+
+  mrbc_value ret = mrbc_hash_new( vm, 4 );
+  if( ret.hash == NULL ) return;	// ENOMEM
+  set_item( &ret, "period",   tcb->period );
+  set_item( &ret, "deadline", tcb->rel_deadline );
+  set_item( &ret, "jobs",     tcb->jobs );
+  set_item( &ret, "misses",   tcb->misses );
+
+  SET_RETURN( ret );
+}
+#endif
+
+
 
 /***** Global functions *****************************************************/
 
@@ -339,13 +488,26 @@ void mrbc_tick(void)
 
   tick_++;
 
+#if MRBC_USE_HEALTH
+  // tick late by one period or more, against the previous tick.
+  // (long IRQ disabled, or long C method with MRBC_NO_TIMER)
+  uint32_t phase_us = hal_micros() - tick_ * TICK_US;
+  if( (int32_t)(phase_us - mrbc_current_runtime->tick_phase_us) >= TICK_US ) {
+    mrbc_current_runtime->tick_overruns++;
+  }
+  mrbc_current_runtime->tick_phase_us = phase_us;
+#endif
+
   // 実行中タスクのタイムスライス値を減らす
   tcb = q_ready_;
   if((tcb != NULL) &&
      (tcb->state == TASKSTATE_RUNNING) &&
      (tcb->timeslice > 0)) {
     tcb->timeslice--;
-    if( tcb->timeslice == 0 ) tcb->vm.flag_preemption = 1;
+    if( tcb->timeslice == 0 ) {
+      tcb->vm.flag_preemption = 1;
+      MRBC_TRACE(MRBC_TRACE_PREEMPT, tcb->vm.vm_id, 0, tick_, 0);
+    }
   }
 
   // 待ちタスクキューから、ウェイクアップすべきタスクを探す
@@ -354,19 +516,24 @@ void mrbc_tick(void)
     mrbc_tcb *t = tcb;
     tcb = tcb->next;
 
-    if( t->reason == TASKREASON_SLEEP && t->wakeup_tick == tick_ ) {
+    if( (t->reason == TASKREASON_SLEEP ||
+	 t->reason == TASKREASON_CFUNC_TIMEOUT) && t->wakeup_tick == tick_ ) {
       q_delete_task(t);
       t->state     = TASKSTATE_READY;
       t->timeslice = TIMESLICE_TICK;
       q_insert_task(t);
       flag_preemption = 1;
+      MRBC_TRACE(MRBC_TRACE_TASK_WAKEUP, t->vm.vm_id, 0, tick_, 0);
     }
   }
 
   if( flag_preemption ) {
     tcb = q_ready_;
     while( tcb != NULL ) {
-      if( tcb->state == TASKSTATE_RUNNING ) tcb->vm.flag_preemption = 1;
+      if( tcb->state == TASKSTATE_RUNNING ) {
+	tcb->vm.flag_preemption = 1;
+	MRBC_TRACE(MRBC_TRACE_PREEMPT, tcb->vm.vm_id, 0, tick_, 0);
+      }
       tcb = tcb->next;
     }
   }
@@ -380,9 +547,14 @@ void mrbc_tick(void)
 */
 void mrbc_init(uint8_t *ptr, unsigned int size )
 {
+  memset(mrbc_current_runtime, 0, sizeof(mrbc_runtime));
   mrbc_init_alloc(ptr, size);
   init_static();
   hal_init();
+#if MRBC_USE_HEALTH
+  mrbc_current_runtime->tick_phase_us = hal_micros();
+  mrbc_current_runtime->health_us = hal_micros();
+#endif
 
 
   // TODO 関数呼び出しが、c_XXX => mrbc_XXX の daisy chain になっている。
@@ -406,6 +578,40 @@ void mrbc_init(uint8_t *ptr, unsigned int size )
   mrbc_class *c_vm;
   c_vm = mrbc_define_class(0, "VM", mrbc_class_object);
   mrbc_define_method(0, c_vm, "tick", c_vm_tick);
+  mrbc_define_method(0, c_vm, "cycles", c_vm_cycles);
+  mrbc_define_method(0, c_vm, "micros", c_vm_micros);
+#if MRBC_USE_SCRATCH
+  mrbc_define_method(0, c_vm, "scratch", c_vm_scratch);
+  mrbc_define_method(0, c_vm, "scratch_count", c_vm_scratch_count);
+#endif
+#if MRBC_USE_EDF
+  mrbc_class *c_task;
+  c_task = mrbc_define_class(0, "Task", mrbc_class_object);
+  mrbc_define_method(0, c_task, "periodic", c_task_periodic);
+  mrbc_define_method(0, c_task, "stats", c_task_stats);
+#endif
+#if MRBC_USE_TRACE
+  mrbc_trace_define_methods(c_vm);
+#endif
+#if MRBC_USE_PROFILE
+  mrbc_profile_define_methods(c_vm);
+#endif
+#if MRBC_USE_HEALTH
+  mrbc_health_define_methods(c_vm);
+#endif
+
+#if MRBC_USE_SERIAL
+  mrbc_init_class_serial(0);
+#endif
+#if MRBC_USE_BUS
+  mrbc_init_class_bus(0);
+#endif
+#if MRBC_USE_GPIO
+  mrbc_init_class_gpio(0);
+#endif
+#if MRBC_USE_ADC
+  mrbc_init_class_adc(0);
+#endif
 }
 
 
@@ -477,6 +683,9 @@ int mrbc_start_task(mrbc_tcb *tcb)
   if( tcb->state != TASKSTATE_DORMANT ) return -1;
   tcb->timeslice           = TIMESLICE_TICK;
   tcb->priority_preemption = tcb->priority;
+#if MRBC_USE_EDF
+  tcb->period              = 0;
+#endif
   mrbc_vm_begin(&tcb->vm);
 
   hal_disable_irq();
@@ -513,6 +722,32 @@ int mrbc_run(void)
     // 実行開始
     tcb->state = TASKSTATE_RUNNING;
     int res = 0;
+    MRBC_TRACE(MRBC_TRACE_TASK_SWITCH_IN, tcb->vm.vm_id, tcb->priority_preemption, 0, 0);
+#if MRBC_USE_HEALTH
+    uint32_t switch_in_us = hal_micros();
+    tcb->switches++;
+#endif
+
+    // ブロックしていたCメソッドの再開
+    if( tcb->resume ) {
+      mrbc_cfunc_resume resume = tcb->resume;
+      tcb->resume = NULL;
+      tcb->vm.flag_cfunc_block = 0;
+      resume( &tcb->vm, tcb->resume_regs, tcb->resume_state );
+      if( !tcb->vm.flag_cfunc_block ) {	// release the arguments.
+        int i;
+        for( i = 1; i <= tcb->vm.cfunc_nregs; i++ ) {
+          mrbc_release( &tcb->resume_regs[i] );
+        }
+      }
+      if( tcb->state != TASKSTATE_RUNNING ) {	// blocked again.
+#if MRBC_USE_HEALTH
+        tcb->run_us += hal_micros() - switch_in_us;
+#endif
+        MRBC_TRACE(MRBC_TRACE_TASK_SWITCH_OUT, tcb->vm.vm_id, tcb->state, 0, 0);
+        continue;
+      }
+    }
 
 #ifndef MRBC_NO_TIMER
     tcb->vm.flag_preemption = 0;
@@ -529,6 +764,12 @@ int mrbc_run(void)
     mrbc_tick();
 #endif /* ifndef MRBC_NO_TIMER */
 
+#if MRBC_USE_HEALTH
+    tcb->run_us += hal_micros() - switch_in_us;
+#endif
+    MRBC_TRACE(MRBC_TRACE_TASK_SWITCH_OUT, tcb->vm.vm_id,
+	       (res < 0) ? TASKSTATE_DORMANT : tcb->state, 0, 0);
+
     // タスク終了？
     if( res < 0 ) {
       hal_disable_irq();
@@ -578,6 +819,9 @@ void mrbc_sleep_ms(mrbc_tcb *tcb, uint32_t ms)
   q_insert_task(tcb);
   hal_enable_irq();
 
+#if MRBC_USE_SCRATCH
+  mrbc_scratch_rewind(&tcb->vm);
+#endif
   tcb->vm.flag_preemption = 1;
 }
 
@@ -606,6 +850,74 @@ void mrbc_change_priority(mrbc_tcb *tcb, int priority)
 }
 
 
+#if MRBC_USE_EDF
+//================================================================
+/*! 周期実行
+
+  Finish the current job of a periodic task, and wait for the release
+  of the next job. The first call releases the first job at once.
+  A job is released every period ms from the first, without drift, and
+  must finish (call this again) by deadline ms from its release.
+  Ready periodic tasks run in earliest deadline first order. (see q_precedes)
+
+  A job finished after its deadline is counted as a miss. Releases whose
+  deadline has already passed are skipped, and also counted as misses.
+
+  @param  tcb		task.
+  @param  period	period in ms. (> 0)
+  @param  deadline	relative deadline in ms, or 0 for the period.
+  @retval 0		the last job met the deadline.
+  @retval -1		missed.
+*/
+int mrbc_task_periodic(mrbc_tcb *tcb, uint32_t period, uint32_t deadline)
+{
+  int ret = 0;
+  if( deadline == 0 ) deadline = period;
+
+  hal_disable_irq();
+  uint32_t now = tick_;
+
+  if( tcb->period == 0 ) {
+    tcb->release_tick = now;
+  } else {
+    tcb->jobs++;
+    if( (int32_t)(now - tcb->deadline_tick) > 0 ) {
+      tcb->misses++;
+      ret = -1;
+    }
+    tcb->release_tick += period;
+    while( (int32_t)(now - (tcb->release_tick + deadline)) > 0 ) {
+      tcb->release_tick += period;
+      tcb->misses++;
+      ret = -1;
+    }
+  }
+  tcb->period        = period;
+  tcb->rel_deadline  = deadline;
+  tcb->deadline_tick = tcb->release_tick + deadline;
+
+  q_delete_task(tcb);
+  if( (int32_t)(tcb->release_tick - now) > 0 ) {
+    tcb->timeslice   = 0;
+    tcb->state       = TASKSTATE_WAITING;
+    tcb->reason      = TASKREASON_SLEEP;
+    tcb->wakeup_tick = tcb->release_tick;
+  } else {
+    tcb->timeslice   = TIMESLICE_TICK;	// released already, by new deadline.
+  }
+  q_insert_task(tcb);
+  hal_enable_irq();
+
+#if MRBC_USE_SCRATCH
+  mrbc_scratch_rewind(&tcb->vm);
+#endif
+  tcb->vm.flag_preemption = 1;
+
+  return ret;
+}
+#endif
+
+
 //================================================================
 /*! 実行停止
 
@@ -643,6 +955,122 @@ void mrbc_resume_task(mrbc_tcb *tcb)
 }
 
 
+//================================================================
+/*! Cメソッドのブロック
+
+  C method calls this and returns, instead of waiting for a device.
+  The task is parked, and resume() is called by the scheduler
+  after mrbc_cfunc_wakeup() or timeout. Other tasks run meanwhile.
+  The arguments v[1..] are kept until resume() returns without blocking.
+
+  @param  vm		pointer to VM.
+  @param  v		argument of C method. (v[0] is return value)
+  @param  resume	continuation.
+  @param  state		argument of continuation.
+  @param  timeout_ms	timeout, or 0 to wait for mrbc_cfunc_wakeup() only.
+
+  (e.g.)
+  static void c_read_sensor(struct VM *vm, mrbc_value v[], int argc)
+  {
+    sensor_start();
+    mrbc_cfunc_block( vm, v, read_sensor_resume, NULL, 10 );
+  }
+  static void read_sensor_resume(struct VM *vm, mrbc_value v[], void *state)
+  {
+    if( !sensor_ready() ) {
+      mrbc_cfunc_block( vm, v, read_sensor_resume, state, 10 );
+      return;
+    }
+    SET_INT_RETURN( sensor_value() );
+  }
+*/
+void mrbc_cfunc_block(struct VM *vm, mrbc_value v[], mrbc_cfunc_resume resume, void *state, int timeout_ms)
+{
+  mrbc_tcb *tcb = VM2TCB(vm);
+
+  hal_disable_irq();
+  q_delete_task(tcb);
+  tcb->timeslice    = 0;
+  tcb->state        = TASKSTATE_WAITING;
+  tcb->resume       = resume;
+  tcb->resume_state = state;
+  tcb->resume_regs  = v;
+  tcb->vm.flag_cfunc_block = 1;
+  if( timeout_ms > 0 ) {
+    tcb->reason      = TASKREASON_CFUNC_TIMEOUT;
+    tcb->wakeup_tick = tick_ + timeout_ms;
+  } else {
+    tcb->reason      = TASKREASON_CFUNC;
+  }
+  q_insert_task(tcb);
+  hal_enable_irq();
+
+  tcb->vm.flag_preemption = 1;
+}
+
+
+//================================================================
+/*! ブロックしたCメソッドの起床
+
+  Can be called from interrupt handler or other tasks.
+
+  @param  tcb		task blocked by mrbc_cfunc_block().
+*/
+void mrbc_cfunc_wakeup(mrbc_tcb *tcb)
+{
+  hal_disable_irq();
+  if( tcb->state == TASKSTATE_WAITING &&
+      (tcb->reason == TASKREASON_CFUNC ||
+       tcb->reason == TASKREASON_CFUNC_TIMEOUT) ) {
+    mrbc_tcb *t = q_ready_;
+    while( t != NULL ) {
+      if( t->state == TASKSTATE_RUNNING ) t->vm.flag_preemption = 1;
+      t = t->next;
+    }
+
+    q_delete_task(tcb);
+    tcb->state     = TASKSTATE_READY;
+    tcb->timeslice = TIMESLICE_TICK;
+    q_insert_task(tcb);
+  }
+  hal_enable_irq();
+}
+
+
+//================================================================
+/*! 状態を共有するブロックしたCメソッドの一斉起床
+
+  Wake up all tasks blocked by mrbc_cfunc_block() with the state.
+  Can be called from interrupt handler or other tasks.
+
+  @param  state		state given to mrbc_cfunc_block().
+*/
+void mrbc_cfunc_wakeup_all(const void *state)
+{
+  hal_disable_irq();
+  mrbc_tcb *tcb = q_waiting_;
+  while( tcb != NULL ) {
+    mrbc_tcb *next = tcb->next;
+    if( (tcb->reason == TASKREASON_CFUNC ||
+	 tcb->reason == TASKREASON_CFUNC_TIMEOUT) &&
+	tcb->resume_state == state ) {
+      q_delete_task(tcb);
+      tcb->state     = TASKSTATE_READY;
+      tcb->timeslice = TIMESLICE_TICK;
+      q_insert_task(tcb);
+    }
+    tcb = next;
+  }
+
+  mrbc_tcb *t = q_ready_;
+  while( t != NULL ) {
+    if( t->state == TASKSTATE_RUNNING ) t->vm.flag_preemption = 1;
+    t = t->next;
+  }
+  hal_enable_irq();
+}
+
+
 //================================================================
 /*! mutex initialize
 
@@ -689,6 +1117,7 @@ int mrbc_mutex_lock( mrbc_mutex *mutex, mrbc_tcb *tcb )
   }
 
   // To WAITING state.
+  MRBC_TRACE(MRBC_TRACE_MUTEX_WAIT, tcb->vm.vm_id, 0, (uint32_t)(uintptr_t)mutex, 0);
   q_delete_task(tcb);
   tcb->state  = TASKSTATE_WAITING;
   tcb->reason = TASKREASON_MUTEX;
@@ -815,7 +1244,7 @@ void pq(mrbc_tcb *p_tcb)
   while( p != NULL ) {
     console_printf(" st:%c%c%c%c  ",
                    (p->state & TASKSTATE_SUSPENDED)?'S':'-',
-                   (p->state & TASKSTATE_WAITING)?("sm"[p->reason]):'-',
+                   (p->state & TASKSTATE_WAITING)?("smcc"[p->reason]):'-',
                    (p->state &(TASKSTATE_RUNNING & ~TASKSTATE_READY))?'R':'-',
                    (p->state & TASKSTATE_READY)?'r':'-' );
     p = p->next;
@@ -20,6 +20,7 @@ extern "C" {
 /***** Feature test switches ************************************************/
 /***** System headers *******************************************************/
 #include <stdint.h>
+#include <stddef.h>
 
 /***** Local headers ********************************************************/
 #include "vm.h"
@@ -41,14 +42,29 @@ enum MrbcTaskState {
 enum MrbcTaskReason {
   TASKREASON_SLEEP = 0x00,
   TASKREASON_MUTEX = 0x01,
+  TASKREASON_CFUNC = 0x02,		//!< blocked C method, wait for wakeup.
+  TASKREASON_CFUNC_TIMEOUT = 0x03,	//!< same, or wakeup_tick.
 };
 
 
 /***** Macros ***************************************************************/
+#define VM2TCB(p) ((mrbc_tcb *)((uint8_t *)p - offsetof(mrbc_tcb, vm)))
+
+
 /***** Typedefs *************************************************************/
 
 struct RMutex;
 
+//================================================
+/*!@brief
+  Continuation of blocked C method.
+
+  Called by the scheduler when the task wakes up. v[0] is the return
+  value register of the method. Call mrbc_cfunc_block() again to keep
+  blocking, or set the return value and return to finish the method.
+*/
+typedef void (*mrbc_cfunc_resume)(struct VM *vm, mrbc_value v[], void *state);
+
 //================================================
 /*!@brief
   Task control block
@@ -59,12 +75,27 @@ typedef struct RTcb {
   uint8_t priority_preemption;
   uint8_t timeslice;
   uint8_t state;	//!< enum MrbcTaskState
-  uint8_t reason;	//!< SLEEP, MUTEX
+  uint8_t reason;	//!< SLEEP, MUTEX, CFUNC
 
   union {
     uint32_t wakeup_tick;
     struct RMutex *mutex;
   };
+  mrbc_cfunc_resume resume;	//!< blocked C method.
+  void *resume_state;
+  mrbc_value *resume_regs;
+#if MRBC_USE_EDF
+  uint32_t period;		//!< ms, or 0 if not periodic. (Task.periodic)
+  uint32_t rel_deadline;	//!< ms from the release.
+  uint32_t release_tick;	//!< release of the current job.
+  uint32_t deadline_tick;	//!< absolute deadline of the current job.
+  uint32_t jobs;		//!< finished jobs.
+  uint32_t misses;		//!< jobs finished late, and skipped releases.
+#endif
+#if MRBC_USE_HEALTH
+  uint32_t run_us;		//!< run time since the last health record.
+  uint32_t switches;		//!< switch in, since the last health record.
+#endif
   struct VM vm;
 } mrbc_tcb;
 
@@ -93,8 +124,14 @@ int mrbc_run(void);
 void mrbc_sleep_ms(mrbc_tcb *tcb, uint32_t ms);
 void mrbc_relinquish(mrbc_tcb *tcb);
 void mrbc_change_priority(mrbc_tcb *tcb, int priority);
+#if MRBC_USE_EDF
+int mrbc_task_periodic(mrbc_tcb *tcb, uint32_t period, uint32_t deadline);
+#endif
 void mrbc_suspend_task(mrbc_tcb *tcb);
 void mrbc_resume_task(mrbc_tcb *tcb);
+void mrbc_cfunc_block(struct VM *vm, mrbc_value v[], mrbc_cfunc_resume resume, void *state, int timeout_ms);
+void mrbc_cfunc_wakeup(mrbc_tcb *tcb);
+void mrbc_cfunc_wakeup_all(const void *state);
 mrbc_mutex *mrbc_mutex_init(mrbc_mutex *mutex);
 int mrbc_mutex_lock(mrbc_mutex *mutex, mrbc_tcb *tcb);
 int mrbc_mutex_unlock(mrbc_mutex *mutex, mrbc_tcb *tcb);
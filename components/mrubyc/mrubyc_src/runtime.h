@@ -0,0 +1,156 @@
+/*! @file
+  @brief
+  mruby/c runtime context.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  All the state of one mruby/c instance. (memory pool, symbol table,
+  constants and global variables, builtin classes and task queues)
+  The modules access it through mrbc_current_runtime, so each host
+  thread can select its own runtime, and independent instances can
+  run in one process.
+
+  (e.g.)
+    static __thread mrbc_runtime rt;	// or malloc(), one for a thread.
+    mrbc_runtime_select( &rt );
+    mrbc_init( pool, sizeof(pool) );
+    mrbc_create_task( bytecode, 0 );
+    mrbc_run();
+
+  To use from several threads, define MRBC_THREAD_LOCAL (e.g. __thread)
+  and MRBC_NO_TIMER. mrbc_run() then counts the tick of its own runtime.
+  Trace, profile, Serial ports, I2C/SPI buses, GPIO pins and the ADC
+  scanner are shared by the process.
+  </pre>
+*/
+
+#ifndef MRBC_SRC_RUNTIME_H_
+#define MRBC_SRC_RUNTIME_H_
+
+#include <stdint.h>
+#include "vm_config.h"
+#include "alloc.h"
+#include "keyvalue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if !defined(MRBC_SYMBOL_SEARCH_LINER) && !defined(MRBC_SYMBOL_SEARCH_BTREE)
+#define MRBC_SYMBOL_SEARCH_BTREE
+#endif
+
+#ifndef MRBC_SYMBOL_TABLE_INDEX_TYPE
+#define MRBC_SYMBOL_TABLE_INDEX_TYPE	uint16_t
+#endif
+
+struct FREE_BLOCK;
+struct RClass;
+struct RProc;
+struct RTcb;
+
+
+//================================================================
+/*!@brief
+  Symbol table entry. (see symbol.c)
+*/
+struct SYM_INDEX {
+  uint16_t hash;	//!< hash value, returned by calc_hash().
+#ifdef MRBC_SYMBOL_SEARCH_BTREE
+  MRBC_SYMBOL_TABLE_INDEX_TYPE left;
+  MRBC_SYMBOL_TABLE_INDEX_TYPE right;
+#endif
+  const char *cstr;	//!< point to the symbol string.
+};
+
+
+//================================================================
+/*!@brief
+  Method cache entry of a call site. (see vm.c)
+*/
+typedef struct METHOD_CACHE {
+  const uint8_t *site;		//!< instruction of the call site.
+  const struct RClass *cls;	//!< receiver class, or defining class if super.
+  struct RProc *proc;
+  struct RClass *owner;		//!< class that has the proc.
+  uint32_t serial;		//!< method_serial when cached.
+  int16_t sym_id;
+} mrbc_method_cache;
+
+
+//================================================================
+/*!@brief
+  Runtime context.
+*/
+typedef struct RRuntime {
+  // memory pool (alloc.c)
+  uint8_t *memory_pool;
+  uint32_t memory_pool_size;
+  struct FREE_BLOCK *free_blocks[SIZE_FREE_BLOCKS + 1];
+  uint16_t free_fli_bitmap;
+  uint8_t  free_sli_bitmap[MRBC_ALLOC_FLI_BIT_WIDTH +1+1]; // + sentinel
+  uint32_t alloc_count;
+  uint32_t alloc_bytes;
+
+  // symbol table (symbol.c)
+  struct SYM_INDEX sym_index[MAX_SYMBOLS_COUNT];
+  int sym_index_pos;	// point to the last(free) sym_index array.
+
+  // constants and global variables (global.c)
+  mrbc_kv_handle handle_const;
+  mrbc_kv_handle handle_global;
+
+  // builtin classes (static.c)
+  struct RClass *class_object;
+  struct RClass *class_nil;
+  struct RClass *class_false;
+  struct RClass *class_true;
+  struct RClass *class_symbol;
+  struct RClass *class_fixnum;
+  struct RClass *class_float;
+  struct RClass *class_string;
+  struct RClass *class_array;
+  struct RClass *class_range;
+  struct RClass *class_hash;
+  struct RClass *class_proc;
+  struct RClass *class_math;
+
+  // method cache (vm.c, class.c)
+  uint32_t method_serial;
+#if MRBC_USE_METHOD_CACHE
+  mrbc_method_cache method_cache[MRBC_METHOD_CACHE_SIZE];
+#else
+  mrbc_method_cache method_cache[1];	// lookup result only.
+#endif
+
+  // VM ID (vm.c)
+  uint32_t free_vm_bitmap[MAX_VM_COUNT / 32 + 1];
+
+  // task queues (rrt0.c)
+  struct RTcb *q_dormant;
+  struct RTcb *q_ready;
+  struct RTcb *q_waiting;
+  struct RTcb *q_suspended;
+  volatile uint32_t tick;
+#if MRBC_USE_HEALTH
+  uint32_t tick_phase_us;	//!< hal_micros() - tick * 1000, at the last tick.
+  uint32_t tick_overruns;	//!< ticks late by one period or more.
+  uint32_t health_us;		//!< hal_micros() at the last health record.
+#endif
+
+} mrbc_runtime;
+
+
+extern MRBC_THREAD_LOCAL mrbc_runtime *mrbc_current_runtime;
+
+mrbc_runtime *mrbc_runtime_select(mrbc_runtime *rt);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
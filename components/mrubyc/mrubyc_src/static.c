@@ -14,20 +14,24 @@
 #include "static.h"
 
 
-// Builtin classes.
-struct RClass *mrbc_class_object;
-struct RClass *mrbc_class_nil;
-struct RClass *mrbc_class_false;
-struct RClass *mrbc_class_true;
-struct RClass *mrbc_class_symbol;
-struct RClass *mrbc_class_fixnum;
-struct RClass *mrbc_class_float;
-struct RClass *mrbc_class_string;
-struct RClass *mrbc_class_array;
-struct RClass *mrbc_class_range;
-struct RClass *mrbc_class_hash;
-struct RClass *mrbc_class_proc;
-struct RClass *mrbc_class_math;
+// Runtime context. (see runtime.h)
+static mrbc_runtime default_runtime_;
+MRBC_THREAD_LOCAL mrbc_runtime *mrbc_current_runtime = &default_runtime_;
+
+
+//================================================================
+/*! select runtime of the calling thread.
+
+  @param  rt	runtime. cleared by mrbc_init().
+  @return	previous runtime.
+*/
+mrbc_runtime *mrbc_runtime_select(mrbc_runtime *rt)
+{
+  mrbc_runtime *prev = mrbc_current_runtime;
+  mrbc_current_runtime = rt;
+
+  return prev;
+}
 
 
 //================================================================
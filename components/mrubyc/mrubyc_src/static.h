@@ -13,26 +13,26 @@
 #ifndef MRBC_SRC_STATIC_H_
 #define MRBC_SRC_STATIC_H_
 
+#include "runtime.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// Builtin classes.
-struct RClass;
-extern struct RClass *mrbc_class_object;
-extern struct RClass *mrbc_class_nil;
-extern struct RClass *mrbc_class_false;
-extern struct RClass *mrbc_class_true;
-extern struct RClass *mrbc_class_symbol;
-extern struct RClass *mrbc_class_fixnum;
-extern struct RClass *mrbc_class_float;
-extern struct RClass *mrbc_class_string;
-extern struct RClass *mrbc_class_array;
-extern struct RClass *mrbc_class_range;
-extern struct RClass *mrbc_class_hash;
-extern struct RClass *mrbc_class_proc;
-extern struct RClass *mrbc_class_math;
+// Builtin classes. (see runtime.h)
+#define mrbc_class_object	(mrbc_current_runtime->class_object)
+#define mrbc_class_nil		(mrbc_current_runtime->class_nil)
+#define mrbc_class_false	(mrbc_current_runtime->class_false)
+#define mrbc_class_true		(mrbc_current_runtime->class_true)
+#define mrbc_class_symbol	(mrbc_current_runtime->class_symbol)
+#define mrbc_class_fixnum	(mrbc_current_runtime->class_fixnum)
+#define mrbc_class_float	(mrbc_current_runtime->class_float)
+#define mrbc_class_string	(mrbc_current_runtime->class_string)
+#define mrbc_class_array	(mrbc_current_runtime->class_array)
+#define mrbc_class_range	(mrbc_current_runtime->class_range)
+#define mrbc_class_hash		(mrbc_current_runtime->class_hash)
+#define mrbc_class_proc		(mrbc_current_runtime->class_proc)
+#define mrbc_class_math		(mrbc_current_runtime->class_math)
 
 void mrbc_init_static(void);
 void mrbc_cleanup_static(void);
@@ -22,31 +22,15 @@
 #include "static.h"
 #include "class.h"
 #include "symbol.h"
+#include "runtime.h"
 #include "c_string.h"
 #include "c_array.h"
 #include "console.h"
 
 
-#if !defined(MRBC_SYMBOL_SEARCH_LINER) && !defined(MRBC_SYMBOL_SEARCH_BTREE)
-#define MRBC_SYMBOL_SEARCH_BTREE
-#endif
-
-#ifndef MRBC_SYMBOL_TABLE_INDEX_TYPE
-#define MRBC_SYMBOL_TABLE_INDEX_TYPE	uint16_t
-#endif
-
-struct SYM_INDEX {
-  uint16_t hash;	//!< hash value, returned by calc_hash().
-#ifdef MRBC_SYMBOL_SEARCH_BTREE
-  MRBC_SYMBOL_TABLE_INDEX_TYPE left;
-  MRBC_SYMBOL_TABLE_INDEX_TYPE right;
-#endif
-  const char *cstr;	//!< point to the symbol string.
-};
-
-
-static struct SYM_INDEX sym_index[MAX_SYMBOLS_COUNT];
-static int sym_index_pos;	// point to the last(free) sym_index array.
+// symbol table. (see runtime.h)
+#define sym_index	(mrbc_current_runtime->sym_index)
+#define sym_index_pos	(mrbc_current_runtime->sym_index_pos)
 
 
 //================================================================
@@ -272,7 +256,7 @@ void mrbc_init_class_symbol(struct VM *vm)
 
 
 
-#if defined(MRBC_DEBUG)
+#if defined(MRBC_DEBUG) || MRBC_USE_HEALTH
 //================================================================
 /* statistics
 
@@ -28,7 +28,7 @@ mrbc_sym str_to_symid(const char *str);
 const char *symid_to_str(mrbc_sym sym_id);
 void mrbc_init_class_symbol(struct VM *vm);
 
-#if defined(MRBC_DEBUG)
+#if defined(MRBC_DEBUG) || MRBC_USE_HEALTH
 void mrbc_symbol_statistics( int *total_used );
 #endif
 
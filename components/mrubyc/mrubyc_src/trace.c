@@ -0,0 +1,332 @@
+/*! @file
+  @brief
+  Scheduler and VM event trace.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Record scheduler and VM events into a fixed ring buffer,
+  and export them as a binary log. (convert by log/trace2chrome.rb)
+
+  </pre>
+*/
+
+#include "vm_config.h"
+#include <stdint.h>
+#include <string.h>
+
+#include "value.h"
+#include "vm.h"
+#include "class.h"
+#include "symbol.h"
+#include "console.h"
+#include "trace.h"
+#include "hal/hal.h"
+
+
+#if MRBC_USE_TRACE
+
+/*
+  Binary log format (all values are big endian)
+
+   "MRBCTRC1"	identifier
+   0000_0000	n of events
+   0000_0000	n of lost events (overwritten)
+   (loop n of events)
+     0000_0000	timestamp (micro seconds)
+     00		type
+     00		vm_id
+     0000	arg16
+     0000_0000	arg32
+     0000_0000	arg32b
+   (loop n of symbols, used in CFUNC events)
+     0000	sym_id
+     00		length
+     ...	symbol name
+   ffff		terminator
+*/
+
+#if !defined(MRBC_TRACE_BUFFER_SIZE)
+#define MRBC_TRACE_BUFFER_SIZE 256
+#endif
+#if !defined(MRBC_TRACE_ALLOC_THRESHOLD)
+#define MRBC_TRACE_ALLOC_THRESHOLD 64
+#endif
+
+static mrbc_trace_event trace_buf[MRBC_TRACE_BUFFER_SIZE];
+static volatile uint32_t trace_head;	//!< total number of recorded events.
+static uint32_t trace_tail;		//!< already fetched or cleared.
+static volatile int trace_enabled;
+static unsigned int trace_alloc_threshold = MRBC_TRACE_ALLOC_THRESHOLD;
+
+
+//================================================================
+/*! start recording
+*/
+void mrbc_trace_start(void)
+{
+  trace_enabled = 1;
+}
+
+
+//================================================================
+/*! stop recording
+*/
+void mrbc_trace_stop(void)
+{
+  trace_enabled = 0;
+}
+
+
+//================================================================
+/*! clear recorded events
+*/
+void mrbc_trace_clear(void)
+{
+  int enabled = trace_enabled;
+  trace_enabled = 0;
+  trace_tail = trace_head;
+  trace_enabled = enabled;
+}
+
+
+//================================================================
+/*! set the threshold of ALLOC/FREE events.
+
+  @param  size	minimum block size to record.
+*/
+void mrbc_trace_set_alloc_threshold(unsigned int size)
+{
+  trace_alloc_threshold = size;
+}
+
+
+//================================================================
+/*! get the threshold of ALLOC/FREE events.
+*/
+int mrbc_trace_alloc_threshold(void)
+{
+  return trace_enabled ? trace_alloc_threshold : 0x7fffffff;
+}
+
+
+//================================================================
+/*! record an event
+
+  @param  type	enum MrbcTraceEventType
+  @param  vm_id	vm_id or 0.
+  @param  arg16	argument.
+  @param  arg32	argument.
+  @param  arg32b argument.
+  @note	  called from tick ISR too. slot is reserved atomically.
+*/
+void mrbc_trace_record(int type, int vm_id, int arg16, uint32_t arg32, uint32_t arg32b)
+{
+  if( !trace_enabled ) return;
+
+  uint32_t n = __atomic_fetch_add( &trace_head, 1, __ATOMIC_RELAXED );
+  mrbc_trace_event *ev = &trace_buf[ n % MRBC_TRACE_BUFFER_SIZE ];
+
+  ev->timestamp = hal_micros();
+  ev->type = type;
+  ev->vm_id = vm_id;
+  ev->arg16 = arg16;
+  ev->arg32 = arg32;
+  ev->arg32b = arg32b;
+}
+
+
+//================================================================
+/*! number of unread events in buffer.
+
+  @param  head	current trace_head.
+  @return	number of events.
+*/
+static uint32_t trace_unread(uint32_t head)
+{
+  uint32_t n = head - trace_tail;
+  return n < MRBC_TRACE_BUFFER_SIZE ? n : MRBC_TRACE_BUFFER_SIZE;
+}
+
+
+//================================================================
+/*! fetch (and consume) recorded events, oldest first.
+
+  @param  dst	pointer to destination buffer.
+  @param  max	size of destination buffer.
+  @param  lost	returns number of overwritten events, or NULL.
+  @return	number of fetched events.
+*/
+int mrbc_trace_fetch(mrbc_trace_event *dst, int max, uint32_t *lost)
+{
+  uint32_t head = trace_head;
+  uint32_t i = head - trace_unread(head);
+  int n = 0;
+
+  if( lost ) *lost = i - trace_tail;
+  while( i != head && n < max ) {
+    dst[n++] = trace_buf[ i++ % MRBC_TRACE_BUFFER_SIZE ];
+  }
+  trace_tail = i;
+
+  return n;
+}
+
+
+//================================================================
+/*! export recorded events as binary log.
+
+  @param  writer	output function.
+  @param  arg		argument for output function.
+  @return		number of exported events, or negative if error.
+*/
+int mrbc_trace_export(mrbc_trace_writer writer, void *arg)
+{
+  int enabled = trace_enabled;
+  trace_enabled = 0;
+
+  uint32_t head = trace_head;
+  uint32_t n = trace_unread(head);
+  uint8_t buf[16];
+  int ret = -1;
+
+  // header
+  memcpy( buf, "MRBCTRC1", 8 );
+  uint32_to_bin( n, buf+8 );
+  uint32_to_bin( head - trace_tail - n, buf+12 );
+  if( writer(arg, buf, 16) < 0 ) goto DONE;
+
+  // events, and collect sym_id of CFUNC events.
+  uint8_t sym_used[MAX_SYMBOLS_COUNT / 8 + 1];
+  memset( sym_used, 0, sizeof(sym_used) );
+
+  uint32_t i;
+  for( i = head - n; i != head; i++ ) {
+    const mrbc_trace_event *ev = &trace_buf[ i % MRBC_TRACE_BUFFER_SIZE ];
+
+    uint32_to_bin( ev->timestamp, buf );
+    buf[4] = ev->type;
+    buf[5] = ev->vm_id;
+    uint16_to_bin( ev->arg16, buf+6 );
+    uint32_to_bin( ev->arg32, buf+8 );
+    uint32_to_bin( ev->arg32b, buf+12 );
+    if( writer(arg, buf, 16) < 0 ) goto DONE;
+
+    if( (ev->type == MRBC_TRACE_CFUNC_ENTER ||
+	 ev->type == MRBC_TRACE_CFUNC_EXIT) && ev->arg16 < MAX_SYMBOLS_COUNT ) {
+      sym_used[ ev->arg16 / 8 ] |= (1 << (ev->arg16 % 8));
+    }
+  }
+
+  // symbol names
+  int sym_id;
+  for( sym_id = 0; sym_id < MAX_SYMBOLS_COUNT; sym_id++ ) {
+    if( !(sym_used[ sym_id / 8 ] & (1 << (sym_id % 8))) ) continue;
+    const char *s = symid_to_str( sym_id );
+    if( !s ) continue;
+
+    int len = strlen(s);
+    if( len > 255 ) len = 255;
+    uint16_to_bin( sym_id, buf );
+    buf[2] = len;
+    if( writer(arg, buf, 3) < 0 ) goto DONE;
+    if( writer(arg, s, len) < 0 ) goto DONE;
+  }
+  uint16_to_bin( 0xffff, buf );
+  if( writer(arg, buf, 2) < 0 ) goto DONE;
+
+  ret = n;
+
+ DONE:
+  trace_enabled = enabled;
+  return ret;
+}
+
+
+//================================================================
+/*! writer for mrbc_trace_dump. output hex string to console.
+*/
+static int console_hex_writer(void *arg, const void *buf, int nbytes)
+{
+  int *column = (int *)arg;
+  const uint8_t *p = (const uint8_t *)buf;
+
+  while( nbytes-- > 0 ) {
+    if( *column == 0 ) console_print("TRACE:");
+    console_printf("%02x", *p++);
+    if( ++*column == 32 ) {
+      console_putchar('\n');
+      *column = 0;
+    }
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! dump recorded events to console.
+
+  (e.g.)
+  TRACE:BEGIN
+  TRACE:4d5242435452433100000012...
+  TRACE:END
+*/
+void mrbc_trace_dump(void)
+{
+  int column = 0;
+
+  console_print("TRACE:BEGIN\n");
+  mrbc_trace_export( console_hex_writer, &column );
+  if( column != 0 ) console_putchar('\n');
+  console_print("TRACE:END\n");
+}
+
+
+
+//================================================================
+/*! (method) VM.trace_start
+*/
+static void c_vm_trace_start(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc >= 1 && v[1].tt == MRBC_TT_FIXNUM ) {
+    mrbc_trace_set_alloc_threshold( v[1].i );
+  }
+  mrbc_trace_start();
+}
+
+
+//================================================================
+/*! (method) VM.trace_stop
+*/
+static void c_vm_trace_stop(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_trace_stop();
+}
+
+
+//================================================================
+/*! (method) VM.trace_dump
+*/
+static void c_vm_trace_dump(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_trace_dump();
+  mrbc_trace_clear();
+}
+
+
+//================================================================
+/*! define trace methods to VM class.
+
+  @param  cls	VM class.
+*/
+void mrbc_trace_define_methods(struct RClass *cls)
+{
+  mrbc_define_method(0, cls, "trace_start", c_vm_trace_start);
+  mrbc_define_method(0, cls, "trace_stop", c_vm_trace_stop);
+  mrbc_define_method(0, cls, "trace_dump", c_vm_trace_dump);
+}
+
+#endif // MRBC_USE_TRACE
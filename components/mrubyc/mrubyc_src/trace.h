@@ -0,0 +1,95 @@
+/*! @file
+  @brief
+  Scheduler and VM event trace.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Record scheduler and VM events into a fixed ring buffer,
+  and export them as a binary log. (convert by log/trace2chrome.rb)
+
+  </pre>
+*/
+
+#ifndef MRBC_SRC_TRACE_H_
+#define MRBC_SRC_TRACE_H_
+
+#include <stdint.h>
+#include "vm_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//================================================================
+/*!@brief
+  Trace event type
+*/
+enum MrbcTraceEventType {
+  MRBC_TRACE_TASK_SWITCH_IN  = 0x01,	//!< arg16: priority
+  MRBC_TRACE_TASK_SWITCH_OUT = 0x02,	//!< arg16: new task state
+  MRBC_TRACE_TASK_WAKEUP     = 0x03,	//!< arg32: wakeup tick
+  MRBC_TRACE_MUTEX_WAIT      = 0x04,	//!< arg32: mutex address
+  MRBC_TRACE_ALLOC           = 0x05,	//!< arg32: size, arg32b: pool offset
+  MRBC_TRACE_FREE            = 0x06,	//!< arg32: size, arg32b: pool offset
+  MRBC_TRACE_CFUNC_ENTER     = 0x07,	//!< arg16: method sym_id
+  MRBC_TRACE_CFUNC_EXIT      = 0x08,	//!< arg16: method sym_id
+  MRBC_TRACE_PREEMPT         = 0x09,	//!< arg32: tick
+};
+
+
+//================================================================
+/*!@brief
+  Trace event record. (16 bytes)
+*/
+typedef struct RTraceEvent {
+  uint32_t timestamp;	//!< hal_micros()
+  uint8_t  type;	//!< enum MrbcTraceEventType
+  uint8_t  vm_id;	//!< 0 is not task context.
+  uint16_t arg16;
+  uint32_t arg32;
+  uint32_t arg32b;
+} mrbc_trace_event;
+
+
+//================================================================
+/*!@brief
+  Output function for export.
+  returns negative value if error.
+*/
+typedef int (*mrbc_trace_writer)(void *arg, const void *buf, int nbytes);
+
+
+#if MRBC_USE_TRACE
+struct RClass;
+
+void mrbc_trace_start(void);
+void mrbc_trace_stop(void);
+void mrbc_trace_clear(void);
+void mrbc_trace_set_alloc_threshold(unsigned int size);
+void mrbc_trace_record(int type, int vm_id, int arg16, uint32_t arg32, uint32_t arg32b);
+int mrbc_trace_alloc_threshold(void);
+int mrbc_trace_fetch(mrbc_trace_event *dst, int max, uint32_t *lost);
+int mrbc_trace_export(mrbc_trace_writer writer, void *arg);
+void mrbc_trace_dump(void);
+void mrbc_trace_define_methods(struct RClass *cls);
+
+# define MRBC_TRACE(type, vm_id, arg16, arg32, arg32b) \
+  mrbc_trace_record((type), (vm_id), (arg16), (arg32), (arg32b))
+# define MRBC_TRACE_ALLOC(type, size, offset) \
+  do { if( (size) >= mrbc_trace_alloc_threshold() ) \
+      mrbc_trace_record((type), 0, 0, (size), (offset)); } while(0)
+
+#else
+# define MRBC_TRACE(type, vm_id, arg16, arg32, arg32b) ((void)0)
+# define MRBC_TRACE_ALLOC(type, size, offset) ((void)0)
+#endif
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -26,6 +26,9 @@
 #include "class.h"
 #include "symbol.h"
 #include "console.h"
+#include "trace.h"
+#include "profile.h"
+#include "runtime.h"
 
 #include "c_string.h"
 #include "c_range.h"
@@ -33,7 +36,11 @@
 #include "c_hash.h"
 
 
-static uint32_t free_vm_bitmap[MAX_VM_COUNT / 32 + 1];
+#define free_vm_bitmap (mrbc_current_runtime->free_vm_bitmap)
+#define method_serial (mrbc_current_runtime->method_serial)
+#define method_cache (mrbc_current_runtime->method_cache)
+#define METHOD_CACHE_INDEX(site, cls) \
+  ((((uintptr_t)(site) >> 2) ^ ((uintptr_t)(cls) >> 4)) & (MRBC_METHOD_CACHE_SIZE - 1))
 #define FREE_BITMAP_WIDTH 32
 #define Num(n) (sizeof(n)/sizeof((n)[0]))
 
@@ -75,7 +82,17 @@ void mrbc_cleanup_vm(void)
 */
 const char * mrbc_get_irep_symbol( const uint8_t *p, int n )
 {
-  int cnt = bin_to_uint32(p);
+  uint32_t cnt = bin_to_uint32(p);
+
+  if( cnt & MRBC_IMAGE_SYMS_LINKED ) {
+    // index of the shared symbol table. (see load_irep_1)
+    if( n >= (cnt & ~MRBC_IMAGE_SYMS_LINKED) ) return 0;
+    const uint8_t *tbl = p - bin_to_uint32(p + 4);
+    int idx = bin_to_uint16(p + 8 + n * 2);
+    if( idx == MRBC_IMAGE_NULL_SYM ) return 0;
+    return (char *)tbl + bin_to_uint32(tbl + idx * 4) + 2;
+  }
+
   if( n >= cnt ) return 0;
   p += 4;
   while( n > 0 ) {
@@ -100,6 +117,27 @@ const char *mrbc_get_callee_name( struct VM *vm )
 }
 
 
+//================================================================
+/*! print source position of the current instruction, for diagnostics.
+
+  Prints nothing if the bytecode has no debug information. (mrbc -g)
+
+  @param  vm	Pointer to VM
+*/
+void mrbc_print_position( struct VM *vm )
+{
+  const char *fname;
+  int len;
+  int line = mrbc_debug_get_line( vm, vm->pc_irep,
+				  vm->inst - vm->pc_irep->code - 1, &fname, &len );
+  if( line == 0 ) return;
+
+  console_print(" at ");
+  console_nprint(fname, len);
+  console_printf(":%d", line);
+}
+
+
 //================================================================
 /*!@brief
 
@@ -166,7 +204,11 @@ void mrbc_push_callinfo( struct VM *vm, mrbc_sym mid, int n_args )
   callinfo->mid = mid;
   callinfo->n_args = n_args;
   callinfo->target_class = vm->target_class;
+  callinfo->own_class = NULL;
   callinfo->prev = vm->callinfo_tail;
+#if MRBC_USE_PROFILE
+  callinfo->prof.idx = -1;
+#endif
   vm->callinfo_tail = callinfo;
 }
 
@@ -179,6 +221,9 @@ void mrbc_pop_callinfo( struct VM *vm )
 {
   mrbc_callinfo *callinfo = vm->callinfo_tail;
   if( !callinfo ) return;
+#if MRBC_USE_PROFILE
+  mrbc_profile_end( &callinfo->prof, callinfo->prev );
+#endif
   vm->callinfo_tail = callinfo->prev;
   vm->current_regs = callinfo->current_regs;
   vm->pc_irep = callinfo->pc_irep;
@@ -190,6 +235,76 @@ void mrbc_pop_callinfo( struct VM *vm )
 }
 
 
+// return address of the block called from C. (see mrbc_yield_block)
+static const uint8_t return_to_c[] = { OP_ABORT };
+
+
+//================================================================
+/*! Call the block given to C function, and return after the block returns.
+
+  The call stack is made as if a method written in Ruby yields,
+  so the block can access local variables of the caller.
+  break and return in the block end the block only,
+  and the value is returned to the C function.
+  Task switching in the block is deferred until the C function returns,
+  so C methods called in the block must not use mrbc_cfunc_block(),
+  and sleep or Task.pass in the block does not stop it. The block
+  keeps running, and the task sleeps for the rest of the time, if any,
+  after the C function returns.
+
+  @param  vm	pointer to VM.
+  @param  v	argument of C function.
+  @param  blk	index of the block in v[]. (argc + 1)
+  @return	return value of the block.
+*/
+mrbc_value mrbc_yield_block( struct VM *vm, mrbc_value v[], int blk )
+{
+  mrbc_value ret = mrbc_nil_value();
+  int flag_preemption = 0;
+
+  if( v[blk].tt != MRBC_TT_PROC ) return ret;
+
+  // push the method frame.
+  mrbc_callinfo *callinfo = vm->callinfo_tail;
+  mrbc_push_callinfo(vm, 0, 0);
+  if( vm->callinfo_tail == callinfo ) return ret;	// ENOMEM
+  callinfo = vm->callinfo_tail;
+
+  // push the block frame, returns to OP_ABORT.
+  uint8_t *inst = vm->inst;
+  vm->current_regs = v;
+  vm->inst = (uint8_t *)return_to_c;
+  mrbc_push_callinfo(vm, 0, 0);
+  vm->inst = inst;
+  if( vm->callinfo_tail == callinfo ) {		// ENOMEM
+    mrbc_pop_callinfo(vm);
+    return ret;
+  }
+
+  mrbc_value *regs = v + blk + 1;
+  mrbc_release( &regs[0] );
+  regs[0] = callinfo->current_regs[0];		// self of the caller.
+  mrbc_dup( &regs[0] );
+
+  vm->pc_irep = v[blk].proc->irep;
+  vm->pc = 0;
+  vm->inst = vm->pc_irep->code;
+  vm->current_regs = regs;
+
+  // run until the block frame is popped.
+  while( vm->callinfo_tail != callinfo ) {
+    if( mrbc_vm_run(vm) == 0 ) flag_preemption = 1;
+  }
+
+  ret = regs[0];
+  regs[0].tt = MRBC_TT_EMPTY;
+  mrbc_pop_callinfo(vm);			// the method frame.
+
+  if( flag_preemption ) vm->flag_preemption = 1;
+  return ret;
+}
+
+
 
 
 
@@ -571,8 +686,10 @@ static inline int op_getconst( mrbc_vm *vm, mrbc_value *regs )
   mrbc_release(&regs[a]);
   mrbc_value *v = mrbc_get_const(sym_id);
   if( v == NULL ) {             // raise?
-    console_printf( "NameError: uninitialized constant %s\n",
+    console_printf( "NameError: uninitialized constant %s",
 		    symid_to_str( sym_id ));
+    mrbc_print_position(vm);
+    console_putchar('\n');
     return 0;
   }
 
@@ -789,20 +906,101 @@ static inline int op_onerr( mrbc_vm *vm, mrbc_value *regs )
 
 //================================================================
 /*!@brief
-  Method call by method name
+  find method through the method cache of the call site.
+
+  @param  site	instruction address of the call site.
+  @param  cls	receiver class, or defining class if super.
+  @return	cache entry, or NULL if not cached.
+*/
+static inline const mrbc_method_cache *method_cache_get( const uint8_t *site, const mrbc_class *cls )
+{
+#if MRBC_USE_METHOD_CACHE
+  const mrbc_method_cache *mc = &method_cache[METHOD_CACHE_INDEX(site, cls)];
+  if( mc->site == site && mc->cls == cls && mc->serial == method_serial ) {
+    return mc;
+  }
+#endif
+  return NULL;
+}
+
+
+//================================================================
+/*!@brief
+  find method, and put into the method cache of the call site.
+
+  @param  site	instruction address of the call site.
+  @param  cls	receiver class, or defining class if super.
+  @param  search	class to search from.
+  @param  sym_id	method name.
+  @return	cache entry, or NULL if no method.
+*/
+static const mrbc_method_cache *method_cache_set( const uint8_t *site, const mrbc_class *cls, const mrbc_class *search, mrbc_sym sym_id )
+{
+  mrbc_class *owner;
+  mrbc_proc *proc = find_method_and_owner( search, sym_id, &owner );
+  if( !proc ) return NULL;
+
+#if MRBC_USE_METHOD_CACHE
+  mrbc_method_cache *mc = &method_cache[METHOD_CACHE_INDEX(site, cls)];
+#else
+  mrbc_method_cache *mc = &method_cache[0];
+#endif
+  mc->site = site;
+  mc->cls = cls;
+  mc->proc = proc;
+  mc->owner = owner;
+  mc->serial = method_serial;
+  mc->sym_id = sym_id;
+
+  return mc;
+}
+
+
+//================================================================
+/*!@brief
+  No method error.
 
   @param  vm    pointer of VM.
   @param  method_name  method name
   @param  regs  pointer to regs
   @param  a     operand a
-  @param  b     operand b
   @param  c     operand c
   @param  is_sendb  Is called from OP_SENDB?
   @retval 0  No error.
 */
-static inline int op_send_by_name( mrbc_vm *vm, const char *method_name, mrbc_value *regs, uint8_t a, uint8_t b, uint8_t c, int is_sendb )
+static int send_no_method( mrbc_vm *vm, const char *method_name, mrbc_value *regs, uint8_t a, uint8_t c, int is_sendb )
 {
-  mrbc_value recv = regs[a];
+  // if not OP_SENDB, blcok does not exist
+  if( !is_sendb ){
+    mrbc_release( &regs[a + c + 1] );
+    regs[a + c + 1].tt = MRBC_TT_NIL;
+  }
+
+  mrb_class *cls = find_class_by_object( vm, &regs[a] );
+  console_printf("No method. Class:%s Method:%s",
+		 symid_to_str(cls->sym_id), method_name );
+  mrbc_print_position(vm);
+  console_putchar('\n');
+  return 0;
+}
+
+
+//================================================================
+/*!@brief
+  Method call
+
+  @param  vm    pointer of VM.
+  @param  mc    method to call. (method cache entry)
+  @param  regs  pointer to regs
+  @param  a     operand a
+  @param  c     operand c
+  @param  is_sendb  Is called from OP_SENDB?
+  @retval 0  No error.
+*/
+static inline int send_method( mrbc_vm *vm, const mrbc_method_cache *mc, mrbc_value *regs, uint8_t a, uint8_t c, int is_sendb )
+{
+  mrbc_proc *m = mc->proc;
+  mrbc_sym sym_id = mc->sym_id;
 
   // if not OP_SENDB, blcok does not exist
   int bidx = a + c + 1;
@@ -811,21 +1009,28 @@ static inline int op_send_by_name( mrbc_vm *vm, const char *method_name, mrbc_va
     regs[bidx].tt = MRBC_TT_NIL;
   }
 
-  mrbc_sym sym_id = str_to_symid(method_name);
-  mrbc_proc *m = find_method(vm, &recv, sym_id);
-
-  if( m == 0 ) {
-    mrb_class *cls = find_class_by_object( vm, &recv );
-    console_printf("No method. Class:%s Method:%s\n",
-		   symid_to_str(cls->sym_id), method_name );
-    return 0;
-  }
-
   // m is C func
   if( m->c_func ) {
+#if MRBC_USE_PROFILE
+    mrbc_profile_frame prof = {.idx = -1};
+    if( m->func != c_proc_call ) {
+      mrbc_profile_begin( &prof, find_class_by_object(vm, &regs[a]), sym_id );
+    }
+#endif
+    MRBC_TRACE(MRBC_TRACE_CFUNC_ENTER, vm->vm_id, sym_id, 0, 0);
     m->func(vm, regs + a, c);
+    MRBC_TRACE(MRBC_TRACE_CFUNC_EXIT, vm->vm_id, sym_id, 0, 0);
+#if MRBC_USE_PROFILE
+    mrbc_profile_end( &prof, vm->callinfo_tail );
+#endif
     if( m->func == c_proc_call ) return 0;
 
+    // the blocked C method uses the arguments after resumed.
+    if( vm->flag_cfunc_block ) {
+      vm->cfunc_nregs = bidx - a;
+      return 0;
+    }
+
     int release_reg = a+1;
     while( release_reg <= bidx ) {
       mrbc_release(&regs[release_reg]);
@@ -837,6 +1042,13 @@ static inline int op_send_by_name( mrbc_vm *vm, const char *method_name, mrbc_va
   // m is Ruby method.
   // callinfo
   mrbc_push_callinfo(vm, sym_id, c);
+  if( vm->callinfo_tail ) {
+    vm->callinfo_tail->own_class = mc->owner;
+#if MRBC_USE_PROFILE
+    mrbc_profile_begin( &vm->callinfo_tail->prof,
+			find_class_by_object(vm, &regs[a]), sym_id );
+#endif
+  }
 
   // target irep
   vm->pc = 0;
@@ -850,6 +1062,33 @@ static inline int op_send_by_name( mrbc_vm *vm, const char *method_name, mrbc_va
 }
 
 
+//================================================================
+/*!@brief
+  Method call by method name
+
+  @param  vm    pointer of VM.
+  @param  method_name  method name
+  @param  regs  pointer to regs
+  @param  a     operand a
+  @param  b     operand b
+  @param  c     operand c
+  @param  is_sendb  Is called from OP_SENDB?
+  @retval 0  No error.
+*/
+static inline int op_send_by_name( mrbc_vm *vm, const char *method_name, mrbc_value *regs, uint8_t a, uint8_t b, uint8_t c, int is_sendb )
+{
+  mrbc_class *cls = find_class_by_object( vm, &regs[a] );
+  const mrbc_method_cache *mc = method_cache_get( vm->inst, cls );
+
+  if( !mc ) {
+    mc = method_cache_set( vm->inst, cls, cls, str_to_symid(method_name) );
+    if( !mc ) return send_no_method( vm, method_name, regs, a, c, is_sendb );
+  }
+
+  return send_method( vm, mc, regs, a, c, is_sendb );
+}
+
+
 
 
 
@@ -891,9 +1130,18 @@ static inline int op_send( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BBB();
 
-  const char *sym_name = mrbc_get_irep_symbol(vm->pc_irep->ptr_to_sym, b);
+  int is_sendb = (vm->inst[-4] == OP_SENDB);
+  mrbc_class *cls = find_class_by_object( vm, &regs[a] );
+  const mrbc_method_cache *mc = method_cache_get( vm->inst, cls );
 
-  return op_send_by_name( vm, sym_name, regs, a, b, c, (vm->inst[-4] == OP_SENDB) );
+  // resolve the name, only if not cached.
+  if( !mc ) {
+    const char *sym_name = mrbc_get_irep_symbol(vm->pc_irep->ptr_to_sym, b);
+    mc = method_cache_set( vm->inst, cls, cls, str_to_symid(sym_name) );
+    if( !mc ) return send_no_method( vm, sym_name, regs, a, c, is_sendb );
+  }
+
+  return send_method( vm, mc, regs, a, c, is_sendb );
 }
 
 
@@ -912,18 +1160,35 @@ static inline int op_super( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_BB();
 
+  // super outside of a method.
   mrbc_callinfo *callinfo = vm->callinfo_tail;
+  if( !callinfo ) return 0;
+  mrbc_sym sym_id = callinfo->mid;
+
+  // the class that has the current method. (own_class is NULL if the
+  // method was not called by OP_SEND, then find it by the irep)
+  mrbc_class *cls = callinfo->own_class;
+  if( !cls ) {
+    cls = find_class_by_object( vm, &regs[0] );
+    mrbc_class *c = cls;
+    mrbc_class *owner;
+    mrbc_proc *m;
+    while( c && (m = find_method_and_owner( c, sym_id, &owner )) != NULL ) {
+      if( !m->c_func && m->irep == vm->pc_irep ) {
+	cls = owner;
+	break;
+      }
+      c = owner->super;
+    }
+  }
 
-  int id = callinfo->mid;
-  const char *sym_name = symid_to_str(id);
+  const mrbc_method_cache *mc = method_cache_get( vm->inst, cls );
+  if( !mc ) mc = method_cache_set( vm->inst, cls, cls->super, sym_id );
 
   mrbc_dup( &regs[0] );
   mrbc_release( &regs[a] );
   regs[a] = regs[0];
 
-  // fing super class
-  regs[a].instance->cls = regs[a].instance->cls->super;
-
   if( b == 127 ){
     // expand array
     assert( regs[a+1].tt == MRBC_TT_ARRAY );
@@ -938,7 +1203,9 @@ static inline int op_super( mrbc_vm *vm, mrbc_value *regs )
     }
     b = argc;
   }
-  return op_send_by_name(vm, sym_name, regs, a, 0, b, 0);
+
+  if( !mc ) return send_no_method( vm, symid_to_str(sym_id), regs, a, b, 0 );
+  return send_method( vm, mc, regs, a, b, 0 );
 }
 
 
@@ -1036,19 +1303,14 @@ static inline int op_enter( mrbc_vm *vm, mrbc_value *regs )
 
 
 //================================================================
-/*!@brief
-  Execute OP_RETURN
-
-  return R(a) (normal)
+/*! return R(a) from the current frame.
 
   @param  vm    pointer of VM.
   @param  regs  pointer to regs
-  @retval 0  No error.
+  @param  a     register of the return value.
 */
-static inline int op_return( mrbc_vm *vm, mrbc_value *regs )
+static void return_frame( mrbc_vm *vm, mrbc_value *regs, int a )
 {
-  FETCH_B();
-
   mrbc_release(&regs[0]);
   regs[0] = regs[a];
   regs[a].tt = MRBC_TT_EMPTY;
@@ -1064,13 +1326,30 @@ static inline int op_return( mrbc_vm *vm, mrbc_value *regs )
   for( i = 1; i < nregs; i++ ) {
     mrbc_release( &regs[i] );
   }
+}
+
+
+//================================================================
+/*!@brief
+  Execute OP_RETURN
+
+  return R(a) (normal)
+
+  @param  vm    pointer of VM.
+  @param  regs  pointer to regs
+  @retval 0  No error.
+*/
+static inline int op_return( mrbc_vm *vm, mrbc_value *regs )
+{
+  FETCH_B();
+
+  return_frame( vm, regs, a );
 
   return 0;
 }
 
 
 
-
 //================================================================
 /*!@brief
   Execute OP_RETURN_BLK
@@ -1088,8 +1367,9 @@ static inline int op_return_blk( mrbc_vm *vm, mrbc_value *regs )
   int nregs = vm->pc_irep->nregs;
   mrbc_irep *caller = vm->irep;
 
-  // trace back to caller
-  while( vm->callinfo_tail->pc_irep != caller ){
+  // trace back to caller, or to the C function. (see mrbc_yield_block)
+  while( vm->callinfo_tail->pc_irep != caller &&
+	 vm->callinfo_tail->inst != return_to_c ){
     nregs += vm->callinfo_tail->n_args;
     mrbc_pop_callinfo(vm);
   }
@@ -1126,11 +1406,15 @@ static inline int op_break( mrbc_vm *vm, mrbc_value *regs )
 {
   FETCH_B();
 
-  (void)a;
+  // break in the block called from C returns R(a) to it.
+  mrbc_callinfo *callinfo = vm->callinfo_tail;
+  if( callinfo && callinfo->inst == return_to_c ) {
+    return_frame( vm, regs, a );
+    return 0;
+  }
 
   // pop until bytecode is OP_SENDB
-  mrbc_callinfo *callinfo = vm->callinfo_tail;
-  while( callinfo ){
+  while( callinfo && callinfo->inst != return_to_c ){
     if( callinfo->inst[-4-callinfo->n_args] == OP_SENDB ){
       // found then return to callinfo
       vm->callinfo_tail = callinfo->prev;
@@ -1901,6 +2185,150 @@ static inline int op_intern( mrbc_vm *vm, mrbc_value *regs )
 }
 
 
+#if MRBC_USE_STRING && MRBC_USE_CONSOLE_STREAM
+//================================================================
+/*!@brief
+  Print a string of the pool.
+
+  @param  vm    pointer of VM.
+  @param  b     pool index.
+  @param  lf    1 if the last output was LF.
+  @return       1 if the last output is LF.
+*/
+static int stream_pool_string( mrbc_vm *vm, int b, int lf )
+{
+  mrbc_object *pool_obj = vm->pc_irep->pools[b];
+  int len = bin_to_uint16(pool_obj->str - 2);
+  if( len == 0 ) return lf;
+
+  console_nprint( pool_obj->str, len );
+  return pool_obj->str[len-1] == '\n';
+}
+
+
+//================================================================
+/*!@brief
+  Stream an interpolated string straight to the console.
+
+  If the string built by OP_STRING is only given to puts or print,
+
+    STRING  R(a)   Lit
+    (MOVE | LOADxx | GETGV | GETIV | GETCONST | STRING)  R(a+1) ...
+    STRCAT  R(a)			(repeat the two)
+    SEND    R(a-1) :puts 1
+
+  print each piece instead of concatenating them. The pieces are
+  loaded by the same op_xxx(), and converted by "to_s" same as
+  op_strcat, so the output is same. Lit pieces are not copied.
+
+  @param  vm    pointer of VM.
+  @param  regs  pointer to regs
+  @param  a     operand a of OP_STRING
+  @param  b     operand b of OP_STRING
+  @retval 0     streamed. vm->inst is after the SEND.
+  @retval 1     not the pattern.
+*/
+static int stream_to_console( mrbc_vm *vm, mrbc_value *regs, uint32_t a, uint32_t b )
+{
+  // check the pattern.
+  const uint8_t *p = vm->inst;
+  if( a == 0 || a >= 0xfe ) return 1;
+
+  while( *p != OP_SEND ) {
+    switch( *p ) {
+    case OP_MOVE:     case OP_LOADL:   case OP_LOADI:   case OP_LOADINEG:
+    case OP_LOADSYM:  case OP_GETGV:   case OP_GETIV:   case OP_GETCONST:
+    case OP_STRING:
+      if( p[1] != a+1 ) return 1;
+      p += 3;
+      break;
+
+    case OP_LOADI__1: case OP_LOADI_0: case OP_LOADI_1: case OP_LOADI_2:
+    case OP_LOADI_3:  case OP_LOADI_4: case OP_LOADI_5: case OP_LOADI_6:
+    case OP_LOADI_7:  case OP_LOADNIL: case OP_LOADSELF: case OP_LOADT:
+    case OP_LOADF:
+      if( p[1] != a+1 ) return 1;
+      p += 2;
+      break;
+
+    default:
+      return 1;
+    }
+    if( p[0] != OP_STRCAT || p[1] != a ) return 1;
+    p += 2;
+  }
+  if( p[1] != a-1 || p[3] != 1 ) return 1;
+
+  // Object#puts or print, not redefined.
+  const uint8_t *site = p + 4;
+  mrbc_class *cls = find_class_by_object( vm, &regs[a-1] );
+  const mrbc_method_cache *mc = method_cache_get( site, cls );
+  if( !mc ) {
+    const char *sym_name = mrbc_get_irep_symbol(vm->pc_irep->ptr_to_sym, p[2]);
+    mc = method_cache_set( site, cls, cls, str_to_symid(sym_name) );
+    if( !mc ) return 1;
+  }
+  int method = mrbc_console_method( mc->proc );
+  if( !method ) return 1;
+
+  // print
+  MRBC_TRACE(MRBC_TRACE_CFUNC_ENTER, vm->vm_id, mc->sym_id, 0, 0);
+  int lf = stream_pool_string( vm, b, 0 );
+
+  while( *vm->inst != OP_SEND ) {
+    uint8_t op = *vm->inst++;
+    switch( op ) {
+    case OP_MOVE:	op_move     (vm, regs); break;
+    case OP_LOADL:	op_loadl    (vm, regs); break;
+    case OP_LOADI:	op_loadi    (vm, regs); break;
+    case OP_LOADINEG:	op_loadineg (vm, regs); break;
+    case OP_LOADSYM:	op_loadsym  (vm, regs); break;
+    case OP_LOADNIL:	op_loadnil  (vm, regs); break;
+    case OP_LOADSELF:	op_loadself (vm, regs); break;
+    case OP_LOADT:	op_loadt    (vm, regs); break;
+    case OP_LOADF:	op_loadf    (vm, regs); break;
+    case OP_GETGV:	op_getgv    (vm, regs); break;
+    case OP_GETIV:	op_getiv    (vm, regs); break;
+    case OP_GETCONST:	op_getconst (vm, regs); break;
+    case OP_STRING:
+      lf = stream_pool_string( vm, vm->inst[1], lf );
+      vm->inst += 2 + 2;	// and STRCAT
+      continue;
+    default:		op_loadi_n  (vm, regs); break;
+    }
+    vm->inst += 2;		// STRCAT
+
+    mrbc_value *v = &regs[a+1];
+    switch( v->tt ) {
+    case MRBC_TT_NIL:
+      continue;
+    case MRBC_TT_FALSE:  case MRBC_TT_TRUE:   case MRBC_TT_FIXNUM:
+    case MRBC_TT_FLOAT:  case MRBC_TT_SYMBOL: case MRBC_TT_STRING:
+      break;
+    default: {
+      mrbc_proc *m = find_method(vm, v, str_to_symid("to_s"));
+      if( m && m->c_func ) m->func(vm, v, 0);
+    }
+    }
+    if( v->tt == MRBC_TT_STRING && mrbc_string_size(v) == 0 ) continue;
+    lf = mrbc_print_sub( v );
+  }
+  vm->inst += 4;		// SEND
+
+  if( method == MRBC_CONSOLE_PUTS ) {
+    if( !lf ) console_putchar('\n');
+    mrbc_release( &regs[a-1] );
+    regs[a-1] = mrbc_nil_value();
+  }
+  mrbc_release( &regs[a] );
+  mrbc_release( &regs[a+1] );
+  MRBC_TRACE(MRBC_TRACE_CFUNC_EXIT, vm->vm_id, mc->sym_id, 0, 0);
+
+  return 0;
+}
+#endif
+
+
 //================================================================
 /*!@brief
   Execute OP_STRING
@@ -1916,6 +2344,10 @@ static inline int op_string( mrbc_vm *vm, mrbc_value *regs )
   FETCH_BB();
 
 #if MRBC_USE_STRING
+#if MRBC_USE_CONSOLE_STREAM
+  if( stream_to_console( vm, regs, a, b ) == 0 ) return 0;
+#endif
+
   mrbc_object *pool_obj = vm->pc_irep->pools[b];
 
   /* CAUTION: pool_obj->str - 2. see IREP POOL structure. */
@@ -2179,18 +2611,23 @@ static inline int op_def( mrbc_vm *vm, mrbc_value *regs )
 
   mrbc_class *cls = regs[a].cls;
   const char *sym_name = mrbc_get_irep_symbol(vm->pc_irep->ptr_to_sym, b);
+
+  // methods in mrblib, not used by the application.
+  if( !mrbc_is_used_method(sym_name) ) {
+    mrbc_release(&regs[a+1]);
+    return 0;
+  }
+
   mrbc_sym sym_id = str_to_symid(sym_name);
   mrbc_proc *proc = regs[a+1].proc;
 
   mrbc_set_vm_id(proc, 0);
   proc->sym_id = sym_id;
-#ifdef MRBC_DEBUG
-  proc->names = sym_name;
-#endif
 
   // add to class
   proc->next = cls->procs;
   cls->procs = proc;
+  mrbc_method_cache_clear();
 
   // checking same method
   for( ;proc->next != NULL; proc = proc->next ) {
@@ -2235,7 +2672,9 @@ static inline int op_alias( mrbc_vm *vm, mrbc_value *regs )
     proc = proc->next;
   }
   if( !proc ) {
-    console_printf("NameError: undefined_method '%s'\n", sym_name_b);
+    console_printf("NameError: undefined_method '%s'", sym_name_b);
+    mrbc_print_position(vm);
+    console_putchar('\n');
     return 0;
   }
 
@@ -2246,11 +2685,9 @@ static inline int op_alias( mrbc_vm *vm, mrbc_value *regs )
 
   // register procs link.
   proc_alias->sym_id = sym_id_a;
-#if defined(MRBC_DEBUG)
-  proc_alias->names = sym_name_a;
-#endif
   proc_alias->next = vm->target_class->procs;
   vm->target_class->procs = proc_alias;
+  mrbc_method_cache_clear();
 
   return 0;
 }
@@ -2408,10 +2845,6 @@ mrbc_vm *mrbc_vm_open( struct VM *vm_arg )
   if( vm_arg == NULL ) vm->flag_need_memfree = 1;
   vm->vm_id = vm_id;
 
-#ifdef MRBC_DEBUG
-  vm->flag_debug_mode = 1;
-#endif
-
   return vm;
 }
 
@@ -2431,8 +2864,9 @@ void mrbc_vm_close( struct VM *vm )
   assert( i < Num(free_vm_bitmap) );
   free_vm_bitmap[i] &= ~(1 << (FREE_BITMAP_WIDTH - n - 1));
 
-  // free irep and vm
+  // free irep and vm. the call sites in it may be reused.
   if( vm->irep ) mrbc_irep_free( vm->irep );
+  mrbc_method_cache_clear();
   if( vm->flag_need_memfree ) mrbc_raw_free(vm);
 }
 
@@ -2483,6 +2917,7 @@ void mrbc_vm_begin( struct VM *vm )
 
   vm->error_code = 0;
   vm->flag_preemption = 0;
+  vm->flag_cfunc_block = 0;
 }
 
 
@@ -2495,6 +2930,9 @@ void mrbc_vm_begin( struct VM *vm )
 void mrbc_vm_end( struct VM *vm )
 {
   mrbc_global_clear_vm_id();
+#if MRBC_USE_SCRATCH
+  mrbc_scratch_free_all(vm);
+#endif
   mrbc_free_all(vm);
 }
 
@@ -2580,10 +3018,6 @@ int mrbc_vm_run( struct VM *vm )
     // Dispatch
     uint8_t op = *vm->inst++;
 
-#ifdef MRBC_DEBUG
-    // if( vm->flag_debug_mode )output_opcode( op );
-#endif
-
     switch( op ) {
     case OP_NOP:        ret = op_nop       (vm, regs); break;
     case OP_MOVE:       ret = op_move      (vm, regs); break;
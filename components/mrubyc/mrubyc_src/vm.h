@@ -19,6 +19,7 @@
 #include "vm_config.h"
 #include "value.h"
 #include "class.h"
+#include "profile.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -57,7 +58,11 @@ typedef struct CALLINFO {
   uint8_t *inst;
   mrbc_value *current_regs;
   mrbc_class *target_class;
+  mrbc_class *own_class;	// class that has the method, for super.
   uint8_t   n_args;     // num of args
+#if MRBC_USE_PROFILE
+  mrbc_profile_frame prof;
+#endif
 } mrbc_callinfo;
 typedef struct CALLINFO mrb_callinfo;
 
@@ -84,14 +89,16 @@ typedef struct VM {
 
   mrbc_class *target_class;
 
-#ifdef MRBC_DEBUG
-  uint8_t flag_debug_mode;
-#endif
-
   int32_t error_code;
 
   volatile int8_t flag_preemption;
   int8_t flag_need_memfree;
+  int8_t flag_cfunc_block;	// C method is blocked. (see mrbc_cfunc_block)
+  uint8_t cfunc_nregs;		// its v[1..n], released after resumed.
+
+#if MRBC_USE_SCRATCH
+  struct SCRATCH *scratch;	// scratch arena, or NULL.
+#endif
 } mrbc_vm;
 typedef struct VM mrb_vm;
 
@@ -100,10 +107,12 @@ typedef struct VM mrb_vm;
 void mrbc_cleanup_vm(void);
 const char *mrbc_get_irep_symbol(const uint8_t *p, int n);
 const char *mrbc_get_callee_name(struct VM *vm);
+void mrbc_print_position(struct VM *vm);
 mrbc_irep *mrbc_irep_alloc(struct VM *vm);
 void mrbc_irep_free(mrbc_irep *irep);
 void mrbc_push_callinfo(struct VM *vm, mrbc_sym mid, int n_args);
 void mrbc_pop_callinfo(struct VM *vm);
+mrbc_value mrbc_yield_block(struct VM *vm, mrbc_value v[], int blk);
 mrbc_vm *mrbc_vm_open(struct VM *vm_arg);
 void mrbc_vm_close(struct VM *vm);
 void mrbc_vm_begin(struct VM *vm);
@@ -34,6 +34,12 @@
 //  MRBC_ALLOC_16BIT or MRBC_ALLOC_24BIT
 #define MRBC_ALLOC_16BIT
 
+// storage class of the current runtime pointer. see runtime.h
+//  (e.g.) __thread, to run a runtime for each thread.
+#if !defined(MRBC_THREAD_LOCAL)
+#define MRBC_THREAD_LOCAL
+#endif
+
 
 /* Configure environment
    0: NOT USE
@@ -58,12 +64,113 @@
    $ make
 */
 
+// Use fast approximations in float32 for log, exp, pow, sqrt, sin and
+// cos of Math class and Float#**. see math_fast.c
+#if !defined(MRBC_USE_MATH_FAST)
+#define MRBC_USE_MATH_FAST 0
+#endif
+#if !defined(MRBC_MATH_FAST_DIGITS)
+#define MRBC_MATH_FAST_DIGITS 4	// relative precision 1e-N, N = 3..6
+#endif
+
 // USE String. Support String class.
 #if !defined(MRBC_USE_STRING)
 #define MRBC_USE_STRING 1
 #endif
 
 
+// Use Benchmark class. see c_benchmark.c
+#if !defined(MRBC_USE_BENCHMARK)
+#define MRBC_USE_BENCHMARK 0
+#endif
+
+// Use Serial class, and its ring buffers. see c_serial.c
+#if !defined(MRBC_USE_SERIAL)
+#define MRBC_USE_SERIAL 0
+#endif
+#if !defined(MRBC_SERIAL_MAX_PORTS)
+#define MRBC_SERIAL_MAX_PORTS 2
+#endif
+#if !defined(MRBC_SERIAL_BUFFER_SIZE)
+#define MRBC_SERIAL_BUFFER_SIZE 256	// power of 2
+#endif
+
+// Use I2C and SPI class. see c_bus.c
+#if !defined(MRBC_USE_BUS)
+#define MRBC_USE_BUS 0
+#endif
+#if !defined(MRBC_BUS_MAX)
+#define MRBC_BUS_MAX 4			// number of buses.
+#endif
+#if !defined(MRBC_BUS_QUEUE_SIZE)
+#define MRBC_BUS_QUEUE_SIZE 8		// transfers in progress or queued.
+#endif
+#if !defined(MRBC_BUS_TIMEOUT_MS)
+#define MRBC_BUS_TIMEOUT_MS 100
+#endif
+
+// Print an interpolated string given to puts/print piece by piece,
+// without building it. see stream_to_console() in vm.c
+#if !defined(MRBC_USE_CONSOLE_STREAM)
+#define MRBC_USE_CONSOLE_STREAM 0
+#endif
+
+// Cache method lookup of each call site (OP_SEND, OP_SUPER). see vm.c
+#if !defined(MRBC_USE_METHOD_CACHE)
+#define MRBC_USE_METHOD_CACHE 0
+#endif
+#if !defined(MRBC_METHOD_CACHE_SIZE)
+#define MRBC_METHOD_CACHE_SIZE 64	// power of 2
+#endif
+
+// Use GPIO class, and its edge event ring buffer. see c_gpio.c
+#if !defined(MRBC_USE_GPIO)
+#define MRBC_USE_GPIO 0
+#endif
+#if !defined(MRBC_GPIO_MAX_PINS)
+#define MRBC_GPIO_MAX_PINS 8
+#endif
+#if !defined(MRBC_GPIO_EVENT_BUFFER_SIZE)
+#define MRBC_GPIO_EVENT_BUFFER_SIZE 64	// power of 2
+#endif
+
+// Use ADC class, the multi-channel scanner. see c_adc.c
+#if !defined(MRBC_USE_ADC)
+#define MRBC_USE_ADC 0
+#endif
+#if !defined(MRBC_ADC_MAX_CHANNELS)
+#define MRBC_ADC_MAX_CHANNELS 8
+#endif
+
+// Use per-task scratch arena, opened by VM.scratch. see alloc.c
+#if !defined(MRBC_USE_SCRATCH)
+#define MRBC_USE_SCRATCH 0
+#endif
+#if !defined(MRBC_SCRATCH_SIZE)
+#define MRBC_SCRATCH_SIZE 1024	// default bytes, both halves.
+#endif
+
+// Use earliest deadline first order for Task.periodic tasks. see rrt0.c
+#if !defined(MRBC_USE_EDF)
+#define MRBC_USE_EDF 0
+#endif
+
+// Use health record of heap, tasks and symbols, VM.health. see health.h
+#if !defined(MRBC_USE_HEALTH)
+#define MRBC_USE_HEALTH 0
+#endif
+
+// Use per-method profiler. see profile.h
+#if !defined(MRBC_USE_PROFILE)
+#define MRBC_USE_PROFILE 0
+#endif
+
+// Use event trace. see trace.h
+#if !defined(MRBC_USE_TRACE)
+#define MRBC_USE_TRACE 0
+#endif
+
+
 /* Hardware dependent flags */
 
 /* Endian
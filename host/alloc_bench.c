@@ -0,0 +1,491 @@
+/*! @file
+  @brief
+  Allocator fragmentation and throughput benchmark.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Replay synthetic and recorded allocation traces against alloc.c,
+  for each pool size, and report ops/sec, worst latency,
+  fragmentation (mrbc_alloc_statistics) and the largest free block.
+
+  usage: alloc_bench [-n ops] [-p size,size,...] [-s] [trace ...]
+    -n	number of operations of each synthetic scenario.
+    -p	pool sizes. (max 65535 with MRBC_ALLOC_16BIT)
+    -s	print the statistics every 1/16 of the run.
+    trace
+	text file, one operation per line.
+	  a <id> <size> [vm_id]	allocate
+	  r <id> <size>		reallocate
+	  f <id>		free
+	  x <vm_id>		free all blocks of the vm (mrbc_free_all)
+	or binary trace recorded with VM.trace_start(0) (see trace.c),
+	ALLOC/FREE events are replayed with the pool offset as id.
+  </pre>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "mrubyc.h"
+#include "trace.h"
+
+#define MAX_IDS 65536
+#define N_VMS 4
+
+
+//================================================================
+/*! result of a scenario.
+*/
+typedef struct BENCH_STAT {
+  uint32_t ops;
+  uint32_t fails;
+  uint64_t total_ns;
+  uint32_t worst_ns;
+  const char *worst_op;
+  int max_frag;
+  int min_largest;
+  int used, frag, largest;	//!< at the end.
+} bench_stat;
+
+static bench_stat stat_;
+static int flag_series_;
+static uint32_t series_interval_;
+static struct VM vms_[N_VMS + 1];	// vms_[0] is not used.
+static uint32_t rand_state_ = 2463534242;
+
+
+
+//================================================================
+/*! xorshift32
+*/
+static uint32_t rnd(uint32_t n)
+{
+  rand_state_ ^= rand_state_ << 13;
+  rand_state_ ^= rand_state_ >> 17;
+  rand_state_ ^= rand_state_ << 5;
+  return rand_state_ % n;
+}
+
+
+//================================================================
+/*! time in nano seconds.
+*/
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+//================================================================
+/*! take the pool statistics.
+*/
+static void sample(void)
+{
+  int total, used, free, frag;
+
+  mrbc_alloc_statistics( &total, &used, &free, &frag );
+  int largest = mrbc_alloc_largest_free();
+
+  if( stat_.max_frag < frag ) stat_.max_frag = frag;
+  if( stat_.min_largest > largest ) stat_.min_largest = largest;
+  stat_.used = used;
+  stat_.frag = frag;
+  stat_.largest = largest;
+
+  if( flag_series_ ) {
+    fprintf(stderr, "  %9u ops  used:%6d  frag:%4d  largest:%6d\n",
+	    stat_.ops, used, frag, largest);
+  }
+}
+
+
+//================================================================
+/*! account an operation.
+*/
+static void account(const char *op, uint64_t t0, int fail)
+{
+  uint32_t ns = now_ns() - t0;
+
+  stat_.ops++;
+  stat_.total_ns += ns;
+  if( stat_.worst_ns < ns ) {
+    stat_.worst_ns = ns;
+    stat_.worst_op = op;
+  }
+  if( fail ) stat_.fails++;
+  if( series_interval_ && stat_.ops % series_interval_ == 0 ) sample();
+}
+
+
+//================================================================
+/*! timed operations.
+*/
+static void *t_alloc(struct VM *vm, unsigned int size)
+{
+  uint64_t t0 = now_ns();
+  void *p = vm ? mrbc_alloc(vm, size) : mrbc_raw_alloc(size);
+  account("alloc", t0, p == NULL);
+  return p;
+}
+
+static void *t_realloc(void *ptr, unsigned int size)
+{
+  uint64_t t0 = now_ns();
+  void *p = mrbc_raw_realloc(ptr, size);
+  account("realloc", t0, p == NULL);
+  return p;
+}
+
+static void t_free(void *ptr)
+{
+  uint64_t t0 = now_ns();
+  mrbc_raw_free(ptr);
+  account("free", t0, 0);
+}
+
+static void t_free_all(struct VM *vm)
+{
+  uint64_t t0 = now_ns();
+  mrbc_free_all(vm);
+  account("free_all", t0, 0);
+}
+
+
+//================================================================
+/*! string build / free churn.
+  keep 32 strings, append random pieces or replace them.
+*/
+static void scenario_string(int n_ops)
+{
+  mrbc_value str[32];
+  char piece[64];
+  int i;
+
+  memset( str, 0, sizeof(str) );
+  memset( piece, 'x', sizeof(piece) - 1 );
+  piece[sizeof(piece) - 1] = '\0';
+
+  while( stat_.ops < n_ops ) {
+    mrbc_value *s = &str[ rnd(32) ];
+    uint64_t t0 = now_ns();
+
+    if( s->tt == MRBC_TT_STRING && rnd(4) != 0 ) {
+      int ret = mrbc_string_append_cstr( s, piece + rnd(48) );
+      account("string_append", t0, ret != 0);
+      if( ret != 0 || s->string->size > 1000 ) {
+	mrbc_string_delete( s );
+	s->tt = MRBC_TT_EMPTY;
+      }
+      continue;
+    }
+
+    if( s->tt == MRBC_TT_STRING ) {
+      mrbc_string_delete( s );
+      account("string_delete", t0, 0);
+      t0 = now_ns();
+    }
+    *s = mrbc_string_new( &vms_[1], piece, 1 + rnd(32) );
+    account("string_new", t0, s->tt != MRBC_TT_STRING || s->string == NULL);
+    if( s->string == NULL ) s->tt = MRBC_TT_EMPTY;
+  }
+
+  for( i = 0; i < 32; i++ ) {
+    if( str[i].tt == MRBC_TT_STRING ) mrbc_string_delete( &str[i] );
+  }
+}
+
+
+//================================================================
+/*! array growth by mrbc_array_resize, with small objects between.
+*/
+static void scenario_array(int n_ops)
+{
+  mrbc_value ary[16];
+  int limit[16];
+  void *obj[64];
+  int i;
+
+  memset( ary, 0, sizeof(ary) );
+  memset( obj, 0, sizeof(obj) );
+
+  while( stat_.ops < n_ops ) {
+    // small object churn.
+    void **o = &obj[ rnd(64) ];
+    if( *o ) t_free( *o );
+    *o = t_alloc( &vms_[1], 8 + rnd(24) );
+
+    // array growth.
+    i = rnd(16);
+    mrbc_value *a = &ary[i];
+    if( a->tt != MRBC_TT_ARRAY ) {
+      uint64_t t0 = now_ns();
+      *a = mrbc_array_new( &vms_[1], rnd(4) );
+      account("array_new", t0, a->array == NULL);
+      if( a->array == NULL ) { a->tt = MRBC_TT_EMPTY; continue; }
+      limit[i] = 16 + rnd(112);
+      continue;
+    }
+
+    int size = a->array->data_size;
+    if( size >= limit[i] || rnd(64) == 0 ) {
+      uint64_t t0 = now_ns();
+      mrbc_array_delete( a );
+      account("array_delete", t0, 0);
+      a->tt = MRBC_TT_EMPTY;
+      continue;
+    }
+
+    uint64_t t0 = now_ns();
+    int ret = mrbc_array_resize( a, rnd(2) ? size + 1 : size * 2 + 1 );
+    account("array_resize", t0, ret != 0);
+    if( ret != 0 ) {
+      mrbc_array_delete( a );
+      a->tt = MRBC_TT_EMPTY;
+    }
+  }
+
+  for( i = 0; i < 16; i++ ) {
+    if( ary[i].tt == MRBC_TT_ARRAY ) mrbc_array_delete( &ary[i] );
+  }
+  for( i = 0; i < 64; i++ ) {
+    if( obj[i] ) mrbc_raw_free( obj[i] );
+  }
+}
+
+
+//================================================================
+/*! task create / destroy.
+  each task allocates blocks, and sometimes ends by mrbc_free_all.
+*/
+static void scenario_task(int n_ops)
+{
+  void *blk[N_VMS + 1][64];
+  int n_blk[N_VMS + 1];
+  int i;
+
+  memset( n_blk, 0, sizeof(n_blk) );
+
+  while( stat_.ops < n_ops ) {
+    int id = 1 + rnd(N_VMS);
+
+    if( n_blk[id] == 64 || rnd(128) == 0 ) {
+      t_free_all( &vms_[id] );
+      n_blk[id] = 0;
+      continue;
+    }
+
+    if( n_blk[id] > 0 && rnd(3) == 0 ) {
+      int k = rnd( n_blk[id] );
+      t_free( blk[id][k] );
+      blk[id][k] = blk[id][ --n_blk[id] ];
+      continue;
+    }
+
+    void *p = t_alloc( &vms_[id], rnd(16) ? 8 + rnd(120) : 256 + rnd(768) );
+    if( p ) blk[id][ n_blk[id]++ ] = p;
+  }
+
+  for( i = 1; i <= N_VMS; i++ ) mrbc_free_all( &vms_[i] );
+}
+
+
+//================================================================
+/*! replay recorded trace.
+
+  @param  fp	trace file.
+  @return	zero if no error.
+*/
+static int scenario_replay(FILE *fp)
+{
+  static void *ids[MAX_IDS];
+  char line[256];
+  int i;
+
+  memset( ids, 0, sizeof(ids) );
+
+  if( fread( line, 1, 8, fp ) == 8 && memcmp( line, "MRBCTRC1", 8 ) == 0 ) {
+    // binary trace.
+    uint8_t buf[16];
+    if( fread( buf, 1, 8, fp ) != 8 ) return -1;
+    uint32_t n = bin_to_uint32( buf );
+
+    while( n-- > 0 ) {
+      if( fread( buf, 1, 16, fp ) != 16 ) return -1;
+      uint32_t size = bin_to_uint32( buf+8 );
+      uint32_t id = bin_to_uint32( buf+12 ) % MAX_IDS;
+
+      switch( buf[4] ) {
+      case MRBC_TRACE_ALLOC:
+	if( ids[id] ) t_free( ids[id] );
+	ids[id] = t_alloc( NULL, size - mrbc_alloc_header_size() );
+	break;
+      case MRBC_TRACE_FREE:
+	if( ids[id] ) t_free( ids[id] );
+	ids[id] = NULL;
+	break;
+      }
+    }
+
+  } else {
+    // text trace.
+    rewind( fp );
+    while( fgets( line, sizeof(line), fp ) ) {
+      unsigned int id = 0, size = 0, vm_id = 0;
+      char op = 0;
+
+      if( sscanf( line, " %c %u %u %u", &op, &id, &size, &vm_id ) < 2 ) continue;
+      id %= MAX_IDS;
+      if( vm_id > N_VMS ) vm_id = 0;
+
+      switch( op ) {
+      case 'a':
+	if( ids[id] ) t_free( ids[id] );
+	ids[id] = t_alloc( vm_id ? &vms_[vm_id] : NULL, size );
+	break;
+
+      case 'r':
+	if( ids[id] ) {
+	  void *p = t_realloc( ids[id], size );
+	  if( p ) ids[id] = p;
+	} else {
+	  ids[id] = t_alloc( NULL, size );
+	}
+	break;
+
+      case 'f':
+	if( ids[id] ) t_free( ids[id] );
+	ids[id] = NULL;
+	break;
+
+      case 'x':
+	if( id < 1 || id > N_VMS ) break;
+	for( i = 0; i < MAX_IDS; i++ ) {
+	  if( ids[i] && mrbc_get_vm_id( ids[i] ) == id ) ids[i] = NULL;
+	}
+	t_free_all( &vms_[id] );
+	break;
+      }
+    }
+  }
+
+  for( i = 0; i < MAX_IDS; i++ ) {
+    if( ids[i] ) mrbc_raw_free( ids[i] );
+  }
+  return 0;
+}
+
+
+//================================================================
+/*! print result.
+*/
+static void print_stat(int pool_size, const char *name)
+{
+  double sec = stat_.total_ns / 1e9;
+
+  printf("%6d %-16s %9u %6u %8.2f %9.1f %-14s %5d %8d %8d\n",
+	 pool_size, name, stat_.ops, stat_.fails,
+	 sec > 0 ? stat_.ops / sec / 1e6 : 0.0,
+	 stat_.worst_ns / 1e3, stat_.worst_op ? stat_.worst_op : "-",
+	 stat_.max_frag, stat_.min_largest, stat_.largest);
+  fflush(stdout);
+}
+
+
+//================================================================
+/*! run one scenario on a fresh pool.
+*/
+static void run(uint8_t *pool, int pool_size, const char *name,
+		void (*func)(int), FILE *fp, int n_ops)
+{
+  int saved_stdout = dup(1);
+  int null = open("/dev/null", O_WRONLY);
+  int i;
+
+  mrbc_cleanup_alloc();
+  mrbc_init_alloc( pool, pool_size );
+  for( i = 1; i <= N_VMS; i++ ) vms_[i].vm_id = i;
+
+  memset( &stat_, 0, sizeof(stat_) );
+  stat_.min_largest = pool_size;
+  series_interval_ = flag_series_ ? (n_ops / 16 + 1) : 4096;
+  if( flag_series_ ) fprintf(stderr, "%d %s\n", pool_size, name);
+
+  // suppress "Out of memory." messages from alloc.c
+  fflush(stdout);
+  dup2( null, 1 );
+  if( func ) func( n_ops ); else scenario_replay( fp );
+  sample();
+  dup2( saved_stdout, 1 );
+  close( null );
+  close( saved_stdout );
+
+  print_stat( pool_size, name );
+}
+
+
+int main(int argc, char *argv[])
+{
+  int pool_sizes[16] = { 8*1024, 16*1024, 40*1024, 60*1024 };
+  int n_pool_sizes = 4;
+  int n_ops = 1000000;
+  int opt, i, j;
+
+  while( (opt = getopt(argc, argv, "n:p:s")) != -1 ) {
+    switch( opt ) {
+    case 'n':
+      n_ops = atoi(optarg);
+      break;
+    case 'p': {
+      char *s = optarg;
+      for( n_pool_sizes = 0; n_pool_sizes < 16 && *s; n_pool_sizes++ ) {
+	pool_sizes[n_pool_sizes] = strtol(s, &s, 0);
+	if( *s == ',' ) s++;
+      }
+    } break;
+    case 's':
+      flag_series_ = 1;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n ops] [-p size,...] [-s] [trace ...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  printf("%6s %-16s %9s %6s %8s %9s %-14s %5s %8s %8s\n",
+	 "pool", "scenario", "ops", "fail", "Mops/s", "worst(us)", "(op)",
+	 "frag", "largest", "(end)");
+
+  for( i = 0; i < n_pool_sizes; i++ ) {
+    int size = pool_sizes[i];
+    uint8_t *pool = malloc( size );
+    if( !pool ) return 1;
+
+    run( pool, size, "string", scenario_string, NULL, n_ops );
+    run( pool, size, "array", scenario_array, NULL, n_ops );
+    run( pool, size, "task", scenario_task, NULL, n_ops );
+
+    for( j = optind; j < argc; j++ ) {
+      FILE *fp = fopen( argv[j], "rb" );
+      if( !fp ) {
+	perror( argv[j] );
+	continue;
+      }
+      const char *name = strrchr( argv[j], '/' );
+      run( pool, size, name ? name + 1 : argv[j], NULL, fp, 0 );
+      fclose( fp );
+    }
+    free( pool );
+  }
+
+  return 0;
+}
@@ -0,0 +1,136 @@
+/*! @file
+  @brief
+  I2C and SPI class test, on simulated devices.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  bus_test_task.rb transfers with devices scripted by hal_bus_sim_attach()
+  (I2C bus 0, SPI bus 1), and with the asynchronous backend below,
+  set by mrbc_bus_set_backend() (I2C bus 1).
+  bus_test_irq.rb completes the asynchronous transfers, as an
+  interrupt handler does, while bus_test_task.rb is blocked.
+
+  usage: bus_test	exit status is the number of failures.
+  </pre>
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mrubyc.h"
+#include "bus_test_task.h"
+#include "bus_test_irq.h"
+
+#if !MRBC_USE_BUS
+#error "bus_test needs MRBC_USE_BUS=1"
+#endif
+
+// asynchronous device that answers later than the timeout.
+#define SLOW_ADDR	0x21
+#define SLOW_MS		50
+
+static mrbc_bus_xfer *active_;
+static uint32_t active_us_;
+static int flag_done_;
+static int n_checks_;
+static int n_failures_;
+
+
+//================================================================
+/*! asynchronous backend, open.
+*/
+static int async_open(int type, int bus, int addr, uint32_t freq, int mode)
+{
+  return 0;
+}
+
+
+//================================================================
+/*! asynchronous backend, start. completed by bus_test_complete.
+*/
+static int async_start(mrbc_bus_xfer *x)
+{
+  active_ = x;
+  active_us_ = hal_micros();
+  return 0;
+}
+
+static const mrbc_bus_backend async_backend_ = { async_open, async_start };
+
+
+//================================================================
+/*! (method) bus_test_complete
+
+  complete the active transfer, rx is 0xa0, 0xa1, ...
+  returns false when the test is over.
+*/
+static void c_bus_test_complete(struct VM *vm, mrbc_value v[], int argc)
+{
+  mrbc_bus_xfer *x = active_;
+
+  if( x && (x->addr != SLOW_ADDR ||
+	    hal_micros() - active_us_ >= SLOW_MS * 1000) ) {
+    int i;
+    for( i = 0; i < x->rx_len; i++ ) x->rx[i] = 0xa0 + i;
+    active_ = NULL;
+    mrbc_bus_complete( x, x->tx_len + x->rx_len );
+  }
+
+  if( flag_done_ && !active_ ) {
+    SET_FALSE_RETURN();
+  } else {
+    SET_TRUE_RETURN();
+  }
+}
+
+
+//================================================================
+/*! (method) check(name, result)
+*/
+static void c_check(struct VM *vm, mrbc_value v[], int argc)
+{
+  int ok = (argc >= 2 && v[2].tt != MRBC_TT_FALSE && v[2].tt != MRBC_TT_NIL);
+
+  n_checks_++;
+  if( !ok ) n_failures_++;
+  console_printf("%-32s %s\n",
+		 GET_TT_ARG(1) == MRBC_TT_STRING ? mrbc_string_cstr(&v[1]) : "?",
+		 ok ? "ok" : "NG");
+}
+
+
+//================================================================
+/*! (method) bus_test_done
+*/
+static void c_bus_test_done(struct VM *vm, mrbc_value v[], int argc)
+{
+  flag_done_ = 1;
+}
+
+
+#define MEMORY_SIZE (1024*40)
+static uint8_t memory_pool[MEMORY_SIZE];
+
+int main(int argc, char *argv[])
+{
+  hal_bus_sim_attach( MRBC_BUS_I2C, 0, 0x76, "# BME280\nreg 0xd0 60\n" );
+  hal_bus_sim_attach( MRBC_BUS_I2C, 0, 0x61, "# SCD30\non 02 02 -> 03 42\n" );
+  hal_bus_sim_attach( MRBC_BUS_SPI, 1, 5, "reg 0x50 aa bb\n" );
+
+  mrbc_init( memory_pool, MEMORY_SIZE );
+  mrbc_bus_set_backend( MRBC_BUS_I2C, 1, &async_backend_ );
+  mrbc_define_method(0, mrbc_class_object, "check", c_check);
+  mrbc_define_method(0, mrbc_class_object, "bus_test_complete", c_bus_test_complete);
+  mrbc_define_method(0, mrbc_class_object, "bus_test_done", c_bus_test_done);
+
+  mrbc_create_task( bus_test_task, 0 );
+  mrbc_create_task( bus_test_irq, 0 );
+  mrbc_run();
+
+  console_printf("\nbus_test: %d checks, %d failures\n", n_checks_, n_failures_);
+  return n_failures_;
+}
@@ -0,0 +1,7 @@
+#
+# Completes the transfers of the asynchronous backend, as an
+# interrupt handler does. (see bus_test.c)
+#
+while bus_test_complete
+  sleep_ms 2
+end
@@ -0,0 +1,27 @@
+#
+# I2C and SPI class test. (see bus_test.c)
+#
+buf = ""
+
+i2c = I2C.new(0)
+check "I2C#write_read", i2c.write_read(0x76, "\xD0", buf, 1) == "\x60"
+check "I2C#write", i2c.write(0x76, "\xF4\x27") == 2
+check "I2C#write_read written", i2c.write_read(0x76, "\xF4", buf, 1) == "\x27"
+check "I2C#write command", i2c.write(0x61, "\x02\x02") == 2
+check "I2C#read response", i2c.read(0x61, buf, 2) == "\x03\x42"
+check "I2C#read NACK", i2c.read(0x10, buf, 1) == nil
+
+spi = SPI.new(1, 5)
+check "SPI#write_read", spi.write_read("\xD0", buf, 2) == "\xAA\xBB"
+check "SPI#transfer", spi.transfer("\x50\x11\x22", buf) == "\xFF\xAA\xBB"
+check "SPI#write_read written", spi.write_read("\xD0", buf, 2) == "\x11\x22"
+
+# completed by bus_test_irq.rb
+async = I2C.new(1)
+check "async I2C#write_read", async.write_read(0x20, "\x01", buf, 2) == "\xA0\xA1"
+async.timeout = 20
+check "async I2C#read timeout", async.read(0x21, buf, 1) == nil
+async.timeout = 100
+check "async I2C#read after timeout", async.read(0x20, buf, 3) == "\xA0\xA1\xA2"
+
+bus_test_done
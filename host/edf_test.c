@@ -0,0 +1,112 @@
+/*! @file
+  @brief
+  Earliest deadline first order of Task.periodic, and deadline misses.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  edf_test_long.rb and edf_test_short.rb are released together every
+  20 ms, with deadlines of 20 ms and 5 ms. edf_test_long.rb goes to
+  sleep first each period, so it would run first in FIFO order.
+  The jobs are light for 5 periods, then overloaded for 5 periods,
+  where every job finishes after its deadline, and some releases are
+  skipped.
+
+  usage: edf_test	exit status is the number of failures.
+  </pre>
+*/
+
+#include <stdio.h>
+
+#include "mrubyc.h"
+#include "edf_test_long.h"
+#include "edf_test_short.h"
+
+#if !MRBC_USE_EDF
+#error "edf_test needs MRBC_USE_EDF=1"
+#endif
+
+#define MAX_JOBS 32
+
+static uint8_t jobs_[MAX_JOBS];		// task id, in the order of start.
+static int n_jobs_;
+static int n_checks_;
+static int n_failures_;
+
+
+//================================================================
+/*! (method) edf_test_job(id, ms)
+
+  a job, busy for ms without giving up the CPU.
+  ms is counted in ticks, same as the deadlines. (a lost SIGALRM
+  makes hal_micros() run ahead of the tick)
+*/
+static void c_edf_test_job(struct VM *vm, mrbc_value v[], int argc)
+{
+  uint32_t start = mrbc_current_runtime->tick;
+
+  if( n_jobs_ < MAX_JOBS ) jobs_[n_jobs_++] = GET_INT_ARG(1);
+  while( mrbc_current_runtime->tick - start < GET_INT_ARG(2) ) {
+  }
+}
+
+
+//================================================================
+/*! (method) edf_test_order(n)
+
+  returns true if the first n jobs were short (1), long (0), ...
+*/
+static void c_edf_test_order(struct VM *vm, mrbc_value v[], int argc)
+{
+  int n = GET_INT_ARG(1);
+  int i;
+
+  if( n > n_jobs_ ) {
+    SET_FALSE_RETURN();
+    return;
+  }
+  for( i = 0; i < n; i++ ) {
+    if( jobs_[i] != !(i & 1) ) {
+      SET_FALSE_RETURN();
+      return;
+    }
+  }
+  SET_TRUE_RETURN();
+}
+
+
+//================================================================
+/*! (method) check(name, result)
+*/
+static void c_check(struct VM *vm, mrbc_value v[], int argc)
+{
+  int ok = (argc >= 2 && v[2].tt != MRBC_TT_FALSE && v[2].tt != MRBC_TT_NIL);
+
+  n_checks_++;
+  if( !ok ) n_failures_++;
+  console_printf("%-32s %s\n",
+		 GET_TT_ARG(1) == MRBC_TT_STRING ? mrbc_string_cstr(&v[1]) : "?",
+		 ok ? "ok" : "NG");
+}
+
+
+#define MEMORY_SIZE (1024*40)
+static uint8_t memory_pool[MEMORY_SIZE];
+
+int main(int argc, char *argv[])
+{
+  mrbc_init( memory_pool, MEMORY_SIZE );
+  mrbc_define_method(0, mrbc_class_object, "check", c_check);
+  mrbc_define_method(0, mrbc_class_object, "edf_test_job", c_edf_test_job);
+  mrbc_define_method(0, mrbc_class_object, "edf_test_order", c_edf_test_order);
+
+  mrbc_create_task( edf_test_long, 0 );
+  mrbc_create_task( edf_test_short, 0 );
+  mrbc_run();
+
+  console_printf("\nedf_test: %d checks, %d failures\n", n_checks_, n_failures_);
+  return n_failures_;
+}
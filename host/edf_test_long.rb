@@ -0,0 +1,19 @@
+#
+# EDF test, the task of long deadline. (see edf_test.c)
+#
+Task.periodic(20)
+Task.periodic(20)		# released with edf_test_short.rb
+
+5.times do
+  edf_test_job 0, 5
+  check "long deadline met", Task.periodic(20)
+end
+5.times do
+  edf_test_job 0, 15		# overload, 10 + 15 ms a period.
+  Task.periodic(20)
+end
+
+st = Task.stats
+check "long jobs", st[:jobs] == 11
+check "long misses", st[:misses] >= 5	# and skipped releases.
+check "EDF order", edf_test_order(16)	# until a release is skipped.
@@ -0,0 +1,18 @@
+#
+# EDF test, the task of short deadline. (see edf_test.c)
+#
+Task.periodic(20, 5)
+Task.periodic(20, 5)		# released with edf_test_long.rb
+
+5.times do
+  edf_test_job 1, 1
+  check "short deadline met", Task.periodic(20, 5)
+end
+5.times do
+  edf_test_job 1, 10		# over the deadline.
+  Task.periodic(20, 5)
+end
+
+st = Task.stats
+check "short jobs", st[:jobs] == 11
+check "short misses", st[:misses] >= 5
@@ -0,0 +1,574 @@
+/*! @file
+  @brief
+  Device fleet simulator, to load the ingestion server (server/app.rb).
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Run N simulated devices, each one is a thread with its own runtime
+  (see runtime.h) executing the tasks of main/main.c. (mrblib/models
+  and mrblib/loops) Sensors give synthetic signals, daily cycle of CO2
+  and temperature, and "DATASEND:..." and "HEALTH:..." lines of puts
+  are posted to POST /data and POST /health of the server over HTTP.
+
+  The devices run on virtual time. (MRBC_VIRTUAL_TIME, see hal_posix)
+  When all tasks are sleeping, the clock jumps to the next wakeup,
+  at most speed times faster than wall clock.
+
+  usage: fleet_sim [-n devices] [-t hours] [-x speed] [-s host:port] [-d]
+    -n	number of devices. (default 100)
+    -t	virtual time to run, in hours. (default 24)
+    -x	speed of virtual time, 0 is as fast as possible. (default 0)
+    -s	server address. (default 127.0.0.1:4567)
+    -d	dry run, do not post. (to measure the VM only)
+
+  (e.g.)
+    (cd ../server; ruby app.rb)
+    make fleet_sim && build/fleet_sim -n 500 -t 24 -x 3600
+
+  reports throughput and latency percentiles of the posts,
+  and CPU time of the VM (excluding HTTP and pacing) per device-hour.
+  </pre>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "mrubyc.h"
+#include "sensors.h"
+
+#include "models/thermistor.h"
+#include "models/led.h"
+#include "models/co2.h"
+#include "loops/primary.h"
+#include "loops/secondary.h"
+
+#if !defined(MRBC_VIRTUAL_TIME) || !defined(MRBC_NO_TIMER)
+#error "fleet_sim needs MRBC_VIRTUAL_TIME and MRBC_NO_TIMER"
+#endif
+
+#define MEMORY_SIZE (1024*40)	// same as main/main.c
+#define STACK_SIZE (256*1024)
+#define HTTP_TIMEOUT_SEC 5
+
+// thermistor circuit. (see main/sensors.c)
+#define THERM_B 3435
+#define THERM_T0 25
+#define THERM_V 3300
+#define THERM_RREF 10000
+
+
+//================================================================
+/*! simulated device.
+*/
+typedef struct DEVICE {
+  int id;
+  pthread_t thread;
+  jmp_buf finish;
+  uint32_t seed;
+
+  // synthetic signals.
+  double co2_base;	//!< ppm at night.
+  double co2_peak;	//!< ppm added in office hours.
+  double temp_base;	//!< degree C.
+  int co2_ppm;		//!< response of the "read CO2" command.
+
+  // results.
+  uint32_t posts;
+  uint32_t health;	//!< health records in posts.
+  uint32_t errors;
+  uint32_t *latency;	//!< micro sec. of each post.
+  int n_latency;
+  int capa_latency;
+  uint64_t cpu_ns;	//!< thread CPU time.
+  uint64_t host_cpu_ns;	//!< thread CPU time out of the VM. (http, pacing)
+  int failed;		//!< could not start tasks.
+
+  mrbc_runtime rt;
+  uint8_t memory_pool[MEMORY_SIZE];
+} device;
+
+static __thread device *dev_;
+static device *devices_;
+
+static int n_devices_ = 100;
+static double hours_ = 24;
+static double speed_ = 0;
+static int dry_run_;
+static const char *server_ = "127.0.0.1:4567";
+static struct addrinfo *server_addr_;
+static uint32_t end_tick_;
+static struct timespec start_;
+
+
+
+//================================================================
+/*! nano seconds of clock.
+*/
+static uint64_t clock_ns(clockid_t id)
+{
+  struct timespec ts;
+  clock_gettime(id, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+//================================================================
+/*! random number. (xorshift32)
+*/
+static uint32_t rand32(uint32_t *seed)
+{
+  uint32_t x = *seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *seed = x;
+}
+
+
+//================================================================
+/*! uniform random number in [lo, hi).
+*/
+static double uniform(uint32_t *seed, double lo, double hi)
+{
+  return lo + (hi - lo) * (rand32(seed) / 4294967296.0);
+}
+
+
+//================================================================
+/*! hour of the day, in virtual time.
+*/
+static double hour_of_day(void)
+{
+  return fmod( mrbc_current_runtime->tick / 3600000.0, 24.0 );
+}
+
+
+//================================================================
+/*! synthetic CO2 concentration (ppm)
+  people come in at 9:00 and leave at 18:00.
+*/
+static int synthetic_co2(device *d)
+{
+  double h = hour_of_day();
+  double ppm = d->co2_base;
+
+  if( h >= 9 && h < 18 ) ppm += d->co2_peak * sin( M_PI * (h - 9) / 9 );
+  ppm += uniform( &d->seed, -20, 20 );
+
+  return ppm < 0 ? 0 : (int)ppm;
+}
+
+
+//================================================================
+/*! synthetic ADC reading (mV) of the thermistor.
+  the temperature is lowest at 6:00, highest at 18:00.
+*/
+static int synthetic_adc(device *d)
+{
+  double h = hour_of_day();
+  double t = d->temp_base - 4 * cos( 2 * M_PI * (h - 6) / 24 );
+  t += uniform( &d->seed, -0.2, 0.2 );
+
+  double r = THERM_RREF * exp( THERM_B * (1 / (t + 273) - 1.0 / (THERM_T0 + 273)) );
+  return (int)(THERM_V * THERM_RREF / (r + THERM_RREF));
+}
+
+
+//================================================================
+/*! POST to the server.
+
+  @param  path	"/data" or "/health"
+  @param  body	form data. (e.g. "co2=500&temperature=21.5")
+  @return	0 if 2xx, or -1.
+*/
+static int http_post(device *d, const char *path, const char *body, int len)
+{
+  char buf[512];
+  int n = snprintf( buf, sizeof(buf),
+		    "POST %s HTTP/1.1\r\n"
+		    "Host: %s\r\n"
+		    "User-Agent: fleet_sim/%d\r\n"
+		    "Content-Type: application/x-www-form-urlencoded\r\n"
+		    "Content-Length: %d\r\n"
+		    "Connection: close\r\n"
+		    "\r\n%.*s", path, server_, d->id, len, len, body );
+  if( n >= sizeof(buf) ) return -1;
+
+  int fd = socket( server_addr_->ai_family, SOCK_STREAM, 0 );
+  if( fd < 0 ) return -1;
+
+  struct timeval tv = { HTTP_TIMEOUT_SEC, 0 };
+  setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv) );
+  setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv) );
+
+  int status = 0;
+  if( connect( fd, server_addr_->ai_addr, server_addr_->ai_addrlen ) == 0 &&
+      write( fd, buf, n ) == n ) {
+    // read the status line, and the rest until the server closes.
+    int pos = 0;
+    while( 1 ) {
+      int r = read( fd, buf + pos, sizeof(buf) - 1 - pos );
+      if( r <= 0 ) break;
+      pos += r;
+      if( pos == sizeof(buf) - 1 ) {
+	buf[pos] = '\0';
+	if( status == 0 ) sscanf( buf, "HTTP/%*s %d", &status );
+	pos = 0;
+      }
+    }
+    buf[pos] = '\0';
+    if( status == 0 ) sscanf( buf, "HTTP/%*s %d", &status );
+  }
+  close( fd );
+
+  return (status >= 200 && status < 300) ? 0 : -1;
+}
+
+
+//================================================================
+/*! post data, and record the latency.
+*/
+static void send_data(device *d, const char *path, const char *data, int len)
+{
+  if( dry_run_ ) {
+    d->posts++;
+    return;
+  }
+
+  uint64_t cpu0 = clock_ns( CLOCK_THREAD_CPUTIME_ID );
+  uint64_t t0 = clock_ns( CLOCK_MONOTONIC );
+  int ret = http_post( d, path, data, len );
+  uint64_t t1 = clock_ns( CLOCK_MONOTONIC );
+  d->host_cpu_ns += clock_ns( CLOCK_THREAD_CPUTIME_ID ) - cpu0;
+
+  if( ret != 0 ) {
+    d->errors++;
+    return;
+  }
+  d->posts++;
+
+  if( d->n_latency == d->capa_latency ) {
+    int capa = d->capa_latency ? d->capa_latency * 2 : 64;
+    uint32_t *p = realloc( d->latency, sizeof(uint32_t) * capa );
+    if( !p ) return;
+    d->latency = p;
+    d->capa_latency = capa;
+  }
+  d->latency[d->n_latency++] = (t1 - t0) / 1000;
+}
+
+
+//================================================================
+/*! (method) puts(*args)
+  post "DATASEND:..." lines to /data, "HEALTH:..." lines to /health,
+  and discard others.
+*/
+static void c_fleet_puts(struct VM *vm, mrbc_value v[], int argc)
+{
+  static const struct {
+    const char *prefix;
+    const char *path;
+    int health;
+  } links[] = {
+    { "DATASEND:", "/data", 0 },
+    { "HEALTH:", "/health", 1 },
+  };
+  int i, j;
+
+  for( i = 1; i <= argc; i++ ) {
+    if( v[i].tt != MRBC_TT_STRING ) continue;
+
+    const char *s = mrbc_string_cstr( &v[i] );
+    int len = mrbc_string_size( &v[i] );
+    for( j = 0; j < sizeof(links) / sizeof(links[0]); j++ ) {
+      int n = strlen( links[j].prefix );
+      if( len > n && memcmp( s, links[j].prefix, n ) == 0 ) {
+	dev_->health += links[j].health;
+	send_data( dev_, links[j].path, s + n, len - n );
+	break;
+      }
+    }
+  }
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! (method) no operation.
+*/
+static void c_fleet_nop(struct VM *vm, mrbc_value v[], int argc)
+{
+  SET_NIL_RETURN();
+}
+
+
+//================================================================
+/*! sensors backend. (see main/sensors.c)
+*/
+static int fleet_co2_request(void)
+{
+  dev_->co2_ppm = synthetic_co2( dev_ );
+  return 9;
+}
+
+static int fleet_co2_receive(uint8_t *buf, int len)
+{
+  int ppm = dev_->co2_ppm;
+  uint8_t res[9] = { 0xff, 0x86, ppm >> 8, ppm & 0xff };
+  int i;
+
+  for( i = 1; i < 8; i++ ) res[8] += res[i];
+  res[8] = 0xff - res[8] + 1;
+
+  // whole response at once, after the request.
+  if( len > sizeof(res) ) len = sizeof(res);
+  memcpy( buf, res + sizeof(res) - len, len );
+  return len;
+}
+
+static int fleet_thermistor_mv(void)
+{
+  return synthetic_adc( dev_ );
+}
+
+static const sensors_backend fleet_sensors_ = {
+  fleet_co2_request, fleet_co2_receive, fleet_thermistor_mv,
+};
+
+
+//================================================================
+/*! idle, jump to the next wakeup. (see hal_posix/hal.h)
+*/
+void hal_idle_cpu(void)
+{
+  mrbc_runtime *rt = mrbc_current_runtime;
+  uint32_t next = end_tick_;
+  mrbc_tcb *tcb;
+
+  for( tcb = rt->q_waiting; tcb != NULL; tcb = tcb->next ) {
+    if( tcb->reason != TASKREASON_SLEEP &&
+	tcb->reason != TASKREASON_CFUNC_TIMEOUT ) continue;
+    if( (int32_t)(tcb->wakeup_tick - rt->tick) > 0 &&
+	(int32_t)(tcb->wakeup_tick - next) < 0 ) next = tcb->wakeup_tick;
+  }
+  if( next == end_tick_ ) longjmp( dev_->finish, 1 );
+
+  if( speed_ > 0 ) {
+    uint64_t cpu0 = clock_ns( CLOCK_THREAD_CPUTIME_ID );
+    uint64_t ns = (uint64_t)start_.tv_sec * 1000000000 + start_.tv_nsec +
+      (uint64_t)(next * 1000000.0 / speed_);
+    struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+    while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) == EINTR )
+      ;
+    dev_->host_cpu_ns += clock_ns( CLOCK_THREAD_CPUTIME_ID ) - cpu0;
+  }
+
+  rt->tick = next - 1;
+  mrbc_tick();
+}
+
+
+//================================================================
+/*! virtual time in micro sec. (see hal_posix/hal.h)
+*/
+uint32_t hal_micros(void)
+{
+  return mrbc_current_runtime->tick * 1000;
+}
+
+
+//================================================================
+/*! device thread.
+*/
+static void *device_main(void *arg)
+{
+  device *d = arg;
+
+  dev_ = d;
+  mrbc_runtime_select( &d->rt );
+  mrbc_init( d->memory_pool, MEMORY_SIZE );
+
+  sensors_define_class();
+  sensors_set_backend( &fleet_sensors_ );
+  mrbc_define_method(0, mrbc_class_object, "puts", c_fleet_puts);
+  mrbc_define_method(0, mrbc_class_object, "debugprint", c_fleet_nop);
+  mrbc_define_method(0, mrbc_class_object, "gpio_init_output", c_fleet_nop);
+  mrbc_define_method(0, mrbc_class_object, "gpio_set_level", c_fleet_nop);
+  mrbc_define_method(0, mrbc_class_object, "init_adc", c_fleet_nop);
+
+  if( !mrbc_create_task( thermistor, 0 ) ||
+      !mrbc_create_task( led, 0 ) ||
+      !mrbc_create_task( co2, 0 ) ||
+      !mrbc_create_task( primary, 0 ) ||
+      !mrbc_create_task( secondary, 0 ) ) {
+    d->failed = 1;
+    return NULL;
+  }
+
+  uint64_t cpu0 = clock_ns( CLOCK_THREAD_CPUTIME_ID );
+  if( setjmp( d->finish ) == 0 ) {
+    mrbc_run();
+    d->failed = 1;		// all tasks ended.
+  }
+  d->cpu_ns = clock_ns( CLOCK_THREAD_CPUTIME_ID ) - cpu0;
+
+  return NULL;
+}
+
+
+//================================================================
+/*! compare function for qsort.
+*/
+static int cmp_uint32(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+
+//================================================================
+/*! print the result.
+*/
+static void report(double wall_sec)
+{
+  uint32_t posts = 0, errors = 0, health = 0;
+  uint64_t vm_ns = 0;
+  int n = 0, running = 0;
+  int i;
+
+  for( i = 0; i < n_devices_; i++ ) {
+    device *d = &devices_[i];
+    if( d->failed ) continue;
+    running++;
+    posts += d->posts;
+    health += d->health;
+    errors += d->errors;
+    vm_ns += d->cpu_ns - d->host_cpu_ns;
+    n += d->n_latency;
+  }
+
+  uint32_t *all = malloc( sizeof(uint32_t) * (n ? n : 1) );
+  n = 0;
+  for( i = 0; i < n_devices_; i++ ) {
+    if( devices_[i].failed ) continue;
+    memcpy( all + n, devices_[i].latency, sizeof(uint32_t) * devices_[i].n_latency );
+    n += devices_[i].n_latency;
+  }
+  qsort( all, n, sizeof(uint32_t), cmp_uint32 );
+
+  printf("\nfleet_sim: %d devices (%d failed), %.1f hours, ",
+	 n_devices_, n_devices_ - running, hours_);
+  if( speed_ > 0 ) printf("x%g\n", speed_); else printf("as fast as possible\n");
+  printf("wall time              %9.2f sec\n", wall_sec);
+  printf("posts                  %9u (%u errors, %u health)%s\n", posts, errors, health,
+	 dry_run_ ? " dry run" : "");
+  printf("throughput             %9.1f posts/sec\n", posts / wall_sec);
+
+  printf("%-22s %9s %7s %7s %7s %7s\n",
+	 "latency (micro sec.)", "n", "p50", "p90", "p99", "max");
+  printf("%-22s %9d", "POST /data, /health", n);
+  if( n == 0 ) {
+    printf("       -       -       -       -\n");
+  } else {
+    printf(" %7u %7u %7u %7u\n", all[ (n - 1) * 50 / 100 ],
+	   all[ (n - 1) * 90 / 100 ], all[ (n - 1) * 99 / 100 ], all[n - 1]);
+  }
+  free( all );
+
+  if( running ) {
+    printf("VM CPU per device-hour %9.3f ms\n",
+	   vm_ns / 1e6 / ((double)running * hours_));
+  }
+}
+
+
+//================================================================
+/*! usage.
+*/
+static void usage(void)
+{
+  fprintf(stderr, "usage: fleet_sim [-n devices] [-t hours] [-x speed] [-s host:port] [-d]\n");
+  exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+  int opt, i;
+
+  while( (opt = getopt(argc, argv, "n:t:x:s:d")) != -1 ) {
+    switch( opt ) {
+    case 'n': n_devices_ = atoi(optarg);	break;
+    case 't': hours_ = atof(optarg);		break;
+    case 'x': speed_ = atof(optarg);		break;
+    case 's': server_ = optarg;			break;
+    case 'd': dry_run_ = 1;			break;
+    default: usage();
+    }
+  }
+  if( n_devices_ <= 0 || hours_ <= 0 || hours_ * 3600000 >= 0x7fffffff ) usage();
+  end_tick_ = (uint32_t)(hours_ * 3600000);
+
+  if( !dry_run_ ) {
+    char host[256];
+    const char *port = strrchr( server_, ':' );
+    if( !port || port - server_ >= sizeof(host) ) usage();
+    memcpy( host, server_, port - server_ );
+    host[port - server_] = '\0';
+
+    struct addrinfo hints = { .ai_socktype = SOCK_STREAM };
+    if( getaddrinfo( host, port + 1, &hints, &server_addr_ ) != 0 ) {
+      fprintf(stderr, "fleet_sim: cannot resolve %s\n", server_);
+      return 1;
+    }
+  }
+
+  devices_ = calloc( n_devices_, sizeof(device) );
+  if( !devices_ ) return 1;
+
+  pthread_attr_t attr;
+  pthread_attr_init( &attr );
+  pthread_attr_setstacksize( &attr, STACK_SIZE );
+
+  clock_gettime( CLOCK_MONOTONIC, &start_ );
+  for( i = 0; i < n_devices_; i++ ) {
+    device *d = &devices_[i];
+    d->id = i;
+    d->seed = 2463534242u + i * 2654435761u;
+    d->co2_base = uniform( &d->seed, 400, 500 );
+    d->co2_peak = uniform( &d->seed, 300, 2000 );
+    d->temp_base = uniform( &d->seed, 18, 24 );
+    if( pthread_create( &d->thread, &attr, device_main, d ) != 0 ) {
+      fprintf(stderr, "fleet_sim: cannot create thread %d\n", i);
+      n_devices_ = i;
+      break;
+    }
+  }
+  for( i = 0; i < n_devices_; i++ ) {
+    pthread_join( devices_[i].thread, NULL );
+  }
+
+  report( (clock_ns( CLOCK_MONOTONIC ) -
+	   ((uint64_t)start_.tv_sec * 1000000000 + start_.tv_nsec)) / 1e9 );
+
+  for( i = 0; i < n_devices_; i++ ) free( devices_[i].latency );
+  free( devices_ );
+  if( server_addr_ ) freeaddrinfo( server_addr_ );
+
+  return 0;
+}
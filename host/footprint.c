@@ -0,0 +1,340 @@
+/*! @file
+  @brief
+  RAM/flash footprint report.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Report the memory cost of the runtime as "key value" lines.
+
+   config.*	vm_config.h parameters.
+   sizeof.*	size of data structures.
+   static.*	static tables in mruby/c objects (or firmware ELF), by nm.
+   heap.*	heap used after mrbc_init and after each mrbc_create_task
+		of the tasks in main/main.c.
+   class.*	number of methods and RAM for RProc, each class.
+   irep.*	number of IREPs, RAM for them, and byte code size, each task.
+   flash.*	size of the linked byte code image. (see tools/link_mrb.rb)
+
+  usage: footprint [-b baseline] [-e elf] [-n nm] [-s min_size]
+    -b	print the difference from a saved output.
+    -e	report static tables from this file. (e.g. build/mrubyc-esp32.elf)
+	(default: build/libmrubyc.a)
+    -n	nm command. (e.g. xtensa-esp32-elf-nm)
+    -s	minimum size of static tables to report. (default 64)
+
+  (e.g.)
+    make footprint && build/footprint > footprint.base
+    (edit vm_config.h)
+    make footprint && build/footprint -b footprint.base
+
+  Build with STRIP_METHODS=1 to see the effect of tools/used_methods.rb.
+
+  NOTE: sizeof and heap are taken on the host, pointers are 64bit
+  on most hosts. Build with FOOTPRINT_CFLAGS=-m32 to get 32bit values.
+  </pre>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mrubyc.h"
+#include "c_range.h"
+
+#include "mrblib_image.h"	// same as main/main.c
+#ifdef STRIP_METHODS
+#include "used_methods.h"
+#endif
+
+#define MEMORY_SIZE (1024*40)	// same as main/main.c
+static uint8_t memory_pool[MEMORY_SIZE];
+
+// tasks in main/main.c, in the same order.
+static const struct {
+  const char *name;
+  const uint8_t *code;
+} tasks[] = {
+  { "thermistor", thermistor },
+  { "led",        led },
+  { "co2",        co2 },
+  { "primary",    primary },
+  { "secondary",  secondary },
+};
+
+#define MAX_ITEMS 512
+static struct {
+  char key[80];
+  long value;
+} items[MAX_ITEMS], baseline[MAX_ITEMS];
+static int n_items, n_baseline;
+
+
+//================================================================
+/*! add an item.
+*/
+static void item(const char *key, long value)
+{
+  if( n_items >= MAX_ITEMS ) return;
+  snprintf( items[n_items].key, sizeof(items[0].key), "%s", key );
+  items[n_items].value = value;
+  n_items++;
+}
+
+#define ITEM_SIZEOF(type) item("sizeof." #type, sizeof(type))
+#define ITEM_CONFIG(name) item("config." #name, name)
+
+
+//================================================================
+/*! heap used.
+*/
+static int heap_used(void)
+{
+  int total, used, free, fragment;
+  mrbc_alloc_statistics( &total, &used, &free, &fragment );
+  return used;
+}
+
+
+//================================================================
+/*! static tables, by nm.
+*/
+static void static_tables(const char *nm, const char *file, int min_size)
+{
+  char cmd[512], line[512];
+  long total_ram = 0, total_rodata = 0;
+
+  snprintf( cmd, sizeof(cmd), "%s -S -t d --size-sort %s 2>/dev/null", nm, file );
+  FILE *fp = popen( cmd, "r" );
+  if( !fp ) return;
+
+  while( fgets( line, sizeof(line), fp ) ) {
+    char addr[64], type, name[256], key[80];
+    long size;
+    if( sscanf( line, "%63s %ld %c %255s", addr, &size, &type, name ) != 4 ) continue;
+
+    switch( type ) {
+    case 'b': case 'B': case 'd': case 'D':
+      total_ram += size;
+      break;
+    case 'r': case 'R':
+      total_rodata += size;
+      break;
+    default:
+      continue;
+    }
+    if( size < min_size ) continue;
+    snprintf( key, sizeof(key), "static.%.72s", name );
+    item( key, size );
+  }
+  pclose( fp );
+
+  item( "static.total_ram", total_ram );
+  item( "static.total_rodata", total_rodata );
+}
+
+
+//================================================================
+/*! methods of a class.
+*/
+static void class_methods(const char *name, mrbc_class *cls)
+{
+  char key[80];
+  int n = 0, bytes = 0;
+  mrbc_proc *proc;
+
+  for( proc = cls->procs; proc != NULL; proc = proc->next ) {
+    n++;
+    bytes += sizeof(mrbc_proc);
+  }
+  snprintf( key, sizeof(key), "class.%s.methods", name );
+  item( key, n );
+  snprintf( key, sizeof(key), "class.%s.bytes", name );
+  item( key, bytes );
+}
+
+
+//================================================================
+/*! all classes, found in global constants.
+*/
+static void classes(void)
+{
+  int sym_id;
+
+  for( sym_id = 0; sym_id < MAX_SYMBOLS_COUNT; sym_id++ ) {
+    const char *name = symid_to_str( sym_id );
+    if( !name ) continue;
+
+    mrbc_value *v = mrbc_get_const( sym_id );
+    if( !v || v->tt != MRBC_TT_CLASS ) continue;
+    class_methods( name, v->cls );
+  }
+}
+
+
+//================================================================
+/*! count IREPs.
+*/
+static void count_irep(mrbc_irep *irep, int *n, int *ram, int *code)
+{
+  int i;
+
+  (*n)++;
+  *ram += sizeof(mrbc_irep) + irep->rlen * sizeof(mrbc_irep *)
+    + irep->plen * (sizeof(mrbc_object *) + sizeof(mrbc_object));
+  *code += irep->ilen;
+
+  for( i = 0; i < irep->rlen; i++ ) {
+    count_irep( irep->reps[i], n, ram, code );
+  }
+}
+
+
+//================================================================
+/*! read baseline.
+*/
+static int read_baseline(const char *filename)
+{
+  FILE *fp = fopen( filename, "r" );
+  char line[256];
+
+  if( !fp ) {
+    perror( filename );
+    return -1;
+  }
+  while( fgets( line, sizeof(line), fp ) && n_baseline < MAX_ITEMS ) {
+    if( sscanf( line, "%79s %ld", baseline[n_baseline].key,
+		&baseline[n_baseline].value ) == 2 ) n_baseline++;
+  }
+  fclose( fp );
+  return 0;
+}
+
+
+//================================================================
+/*! print items. (with the difference from baseline)
+*/
+static void print_items(void)
+{
+  int i, j;
+
+  for( i = 0; i < n_items; i++ ) {
+    if( !n_baseline ) {
+      printf("%-48s %8ld\n", items[i].key, items[i].value);
+      continue;
+    }
+
+    for( j = 0; j < n_baseline; j++ ) {
+      if( strcmp( items[i].key, baseline[j].key ) == 0 ) break;
+    }
+    if( j == n_baseline ) {
+      printf("%-48s %8ld %8s %+8ld\n", items[i].key, items[i].value, "-",
+	     items[i].value);
+    } else if( items[i].value != baseline[j].value ) {
+      printf("%-48s %8ld %8ld %+8ld\n", items[i].key, items[i].value,
+	     baseline[j].value, items[i].value - baseline[j].value);
+    } else {
+      printf("%-48s %8ld\n", items[i].key, items[i].value);
+    }
+    if( j < n_baseline ) baseline[j].key[0] = '\0';
+  }
+
+  // removed items.
+  for( j = 0; j < n_baseline; j++ ) {
+    if( !baseline[j].key[0] ) continue;
+    printf("%-48s %8s %8ld %+8ld\n", baseline[j].key, "-", baseline[j].value,
+	   -baseline[j].value);
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *nm = "nm";
+  const char *file = "build/libmrubyc.a";
+  int min_size = 64;
+  int opt, i;
+
+  while( (opt = getopt(argc, argv, "b:e:n:s:")) != -1 ) {
+    switch( opt ) {
+    case 'b':
+      if( read_baseline( optarg ) != 0 ) return 1;
+      break;
+    case 'e':
+      file = optarg;
+      break;
+    case 'n':
+      nm = optarg;
+      break;
+    case 's':
+      min_size = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-b baseline] [-e elf] [-n nm] [-s min_size]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // config and sizeof
+  ITEM_CONFIG( MAX_VM_COUNT );
+  ITEM_CONFIG( MAX_REGS_SIZE );
+  ITEM_CONFIG( MAX_SYMBOLS_COUNT );
+  item( "config.sizeof_pointer", sizeof(void *) );
+
+  ITEM_SIZEOF( mrbc_tcb );
+  ITEM_SIZEOF( mrbc_vm );
+  ITEM_SIZEOF( mrbc_value );
+  ITEM_SIZEOF( mrbc_callinfo );
+  ITEM_SIZEOF( mrbc_irep );
+  ITEM_SIZEOF( mrbc_class );
+  ITEM_SIZEOF( mrbc_proc );
+  ITEM_SIZEOF( mrbc_instance );
+  ITEM_SIZEOF( mrbc_string );
+  ITEM_SIZEOF( mrbc_array );
+  ITEM_SIZEOF( mrbc_hash );
+  ITEM_SIZEOF( mrbc_range );
+  ITEM_SIZEOF( mrbc_kv_handle );
+  ITEM_SIZEOF( mrbc_mutex );
+
+  // static tables
+  static_tables( nm, file, min_size );
+
+  // heap
+#ifdef STRIP_METHODS
+  mrbc_set_used_methods( used_methods, USED_METHODS_SIZE );
+  item( "config.used_methods", USED_METHODS_SIZE );
+#endif
+  mrbc_init( memory_pool, MEMORY_SIZE );
+  item( "heap.mrbc_init", heap_used() );
+  classes();
+
+  for( i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++ ) {
+    char key[80];
+    int n = 0, ram = 0, code = 0;
+    int used = heap_used();
+
+    mrbc_tcb *tcb = mrbc_create_task( tasks[i].code, 0 );
+    if( !tcb ) return 1;
+
+    snprintf( key, sizeof(key), "heap.task.%s", tasks[i].name );
+    item( key, heap_used() - used );
+
+    count_irep( tcb->vm.irep, &n, &ram, &code );
+    snprintf( key, sizeof(key), "irep.%s.count", tasks[i].name );
+    item( key, n );
+    snprintf( key, sizeof(key), "irep.%s.ram", tasks[i].name );
+    item( key, ram );
+    snprintf( key, sizeof(key), "irep.%s.code", tasks[i].name );
+    item( key, code );
+  }
+  item( "heap.total", heap_used() );
+  item( "flash.mrblib_image", sizeof(mrblib_image) );
+
+  print_items();
+
+  return 0;
+}
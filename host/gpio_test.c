@@ -0,0 +1,107 @@
+/*! @file
+  @brief
+  GPIO class test, with edges injected by mrbc_gpio_event().
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  gpio_test_irq.rb injects the edges below, as the GPIO interrupt
+  handler does, while gpio_test_task.rb is waiting for them.
+  The time stamps are across the wrap of hal_micros(), and one
+  interval is longer than Fixnum.
+
+  usage: gpio_test	exit status is the number of failures.
+  </pre>
+*/
+
+#include <stdio.h>
+
+#include "mrubyc.h"
+#include "gpio_test_task.h"
+#include "gpio_test_irq.h"
+
+#if !MRBC_USE_GPIO
+#error "gpio_test needs MRBC_USE_GPIO=1"
+#endif
+
+#define T0	0xffffff00U
+
+static const struct {
+  uint8_t pin;
+  uint8_t level;
+  uint32_t us;
+} edges_[] = {
+  { 4, 0, T0 },				// button, falling.
+  { 4, 1, T0 + 100 },			// rising, counted only.
+  { 5, 1, T0 + 300 },			// tacho, after the wrap.
+  { 4, 0, T0 + 1000 },
+  { 5, 1, T0 + 300 + 3000000000U },	// 50 minutes.
+};
+
+static int n_checks_;
+static int n_failures_;
+
+
+//================================================================
+/*! (method) gpio_test_inject
+*/
+static void c_gpio_test_inject(struct VM *vm, mrbc_value v[], int argc)
+{
+  int i;
+  for( i = 0; i < sizeof(edges_) / sizeof(edges_[0]); i++ ) {
+    mrbc_gpio_event( edges_[i].pin, edges_[i].level, edges_[i].us );
+  }
+}
+
+
+//================================================================
+/*! (method) gpio_test_flood(n)
+
+  inject falling edges, n more than the ring buffer.
+  returns the size of the ring buffer.
+*/
+static void c_gpio_test_flood(struct VM *vm, mrbc_value v[], int argc)
+{
+  int i;
+  for( i = 0; i < MRBC_GPIO_EVENT_BUFFER_SIZE + GET_INT_ARG(1); i++ ) {
+    mrbc_gpio_event( 4, 0, hal_micros() );
+  }
+  SET_INT_RETURN( MRBC_GPIO_EVENT_BUFFER_SIZE );
+}
+
+
+//================================================================
+/*! (method) check(name, result)
+*/
+static void c_check(struct VM *vm, mrbc_value v[], int argc)
+{
+  int ok = (argc >= 2 && v[2].tt != MRBC_TT_FALSE && v[2].tt != MRBC_TT_NIL);
+
+  n_checks_++;
+  if( !ok ) n_failures_++;
+  console_printf("%-32s %s\n",
+		 GET_TT_ARG(1) == MRBC_TT_STRING ? mrbc_string_cstr(&v[1]) : "?",
+		 ok ? "ok" : "NG");
+}
+
+
+#define MEMORY_SIZE (1024*40)
+static uint8_t memory_pool[MEMORY_SIZE];
+
+int main(int argc, char *argv[])
+{
+  mrbc_init( memory_pool, MEMORY_SIZE );
+  mrbc_define_method(0, mrbc_class_object, "check", c_check);
+  mrbc_define_method(0, mrbc_class_object, "gpio_test_inject", c_gpio_test_inject);
+  mrbc_define_method(0, mrbc_class_object, "gpio_test_flood", c_gpio_test_flood);
+
+  mrbc_create_task( gpio_test_task, 0 );
+  mrbc_create_task( gpio_test_irq, 0 );
+  mrbc_run();
+
+  console_printf("\ngpio_test: %d checks, %d failures\n", n_checks_, n_failures_);
+  return n_failures_;
+}
@@ -0,0 +1,6 @@
+#
+# Injects the edges, as the GPIO interrupt handler does, while
+# gpio_test_task.rb is waiting. (see gpio_test.c)
+#
+sleep_ms 50
+gpio_test_inject
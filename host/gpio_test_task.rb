@@ -0,0 +1,26 @@
+#
+# GPIO class test. (see gpio_test.c)
+#
+button = GPIO.new(4, :falling, :up)
+tacho = GPIO.new(5, :rising)
+check "GPIO.new", tacho != nil
+check "GPIO.new bad edge", GPIO.new(6, :up) == nil
+check "GPIO#value pulled up", button.value == 1
+check "GPIO.wait timeout", GPIO.wait(10) == false
+
+# injected by gpio_test_irq.rb
+check "GPIO.wait", GPIO.wait(1000) == true
+ev = GPIO.events(16)
+check "GPIO.events", ev.size == 4
+check "GPIO.events order", ev[1][0] == 5
+check "GPIO.events interval", ev[2] == [4, 0, 1000]
+check "GPIO.events long interval", ev[3] == [5, 1, 0x7fff_ffff]
+check "GPIO.events empty", GPIO.events(16).size == 0
+check "GPIO#count", tacho.count == 2
+check "GPIO#count rising edges", button.count == 1
+tacho.clear_count
+check "GPIO#clear_count", tacho.count == 0
+
+size = gpio_test_flood(4)
+check "GPIO.lost", GPIO.lost == 4
+check "GPIO.events full", GPIO.events(size + 4).size == size
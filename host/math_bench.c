@@ -0,0 +1,222 @@
+/*! @file
+  @brief
+  Fast math accuracy and speed benchmark against libm.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Run math_fast.c (MRBC_USE_MATH_FAST) over random arguments, and
+  report the error against libm in double, and ns/call of math_fast,
+  libm in float and libm in double. The error is relative, except
+  sin and cos. (absolute) NG if it is over 10^-MRBC_MATH_FAST_DIGITS,
+  or over it times |y*log(x)| for pow. (see mrbc_fast_powf)
+  Then the error of the thermistor temperature. (see main/sensors.c)
+
+  usage: math_bench [-n count]
+  the precision is compiled in. make -B build/math_bench MATH_FAST_DIGITS=6
+  </pre>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "vm_config.h"
+#include "math_fast.h"
+
+#if !MRBC_USE_MATH_FAST
+# error "build with -DMRBC_USE_MATH_FAST=1"
+#endif
+
+
+//================================================================
+/*! function under test.
+*/
+typedef struct MATH_FUNC {
+  const char *name;
+  float (*fast)(float x, float y);
+  float (*libm_f)(float x, float y);
+  double (*libm_d)(double x, double y);
+  float lo, hi;			//!< range of x
+  int log_scale;		//!< x is log-uniform.
+  int absolute;			//!< absolute error.
+  int scaled;			//!< error per |y*log(x)|, if over 1.
+  float y_lo, y_hi;		//!< range of y, if 2 arguments.
+} math_func;
+
+#define WRAP1(name, fn) \
+  static float fast_##name(float x, float y) { return mrbc_fast_##fn(x); } \
+  static float libm_f_##name(float x, float y) { return fn(x); } \
+  static double libm_d_##name(double x, double y) { return name(x); }
+
+WRAP1(log, logf)
+WRAP1(exp, expf)
+WRAP1(sqrt, sqrtf)
+WRAP1(sin, sinf)
+WRAP1(cos, cosf)
+static float fast_pow(float x, float y) { return mrbc_fast_powf(x, y); }
+static float libm_f_pow(float x, float y) { return powf(x, y); }
+static double libm_d_pow(double x, double y) { return pow(x, y); }
+
+static const math_func funcs_[] = {
+  { "log",  fast_log,  libm_f_log,  libm_d_log,  1e-6f, 1e6f, 1, 0 },
+  { "exp",  fast_exp,  libm_f_exp,  libm_d_exp,  -80,   80,   0, 0 },
+  { "pow",  fast_pow,  libm_f_pow,  libm_d_pow,  1e-2f, 1e2f, 1, 0, 1, -4.5f, 4.5f },
+  { "sqrt", fast_sqrt, libm_f_sqrt, libm_d_sqrt, 1e-6f, 1e6f, 1, 0 },
+  { "sin",  fast_sin,  libm_f_sin,  libm_d_sin,  -100,  100,  0, 1 },
+  { "cos",  fast_cos,  libm_f_cos,  libm_d_cos,  -100,  100,  0, 1 },
+};
+
+static float *xs_, *ys_;
+static int n_;
+static volatile float sink_f_;
+static volatile double sink_d_;
+
+
+//================================================================
+/*! random float in [lo, hi)
+*/
+static float random_in(float lo, float hi, int log_scale)
+{
+  double r = (double)rand() / ((double)RAND_MAX + 1);
+  if( log_scale ) return (float)exp( log(lo) + r * (log(hi) - log(lo)) );
+  return (float)(lo + r * (hi - lo));
+}
+
+
+//================================================================
+/*! elapsed nanoseconds.
+*/
+static double elapsed_ns(const struct timespec *t0)
+{
+  struct timespec t1;
+  clock_gettime( CLOCK_MONOTONIC, &t1 );
+  return (t1.tv_sec - t0->tv_sec) * 1e9 + (t1.tv_nsec - t0->tv_nsec);
+}
+
+
+//================================================================
+/*! run a function, and print the result line.
+
+  @return	1 if the error is over the limit.
+*/
+static int bench_func(const math_func *f, double limit)
+{
+  int i;
+  srand( 1 );
+  for( i = 0; i < n_; i++ ) {
+    xs_[i] = random_in( f->lo, f->hi, f->log_scale );
+    ys_[i] = f->y_hi ? random_in( f->y_lo, f->y_hi, 0 ) : 0;
+  }
+
+  // accuracy
+  double max_err = 0;
+  float worst_x = 0, worst_y = 0;
+  for( i = 0; i < n_; i++ ) {
+    double ref = f->libm_d( xs_[i], ys_[i] );
+    double err = fabs( f->fast( xs_[i], ys_[i] ) - ref );
+    if( !f->absolute && ref != 0 ) err /= fabs(ref);
+    if( f->scaled ) err /= fmax( 1, fabs(ys_[i] * log(xs_[i])) );
+    if( err > max_err ) {
+      max_err = err;
+      worst_x = xs_[i];
+      worst_y = ys_[i];
+    }
+  }
+
+  // speed
+  struct timespec t0;
+  float acc_f = 0;
+  double acc_d = 0;
+
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  for( i = 0; i < n_; i++ ) acc_f += f->fast( xs_[i], ys_[i] );
+  double ns_fast = elapsed_ns( &t0 ) / n_;
+
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  for( i = 0; i < n_; i++ ) acc_f += f->libm_f( xs_[i], ys_[i] );
+  double ns_libm_f = elapsed_ns( &t0 ) / n_;
+
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  for( i = 0; i < n_; i++ ) acc_d += f->libm_d( xs_[i], ys_[i] );
+  double ns_libm_d = elapsed_ns( &t0 ) / n_;
+
+  sink_f_ = acc_f;
+  sink_d_ = acc_d;
+
+  int ng = !(max_err <= limit);
+  printf("%-5s %-4s %10.3g  %8.2f %8.2f %8.2f  %s  (x=%g",
+	 f->name, f->absolute ? "abs" : f->scaled ? "rel*" : "rel", max_err,
+	 ns_fast, ns_libm_f, ns_libm_d, ng ? "NG" : "ok", worst_x);
+  if( f->y_hi ) printf(" y=%g", worst_y);
+  printf(")\n");
+
+  return ng;
+}
+
+
+//================================================================
+/*! thermistor temperature, same as main/sensors.c
+*/
+#define DIVIDER_MV	3300
+#define DIVIDER_RREF	10000
+#define THERMISTOR_B	3435
+#define THERMISTOR_TO	25
+#define THERMISTOR_R0	10000
+
+static double thermistor_error(void)
+{
+  double max_err = 0;
+  int mv;
+
+  for( mv = 100; mv <= 3200; mv++ ) {
+    double r = (double)(DIVIDER_MV - mv) * DIVIDER_RREF / mv;
+    double ref = 1 / (log(r / THERMISTOR_R0) / THERMISTOR_B +
+		      1.0 / (THERMISTOR_TO + 273)) - 273;
+    double t = 1 / (mrbc_fast_logf(r / THERMISTOR_R0) / THERMISTOR_B +
+		    1.0 / (THERMISTOR_TO + 273)) - 273;
+    if( fabs(t - ref) > max_err ) max_err = fabs(t - ref);
+  }
+
+  return max_err;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  n_ = 1000000;
+  while( (opt = getopt(argc, argv, "n:")) != -1 ) {
+    switch( opt ) {
+    case 'n': n_ = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-n count]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  xs_ = malloc( sizeof(float) * n_ );
+  ys_ = malloc( sizeof(float) * n_ );
+  if( !xs_ || !ys_ ) return 1;
+
+  double limit = pow( 10, -MRBC_MATH_FAST_DIGITS );
+  printf("MRBC_MATH_FAST_DIGITS=%d (limit %g), %d calls each\n",
+	 MRBC_MATH_FAST_DIGITS, limit, n_);
+  printf("func  err     max error   ns/call: fast   libm_f   libm_d\n");
+
+  int ng = 0, i;
+  for( i = 0; i < sizeof(funcs_) / sizeof(funcs_[0]); i++ ) {
+    ng += bench_func( &funcs_[i], limit );
+  }
+
+  printf("thermistor 100..3200 mV: max error %.2g degC\n", thermistor_error());
+
+  free( xs_ );
+  free( ys_ );
+  return ng != 0;
+}
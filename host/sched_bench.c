@@ -0,0 +1,347 @@
+/*! @file
+  @brief
+  Sleep wakeup jitter and preemption latency benchmark.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+
+  Run N tasks (sched_bench_task.rb) at mixed priorities and periods,
+  plus a lowest priority task that never sleeps, and report p50/p99/max of
+
+   - wakeup lateness   actual wakeup time - requested deadline.
+   - wake -> run       WAKEUP event in mrbc_tick -> SWITCH_IN of the task.
+   - preempt -> switch PREEMPT event in mrbc_tick -> SWITCH_OUT in mrbc_run.
+
+  Compile with -DMRBC_NO_TIMER to measure the no-timer scheduler.
+  (see Makefile)
+  </pre>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrubyc.h"
+#include "trace.h"
+#include "sched_bench.h"
+#include "sched_bench_task.h"
+
+#if !MRBC_USE_TRACE
+#error "sched_bench needs MRBC_USE_TRACE=1"
+#endif
+#if !MRBC_SCHEDULER_EXIT
+#error "sched_bench needs MRBC_SCHEDULER_EXIT=1, mrbc_run() returns when the tasks end"
+#endif
+
+#if !defined(SCHED_BENCH_MAX_SAMPLES)
+#define SCHED_BENCH_MAX_SAMPLES 1024
+#endif
+
+
+//================================================================
+/*! sample buffer.
+  keeps SCHED_BENCH_MAX_SAMPLES samples chosen uniformly from the whole
+  run (reservoir sampling), and counts all.
+*/
+typedef struct SAMPLES {
+  int n;
+  int32_t max;
+  int32_t v[SCHED_BENCH_MAX_SAMPLES];
+} samples;
+
+//================================================================
+/*! benchmark task.
+*/
+typedef struct BENCH_TASK {
+  mrbc_tcb tcb;
+  int period_ms;	//!< 0 is CPU hog. (never sleeps)
+  int work;		//!< loop count after each wakeup.
+  int sleeping;
+  uint32_t deadline;	//!< hal_micros() at wakeup expected.
+  samples lateness;
+} bench_task;
+
+
+// priority, period, work. (the last one is used for the CPU hog)
+static const struct {
+  uint8_t priority;
+  uint16_t period_ms;
+  uint16_t work;
+} task_params[] = {
+  { 100,   1,    50 },
+  { 110,   5,   500 },
+  { 120,  10,  2000 },
+  { 130,  20,  5000 },
+  { 140,  50, 20000 },
+  { 200,   0, 50000 },
+};
+#define N_PARAMS (sizeof(task_params) / sizeof(task_params[0]))
+
+static bench_task tasks_[MAX_VM_COUNT];
+static int n_tasks_;
+static uint32_t end_time_;
+
+// trace event analysis (index by vm_id)
+static uint32_t wakeup_at_[MAX_VM_COUNT+1];
+static uint32_t preempt_at_[MAX_VM_COUNT+1];
+static samples wake_to_run_;
+static samples preempt_to_switch_;
+static uint32_t trace_lost_;
+
+
+
+//================================================================
+/*! add a sample.
+*/
+static void add_sample(samples *s, int32_t v)
+{
+  if( s->n == 0 || s->max < v ) s->max = v;
+  if( s->n < SCHED_BENCH_MAX_SAMPLES ) {
+    s->v[s->n] = v;
+  } else {
+    // replace with probability MAX / (n + 1).
+    int i = rand() % (s->n + 1);
+    if( i < SCHED_BENCH_MAX_SAMPLES ) s->v[i] = v;
+  }
+  s->n++;
+}
+
+
+//================================================================
+/*! compare function for qsort.
+*/
+static int cmp_int32(const void *a, const void *b)
+{
+  int32_t x = *(const int32_t *)a;
+  int32_t y = *(const int32_t *)b;
+  return (x > y) - (x < y);
+}
+
+
+//================================================================
+/*! print percentiles.
+*/
+static void print_samples(const char *label, samples *s)
+{
+  int n = s->n < SCHED_BENCH_MAX_SAMPLES ? s->n : SCHED_BENCH_MAX_SAMPLES;
+
+  console_printf("%-22s %7d", label, s->n);
+  if( n == 0 ) {
+    console_printf("      -      -      -\n");
+    return;
+  }
+  qsort( s->v, n, sizeof(int32_t), cmp_int32 );
+  console_printf(" %6d %6d %6d\n",
+		 s->v[ (n - 1) * 50 / 100 ], s->v[ (n - 1) * 99 / 100 ], s->max);
+}
+
+
+//================================================================
+/*! find benchmark task from VM.
+*/
+static bench_task *find_task(struct VM *vm)
+{
+  int i;
+  for( i = 0; i < n_tasks_; i++ ) {
+    if( &tasks_[i].tcb.vm == vm ) return &tasks_[i];
+  }
+  return NULL;
+}
+
+
+//================================================================
+/*! fetch trace events and pick up latencies.
+*/
+static void collect_trace(void)
+{
+  mrbc_trace_event ev[32];
+  uint32_t lost;
+  int n, i;
+
+  while( 1 ) {
+    hal_disable_irq();
+    n = mrbc_trace_fetch( ev, 32, &lost );
+    hal_enable_irq();
+    trace_lost_ += lost;
+    if( n == 0 ) break;
+
+    for( i = 0; i < n; i++ ) {
+      int id = ev[i].vm_id;
+      if( id > MAX_VM_COUNT ) continue;
+
+      switch( ev[i].type ) {
+      case MRBC_TRACE_TASK_WAKEUP:
+	if( !wakeup_at_[id] ) wakeup_at_[id] = ev[i].timestamp | 1;
+	break;
+
+      case MRBC_TRACE_TASK_SWITCH_IN:
+	if( wakeup_at_[id] ) {
+	  add_sample( &wake_to_run_, ev[i].timestamp - wakeup_at_[id] );
+	  wakeup_at_[id] = 0;
+	}
+	break;
+
+      case MRBC_TRACE_PREEMPT:
+	if( !preempt_at_[id] ) preempt_at_[id] = ev[i].timestamp | 1;
+	break;
+
+      case MRBC_TRACE_TASK_SWITCH_OUT:
+	if( preempt_at_[id] ) {
+	  add_sample( &preempt_to_switch_, ev[i].timestamp - preempt_at_[id] );
+	  preempt_at_[id] = 0;
+	}
+	break;
+
+      default:
+	break;
+      }
+    }
+  }
+}
+
+
+//================================================================
+/*! (method) bench_period
+*/
+static void c_bench_period(struct VM *vm, mrbc_value v[], int argc)
+{
+  bench_task *t = find_task(vm);
+  SET_INT_RETURN( t ? t->period_ms : 0 );
+}
+
+
+//================================================================
+/*! (method) bench_work
+*/
+static void c_bench_work(struct VM *vm, mrbc_value v[], int argc)
+{
+  bench_task *t = find_task(vm);
+  SET_INT_RETURN( t ? t->work : 0 );
+}
+
+
+//================================================================
+/*! (method) bench_sleep(ms)  returns false if benchmark is over.
+*/
+static void c_bench_sleep(struct VM *vm, mrbc_value v[], int argc)
+{
+  bench_task *t = find_task(vm);
+  uint32_t now = hal_micros();
+
+  if( t == NULL || (int32_t)(now - end_time_) >= 0 ) {
+    SET_FALSE_RETURN();
+    return;
+  }
+
+  int ms = GET_INT_ARG(1);
+  if( ms > 0 ) {
+    t->deadline = now + ms * 1000;
+    t->sleeping = 1;
+    mrbc_sleep_ms( &t->tcb, ms );
+  }
+  SET_TRUE_RETURN();
+}
+
+
+//================================================================
+/*! (method) bench_woke
+*/
+static void c_bench_woke(struct VM *vm, mrbc_value v[], int argc)
+{
+  bench_task *t = find_task(vm);
+  uint32_t now = hal_micros();
+
+  if( t && t->sleeping ) {
+    add_sample( &t->lateness, (int32_t)(now - t->deadline) );
+    t->sleeping = 0;
+  }
+  collect_trace();
+}
+
+
+//================================================================
+/*! run the benchmark and print the result.
+
+  @param  n_tasks	number of tasks (2..MAX_VM_COUNT)
+  @param  duration_ms	duration.
+  @return		zero if no error.
+  @note	  mrbc_init() must be called before. (tasks must not be running)
+*/
+int sched_bench_run(int n_tasks, int duration_ms)
+{
+  int i;
+
+  if( n_tasks < 2 ) n_tasks = 2;
+  if( n_tasks > MAX_VM_COUNT ) n_tasks = MAX_VM_COUNT;
+
+  mrbc_define_method(0, mrbc_class_object, "bench_period", c_bench_period);
+  mrbc_define_method(0, mrbc_class_object, "bench_work",   c_bench_work);
+  mrbc_define_method(0, mrbc_class_object, "bench_sleep",  c_bench_sleep);
+  mrbc_define_method(0, mrbc_class_object, "bench_woke",   c_bench_woke);
+
+  memset( tasks_, 0, sizeof(tasks_) );
+  memset( &wake_to_run_, 0, sizeof(wake_to_run_) );
+  memset( &preempt_to_switch_, 0, sizeof(preempt_to_switch_) );
+  memset( wakeup_at_, 0, sizeof(wakeup_at_) );
+  memset( preempt_at_, 0, sizeof(preempt_at_) );
+  trace_lost_ = 0;
+  n_tasks_ = n_tasks;
+  end_time_ = hal_micros() + duration_ms * 1000;
+
+  for( i = 0; i < n_tasks; i++ ) {
+    int p = (i == n_tasks - 1) ? N_PARAMS - 1 : i % (N_PARAMS - 1);
+    bench_task *t = &tasks_[i];
+
+    mrbc_init_tcb( &t->tcb );
+    t->tcb.priority = task_params[p].priority;
+    t->period_ms = task_params[p].period_ms;
+    t->work = task_params[p].work;
+    if( mrbc_create_task( sched_bench_task, &t->tcb ) == NULL ) return -1;
+  }
+
+  mrbc_trace_set_alloc_threshold( 0xffff );
+  mrbc_trace_clear();
+  mrbc_trace_start();
+  mrbc_run();
+  mrbc_trace_stop();
+  collect_trace();
+
+#if defined(MRBC_NO_TIMER)
+  console_printf("\nsched_bench: no timer, %d tasks, %d ms\n", n_tasks, duration_ms);
+#else
+  console_printf("\nsched_bench: timer, %d tasks, %d ms\n", n_tasks, duration_ms);
+#endif
+  console_printf("%-22s %7s %6s %6s %6s\n", "(micro sec.)", "n", "p50", "p99", "max");
+
+  for( i = 0; i < n_tasks; i++ ) {
+    bench_task *t = &tasks_[i];
+    char label[32];
+    if( t->period_ms == 0 ) continue;
+    sprintf( label, "lateness p%d %dms", t->tcb.priority, t->period_ms );
+    print_samples( label, &t->lateness );
+  }
+  print_samples( "wake -> run", &wake_to_run_ );
+  print_samples( "preempt -> switch", &preempt_to_switch_ );
+  if( trace_lost_ ) console_printf("(%d trace events lost)\n", trace_lost_);
+
+  return 0;
+}
+
+
+#if !defined(ESP_PLATFORM)
+#define MEMORY_SIZE (1024*40)
+static uint8_t memory_pool[MEMORY_SIZE];
+
+int main(int argc, char *argv[])
+{
+  int n_tasks = argc > 1 ? atoi(argv[1]) : 5;
+  int duration_ms = argc > 2 ? atoi(argv[2]) : 5000;
+
+  mrbc_init( memory_pool, MEMORY_SIZE );
+
+  return sched_bench_run( n_tasks, duration_ms ) == 0 ? 0 : 1;
+}
+#endif
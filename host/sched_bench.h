@@ -0,0 +1,25 @@
+/*! @file
+  @brief
+  Sleep wakeup jitter and preemption latency benchmark.
+
+  <pre>
+  Copyright (C) 2015-2019 Kyushu Institute of Technology.
+  Copyright (C) 2015-2019 Shimane IT Open-Innovation Center.
+
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef SCHED_BENCH_H_
+#define SCHED_BENCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int sched_bench_run(int n_tasks, int duration_ms);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,15 @@
+#
+# Scheduler benchmark task. (see sched_bench.c)
+#
+# Every task runs this same code, with its own period and workload.
+#
+period = bench_period
+work = bench_work
+
+while bench_sleep(period)
+  bench_woke
+  i = 0
+  while i < work
+    i += 1
+  end
+end
@@ -0,0 +1,25 @@
+require "uri"
+
+# "HEALTH:..." record of the firmware, stored as a row of health.csv.
+# (see components/mrubyc/mrubyc_src/health.h)
+#
+#  up=s&heap=used,free,frag,largest&sym=used,max&overruns=n&tasks=id:cpu:sw,...
+#
+module HealthRecord
+  COLUMNS = %w(time device up heap_used heap_free heap_frag heap_largest
+               sym_used sym_max overruns tasks)
+
+  # params is a Hash of the record, or the record String.
+  def self.row(time, device, params)
+    params = URI.decode_www_form(params).to_h if params.is_a?(String)
+    heap = params["heap"].to_s.split(",")
+    sym = params["sym"].to_s.split(",")
+    [time, device, params["up"], *heap.values_at(0..3), *sym.values_at(0, 1),
+     params["overruns"], params["tasks"]]
+  end
+
+  # the largest CPU per mille of the tasks in a row.
+  def self.max_cpu(tasks)
+    tasks.to_s.split(",").map { |t| t.split(":")[1].to_i }.max || 0
+  end
+end
@@ -1,9 +1,12 @@
 require "file-tail"
 require "csv"
 require 'fileutils'
+require_relative "health_record"
 
 csvfile = "data.csv"
 FileUtils.touch(csvfile)
+healthfile = "health.csv"
+FileUtils.touch(healthfile)
 
 filename = 'log.txt'
 
@@ -21,6 +24,10 @@ File.open(filename) do |log|
         sensors = data[1].split("&").map{|sensor| sensor.split("=")}
         csv << [Time.now, sensors[0][1].chomp, sensors[1][1].chomp]
       end
+    elsif health = line.match(/\AHEALTH:(.+)/)
+      CSV.open(healthfile, "a") do |csv|
+        csv << HealthRecord.row(Time.now, "serial", health[1].chomp)
+      end
     end
   end
 end
@@ -0,0 +1,114 @@
+#
+# Convert mruby/c event trace (see components/mrubyc/mrubyc_src/trace.c)
+# to Chrome trace event format. Open the output with chrome://tracing
+# or https://ui.perfetto.dev
+#
+#  ruby trace2chrome.rb log.txt > trace.json     # "TRACE:" lines in monitor log
+#  ruby trace2chrome.rb trace.bin > trace.json   # binary log
+#
+require "json"
+
+EVENT_NAMES = {
+  0x01 => :switch_in,
+  0x02 => :switch_out,
+  0x03 => :wakeup,
+  0x04 => :mutex_wait,
+  0x05 => :alloc,
+  0x06 => :free,
+  0x07 => :cfunc_enter,
+  0x08 => :cfunc_exit,
+  0x09 => :preempt,
+}
+TASK_STATES = { 0x00 => "dormant", 0x01 => "ready", 0x03 => "running",
+                0x04 => "waiting", 0x08 => "suspended" }
+
+def read_binary(filename)
+  data = File.binread(filename)
+  return data if data.start_with?("MRBCTRC1")
+
+  # pick up the last dump in monitor log.
+  hex = nil
+  File.foreach(filename) do |line|
+    case line
+    when /\ATRACE:BEGIN/ then hex = ""
+    when /\ATRACE:END/   then data = [hex].pack("H*") if hex
+    when /\ATRACE:(\h+)/ then hex << $1 if hex
+    end
+  end
+  raise "trace not found in #{filename}" unless data.start_with?("MRBCTRC1")
+  data
+end
+
+def parse(data)
+  n_events, n_lost = data[8, 8].unpack("NN")
+  pos = 16
+  events = n_events.times.map do
+    ts, type, vm_id, arg16, arg32, arg32b = data[pos, 16].unpack("NCCnNN")
+    pos += 16
+    { ts: ts, type: EVENT_NAMES[type], vm_id: vm_id,
+      arg16: arg16, arg32: arg32, arg32b: arg32b }
+  end
+
+  symbols = {}
+  loop do
+    sym_id = data[pos, 2].unpack1("n")
+    pos += 2
+    break if sym_id == 0xffff
+    len = data[pos].unpack1("C")
+    symbols[sym_id] = data[pos + 1, len]
+    pos += 1 + len
+  end
+
+  [events, symbols, n_lost]
+end
+
+def convert(events, symbols)
+  base = events.first ? events.first[:ts] : 0
+  trace = []
+  events.each do |ev|
+    ts = (ev[:ts] - base) & 0xffffffff   # wrap around 32bit micro sec.
+    tid = ev[:vm_id]
+    rec = { pid: 1, tid: tid, ts: ts }
+    case ev[:type]
+    when :switch_in
+      trace << rec.merge(ph: "B", name: "run", args: { priority: ev[:arg16] })
+    when :switch_out
+      trace << rec.merge(ph: "E", name: "run",
+                         args: { state: TASK_STATES[ev[:arg16]] })
+    when :wakeup
+      trace << rec.merge(ph: "i", s: "t", name: "wakeup",
+                         args: { tick: ev[:arg32] })
+    when :preempt
+      trace << rec.merge(ph: "i", s: "t", name: "preempt",
+                         args: { tick: ev[:arg32] })
+    when :mutex_wait
+      trace << rec.merge(ph: "i", s: "t", name: "mutex wait",
+                         args: { mutex: format("%08x", ev[:arg32]) })
+    when :alloc, :free
+      trace << rec.merge(ph: "i", s: "p", name: ev[:type].to_s,
+                         args: { size: ev[:arg32], offset: ev[:arg32b] })
+    when :cfunc_enter, :cfunc_exit
+      name = symbols[ev[:arg16]] || "sym##{ev[:arg16]}"
+      trace << rec.merge(ph: ev[:type] == :cfunc_enter ? "B" : "E", name: name,
+                         cat: "cfunc")
+    end
+  end
+
+  tids = events.map { |ev| ev[:vm_id] }.uniq
+  tids.each do |tid|
+    name = tid == 0 ? "system" : "task #{tid}"
+    trace << { pid: 1, tid: tid, ph: "M", name: "thread_name",
+               args: { name: name } }
+  end
+  trace
+end
+
+if ARGV.empty?
+  warn "usage: ruby #{$0} (log.txt | trace.bin)"
+  exit 1
+end
+
+events, symbols, n_lost = parse(read_binary(ARGV[0]))
+warn "#{events.size} events, #{n_lost} lost" if n_lost > 0
+puts JSON.generate({ traceEvents: convert(events, symbols),
+                     displayTimeUnit: "ms" })
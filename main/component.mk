@@ -4,14 +4,30 @@
 # (Uses default behaviour of compiling all source files in directory, adding 'include' to include path.)
 
 COMPONENT_DEPENDS := mrubyc
-COMPONENT_EXTRA_CLEAN = SRCFILES
+
+# mruby/c features used by main.c and mrblib. (see vm_config.h)
+# keep the same as components/mrubyc/component.mk.
+CFLAGS += -DMRBC_USE_METHOD_CACHE=1 \
+  -DMRBC_USE_ADC=1 \
+  -DMRBC_USE_SCRATCH=1 \
+  -DMRBC_USE_CONSOLE_STREAM=1 \
+  -DMRBC_USE_HEALTH=1
+COMPONENT_EXTRA_CLEAN = SRCFILES mrblib_image.h
 
 MRBC = mrbc
 SRCDIR = $(PROJECT_PATH)/mrblib
 SRCFILES = $(wildcard $(SRCDIR)/*.rb) $(wildcard $(SRCDIR)/**/*.rb)
 OBJS = $(patsubst %.rb,%.h,$(SRCFILES))
 
-main.o: $(OBJS)
+# the scripts run by main.c, linked into one image with shared symbol
+# and string pools. (see tools/link_mrb.rb)
+IMAGE_SCRIPTS = models/thermistor models/led models/co2 loops/primary loops/secondary
+IMAGE_SRCS = $(patsubst %,$(COMPONENT_BUILD_DIR)/%.h,$(IMAGE_SCRIPTS))
+
+main.o: $(OBJS) $(COMPONENT_BUILD_DIR)/mrblib_image.h
+
+$(COMPONENT_BUILD_DIR)/mrblib_image.h: $(OBJS) $(PROJECT_PATH)/tools/link_mrb.rb
+	ruby $(PROJECT_PATH)/tools/link_mrb.rb -o $@ $(IMAGE_SRCS)
 
 $(SRCDIR)/%.h: $(SRCDIR)/%.rb
 	@if [ ! -d $(dir $(subst $(SRCDIR),$(COMPONENT_BUILD_DIR),$@)) ]; \
@@ -20,3 +36,30 @@ $(SRCDIR)/%.h: $(SRCDIR)/%.rb
 	@echo $(MRBC) -E -B $(basename $(notdir $@)) -o $(subst $(SRCDIR),$(COMPONENT_BUILD_DIR),$@) $^
 	$(MRBC) -E -B $(basename $(notdir $@)) -o $(subst $(SRCDIR),$(COMPONENT_BUILD_DIR),$@) $^
 
+
+# make SCHED_BENCH=1 flash monitor
+#   runs host/sched_bench.c on the board, instead of the application.
+ifdef SCHED_BENCH
+CFLAGS += -DSCHED_BENCH -DMRBC_USE_TRACE=1 -DMRBC_SCHEDULER_EXIT=1
+COMPONENT_SRCDIRS := . ../host
+COMPONENT_OBJS := main.o sensors.o ../host/sched_bench.o
+COMPONENT_PRIV_INCLUDEDIRS := ../host
+
+../host/sched_bench.o: $(COMPONENT_BUILD_DIR)/sched_bench_task.h
+
+$(COMPONENT_BUILD_DIR)/sched_bench_task.h: $(PROJECT_PATH)/host/sched_bench_task.rb
+	$(MRBC) -E -B sched_bench_task -o $@ $^
+endif
+
+
+# make STRIP_METHODS=1 flash
+#   define only the built-in methods used by mrblib/*.rb (and used_methods.keep).
+ifdef STRIP_METHODS
+CFLAGS += -DSTRIP_METHODS
+
+main.o: $(COMPONENT_BUILD_DIR)/used_methods.h
+
+$(COMPONENT_BUILD_DIR)/used_methods.h: $(OBJS) $(COMPONENT_PATH)/used_methods.keep $(PROJECT_PATH)/tools/used_methods.rb
+	ruby $(PROJECT_PATH)/tools/used_methods.rb -m $(PROJECT_PATH)/components/mrubyc/mrubyc_src/mrblib.c \
+	  -k $(COMPONENT_PATH)/used_methods.keep -o $@ $(subst $(SRCDIR),$(COMPONENT_BUILD_DIR),$(OBJS))
+endif
@@ -6,24 +6,22 @@
 #include "nvs_flash.h"
 #include "driver/uart.h"
 #include "driver/gpio.h"
-#include "driver/adc.h"
-#include "esp_adc_cal.h"
 
 #include "mrubyc.h"
+#include "sensors.h"
 
-#include "models/thermistor.h"
-#include "models/led.h"
-#include "models/co2.h"
-#include "loops/primary.h"
-#include "loops/secondary.h"
+#include "mrblib_image.h"	// scripts of mrblib, linked by tools/link_mrb.rb
+#ifdef SCHED_BENCH
+#include "sched_bench.h"
+#endif
+#ifdef STRIP_METHODS
+#include "used_methods.h"
+#endif
 
-#define DEFAULT_VREF    1100
 #define NO_OF_SAMPLES   64
+#define ADC_RATE_HZ     10
 
-static esp_adc_cal_characteristics_t *adc_chars;
-static const adc_channel_t channel = ADC_CHANNEL_0; //GPIO4
-static const adc_atten_t atten = ADC_ATTEN_DB_11;
-static const adc_unit_t unit = ADC_UNIT_2;
+static const int adc_channel = 10;	// ADC2_CHANNEL_0, GPIO4 (see hal_adc_open)
 
 #define MEMORY_SIZE (1024*40)
 static uint8_t memory_pool[MEMORY_SIZE];
@@ -41,21 +39,12 @@ static void c_gpio_set_level(mrb_vm *vm, mrb_value *v, int argc){
 }
 
 static void c_init_adc(mrb_vm *vm, mrb_value *v, int argc){
-  adc2_config_channel_atten((adc2_channel_t)channel, atten);
-  adc_chars = calloc(1, sizeof(esp_adc_cal_characteristics_t));
-  esp_adc_cal_characterize(unit, atten, ADC_WIDTH_BIT_12, DEFAULT_VREF, adc_chars);
+  mrbc_adc_configure(&adc_channel, 1, ADC_RATE_HZ, NO_OF_SAMPLES);
 }
 
+// the last sweep of the scanner, no sampling here.
 static void c_read_adc(mrb_vm *vm, mrb_value *v, int argc){
-  uint32_t adc_reading = 0;
-  for (int i = 0; i < NO_OF_SAMPLES; i++) {
-    int raw;
-    adc2_get_raw((adc2_channel_t)channel, ADC_WIDTH_BIT_12, &raw);
-    adc_reading += raw;
-  }
-  adc_reading /= NO_OF_SAMPLES;
-  uint32_t millivolts = esp_adc_cal_raw_to_voltage(adc_reading, adc_chars);
-  SET_INT_RETURN(millivolts);
+  SET_INT_RETURN(mrbc_adc_value(0));
 }
 //================================================================
 /*! DEBUG PRINT
@@ -95,23 +84,15 @@ static void c_debugprint(struct VM *vm, mrbc_value v[], int argc){
 #define MY_UART_RXD  (16)
 static int uart_num = UART_NUM_2;
 
-static void c_get_co2(struct VM *vm, mrbc_value v[], int argc){
-  uint8_t command[] = {
-    0xFF, 0x01, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00, 0x79
-  };
-  uart_write_bytes(uart_num, (const char*)command, 9);
-  // Read data from UART.
-  uint8_t data[10];
-  int length = 0;
-  ESP_ERROR_CHECK(uart_get_buffered_data_len(uart_num, (size_t*)&length));
-  length = uart_read_bytes(uart_num, data, length, 100);
-  int i;
-  mrb_value array = mrbc_array_new( vm, 9 );
-  for( i = 0; i < 9; i++ ) {
-    mrb_value value = mrb_fixnum_value(data[i]);
-    mrbc_array_set( &array, i, &value );
+// wake up Sensors.snapshot on data arrival.
+static void uart_event_task(void *arg){
+  QueueHandle_t queue = (QueueHandle_t)arg;
+  uart_event_t event;
+  while( 1 ) {
+    if( xQueueReceive(queue, &event, portMAX_DELAY) && event.type == UART_DATA ) {
+      sensors_notify();
+    }
   }
-  SET_RETURN(array);
 }
 
 void app_main(void) {
@@ -132,16 +113,24 @@ void app_main(void) {
   QueueHandle_t uart_queue;
   // Install UART driver using an event queue here
   ESP_ERROR_CHECK(uart_driver_install(uart_num, uart_buffer_size, uart_buffer_size, 10, &uart_queue, 0));
+  xTaskCreate(uart_event_task, "uart_event", 2048, uart_queue, 12, NULL);
 
   nvs_flash_init();
 
+#ifdef STRIP_METHODS
+  mrbc_set_used_methods(used_methods, USED_METHODS_SIZE);
+#endif
   mrbc_init(memory_pool, MEMORY_SIZE);
+#ifdef SCHED_BENCH
+  sched_bench_run(MAX_VM_COUNT, 10000);
+  return;
+#endif
+  sensors_define_class();
   mrbc_define_method(0, mrbc_class_object, "debugprint", c_debugprint);
   mrbc_define_method(0, mrbc_class_object, "gpio_init_output", c_gpio_init_output);
   mrbc_define_method(0, mrbc_class_object, "gpio_set_level", c_gpio_set_level);
   mrbc_define_method(0, mrbc_class_object, "init_adc", c_init_adc);
   mrbc_define_method(0, mrbc_class_object, "read_adc", c_read_adc);
-  mrbc_define_method(0, mrbc_class_object, "get_co2", c_get_co2);
 
   mrbc_create_task( thermistor, 0 );
   mrbc_create_task( led, 0 );
@@ -0,0 +1,331 @@
+/*! @file
+  @brief
+  Batch acquisition of the board sensors.
+
+  <pre>
+  This file is distributed under BSD 3-Clause License.
+
+  Sensors.snapshot reads all sensors in one call, and returns a
+  SensorRecord with typed fields. Sensors.snapshot_into fills a record
+  given, to poll without allocation.
+  The caller waits for the CO2 response without blocking other tasks.
+  (see mrbc_cfunc_block) A task that arrives during an acquisition
+  shares its result.
+
+  (e.g.)
+    rec = SensorRecord.new
+    while true
+      Sensors.snapshot_into(rec, 1000)	# reuse a result younger than 1s.
+      puts "CO2: #{rec.co2}, Temperature: #{rec.temperature}"
+      sleep 1
+    end
+
+  co2 is 0 if the sensor did not respond, same as Co2#concentrate.
+  </pre>
+*/
+
+#include <math.h>
+#include "mrubyc.h"
+#include "hal/hal.h"
+#include "math_fast.h"
+#include "sensors.h"
+
+#define SENSORS_CO2_PORT 2
+#define SENSORS_CO2_TIMEOUT_MS 200
+#define SENSORS_POLL_MS 10
+
+// thermistor, and its divider with Rref. (see mrblib/models/thermistor.rb)
+#define THERMISTOR_B 3435
+#define THERMISTOR_TO 25	// deg C at THERMISTOR_R0.
+#define THERMISTOR_R0 10000	// Ohm
+#define DIVIDER_MV 3300
+#define DIVIDER_RREF 10000	// Ohm
+
+
+//================================================================
+/*!@brief
+  Record of a snapshot. (instance data of SensorRecord)
+*/
+typedef struct SENSOR_RECORD {
+  int32_t co2;			//!< ppm, 0 if no response.
+  int32_t millivolts;		//!< thermistor divider.
+  mrbc_float temperature;	//!< deg C
+  uint32_t time_ms;		//!< hal_micros() / 1000 at the acquisition.
+  uint32_t max_age_ms;		//!< (internal) of the snapshot in progress.
+  uint16_t wait_seq;		//!< (internal) state_.seq at arrival.
+  uint8_t shared;		//!< (internal) arrived during an acquisition.
+} sensor_record;
+
+//================================================================
+/*!@brief
+  Acquisition state.
+*/
+typedef struct SENSORS_STATE {
+  struct VM *owner;		//!< acquiring task, or NULL.
+  uint32_t start_us;
+  uint8_t n_frame;
+  uint8_t frame[9];		//!< MH-Z19 response.
+  uint8_t valid;
+  uint16_t seq;			//!< count of acquisitions.
+  sensor_record last;
+} sensors_state;
+
+static int default_co2_request(void);
+static int default_co2_receive(uint8_t *buf, int len);
+static int default_thermistor_mv(void);
+
+static const sensors_backend default_backend_ = {
+  default_co2_request, default_co2_receive, default_thermistor_mv,
+};
+static MRBC_THREAD_LOCAL const sensors_backend *backend_ = &default_backend_;
+static MRBC_THREAD_LOCAL sensors_state state_;
+static MRBC_THREAD_LOCAL mrbc_class *cls_record_;
+
+
+//================================================================
+/*! default backend. MH-Z19 "read CO2" command.
+*/
+static int default_co2_request(void)
+{
+  static const uint8_t cmd[9] = { 0xff, 0x01, 0x86, 0, 0, 0, 0, 0, 0x79 };
+  uint8_t stale[16];
+
+  while( hal_uart_read( SENSORS_CO2_PORT, stale, sizeof(stale) ) > 0 )
+    ;
+  return hal_uart_write( SENSORS_CO2_PORT, cmd, sizeof(cmd) );
+}
+
+static int default_co2_receive(uint8_t *buf, int len)
+{
+  return hal_uart_read( SENSORS_CO2_PORT, buf, len );
+}
+
+static int default_thermistor_mv(void)
+{
+#if MRBC_USE_ADC
+  return mrbc_adc_value( 0 );
+#else
+  return -1;
+#endif
+}
+
+
+//================================================================
+/*! temperature of the thermistor from the divider voltage.
+*/
+static mrbc_float thermistor_temperature(int mv)
+{
+  if( mv <= 0 || mv >= DIVIDER_MV ) return NAN;
+
+  mrbc_float r = (mrbc_float)(DIVIDER_MV - mv) * DIVIDER_RREF / mv;
+  return 1 / (MRBC_MATH_LOG(r / THERMISTOR_R0) / THERMISTOR_B +
+	      1.0 / (THERMISTOR_TO + 273)) - 273;
+}
+
+
+//================================================================
+/*! finish the acquisition, into state_.last
+*/
+static void acquire_finish(void)
+{
+  sensor_record *r = &state_.last;
+  const uint8_t *f = state_.frame;
+
+  r->co2 = 0;
+  if( state_.n_frame == sizeof(state_.frame) && f[0] == 0xff && f[1] == 0x86 ) {
+    r->co2 = f[2] * 256 + f[3];
+  }
+  r->millivolts = backend_->thermistor_mv();
+  r->temperature = thermistor_temperature( r->millivolts );
+  r->time_ms = hal_micros() / 1000;
+
+  state_.valid = 1;
+  state_.seq++;
+  state_.owner = NULL;
+  mrbc_cfunc_wakeup_all( &state_ );
+}
+
+
+//================================================================
+/*! try to complete the snapshot into v[0].
+
+  @return	1 if completed.
+*/
+static int snapshot_try(struct VM *vm, mrbc_value v[])
+{
+  sensor_record *rec = (sensor_record *)v[0].instance->data;
+  uint32_t now = hal_micros();
+
+  if( rec->shared && state_.seq != rec->wait_seq ) goto DONE;
+  if( state_.valid && state_.owner == NULL &&
+      (uint32_t)(now / 1000 - state_.last.time_ms) < rec->max_age_ms ) goto DONE;
+
+  if( state_.owner == NULL ||
+      (uint32_t)(now - state_.start_us) >= SENSORS_CO2_TIMEOUT_MS * 2000 ) {
+    state_.owner = vm;		// start, or take over an abandoned one.
+    state_.start_us = now;
+    state_.n_frame = 0;
+    backend_->co2_request();
+  }
+  if( state_.owner != vm ) return 0;
+
+  state_.n_frame += backend_->co2_receive( state_.frame + state_.n_frame,
+				sizeof(state_.frame) - state_.n_frame );
+  if( state_.n_frame < sizeof(state_.frame) &&
+      (uint32_t)(now - state_.start_us) < SENSORS_CO2_TIMEOUT_MS * 1000 ) return 0;
+
+  acquire_finish();
+
+ DONE:
+  rec->co2 = state_.last.co2;
+  rec->millivolts = state_.last.millivolts;
+  rec->temperature = state_.last.temperature;
+  rec->time_ms = state_.last.time_ms;
+  return 1;
+}
+
+
+//================================================================
+/*! continuation of snapshot.
+*/
+static void snapshot_resume(struct VM *vm, mrbc_value v[], void *state)
+{
+  if( snapshot_try( vm, v ) ) return;
+
+  mrbc_cfunc_block( vm, v, snapshot_resume, &state_, SENSORS_POLL_MS );
+}
+
+
+//================================================================
+/*! start the snapshot into v[0].
+*/
+static void snapshot_start(struct VM *vm, mrbc_value v[], uint32_t max_age_ms)
+{
+  sensor_record *rec = (sensor_record *)v[0].instance->data;
+
+  rec->max_age_ms = max_age_ms;
+  rec->wait_seq = state_.seq;
+  rec->shared = (state_.owner != NULL && state_.owner != vm);
+  if( snapshot_try( vm, v ) ) return;
+
+  mrbc_cfunc_block( vm, v, snapshot_resume, &state_, SENSORS_POLL_MS );
+}
+
+
+//================================================================
+/*! (method) SensorRecord.new
+*/
+static void c_sensor_record_new(struct VM *vm, mrbc_value v[], int argc)
+{
+  *v = mrbc_instance_new(vm, v->cls, sizeof(sensor_record));
+  if( !v->instance ) return;
+
+  memset( v->instance->data, 0, sizeof(sensor_record) );
+}
+
+
+//================================================================
+/*! (method) SensorRecord#co2, millivolts, temperature, time
+*/
+static void c_sensor_record_co2(struct VM *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN( ((sensor_record *)v->instance->data)->co2 );
+}
+
+static void c_sensor_record_millivolts(struct VM *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN( ((sensor_record *)v->instance->data)->millivolts );
+}
+
+static void c_sensor_record_temperature(struct VM *vm, mrbc_value v[], int argc)
+{
+  SET_FLOAT_RETURN( ((sensor_record *)v->instance->data)->temperature );
+}
+
+static void c_sensor_record_time(struct VM *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN( ((sensor_record *)v->instance->data)->time_ms );
+}
+
+
+//================================================================
+/*! (method) Sensors.snapshot(max_age_ms = 0)  => SensorRecord
+*/
+static void c_sensors_snapshot(struct VM *vm, mrbc_value v[], int argc)
+{
+  uint32_t max_age_ms = 0;
+  if( argc >= 1 && GET_TT_ARG(1) == MRBC_TT_FIXNUM ) max_age_ms = GET_INT_ARG(1);
+
+  mrbc_value rec = mrbc_instance_new(vm, cls_record_, sizeof(sensor_record));
+  if( !rec.instance ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  memset( rec.instance->data, 0, sizeof(sensor_record) );
+  SET_RETURN( rec );
+
+  snapshot_start( vm, v, max_age_ms );
+}
+
+
+//================================================================
+/*! (method) Sensors.snapshot_into(record, max_age_ms = 0)  => record
+*/
+static void c_sensors_snapshot_into(struct VM *vm, mrbc_value v[], int argc)
+{
+  if( argc < 1 || GET_TT_ARG(1) != MRBC_TT_OBJECT ||
+      v[1].instance->cls != cls_record_ ) {
+    SET_NIL_RETURN();
+    return;
+  }
+  uint32_t max_age_ms = 0;
+  if( argc >= 2 && GET_TT_ARG(2) == MRBC_TT_FIXNUM ) max_age_ms = GET_INT_ARG(2);
+
+  mrbc_value rec = v[1];
+  mrbc_dup( &rec );
+  SET_RETURN( rec );
+
+  snapshot_start( vm, v, max_age_ms );
+}
+
+
+//================================================================
+/*! set the sensor access.
+
+  @param  backend	functions, or NULL for the default.
+*/
+void sensors_set_backend(const sensors_backend *backend)
+{
+  backend_ = backend ? backend : &default_backend_;
+}
+
+
+//================================================================
+/*! wake up the task waiting for the CO2 response.
+  call on UART data arrival.
+*/
+void sensors_notify(void)
+{
+  mrbc_cfunc_wakeup_all( &state_ );
+}
+
+
+//================================================================
+/*! define Sensors and SensorRecord class.
+*/
+void sensors_define_class(void)
+{
+  memset( &state_, 0, sizeof(state_) );
+
+  mrbc_class *cls = mrbc_define_class(0, "SensorRecord", mrbc_class_object);
+  mrbc_define_method(0, cls, "new", c_sensor_record_new);
+  mrbc_define_method(0, cls, "co2", c_sensor_record_co2);
+  mrbc_define_method(0, cls, "millivolts", c_sensor_record_millivolts);
+  mrbc_define_method(0, cls, "temperature", c_sensor_record_temperature);
+  mrbc_define_method(0, cls, "time", c_sensor_record_time);
+  cls_record_ = cls;
+
+  cls = mrbc_define_class(0, "Sensors", mrbc_class_object);
+  mrbc_define_method(0, cls, "snapshot", c_sensors_snapshot);
+  mrbc_define_method(0, cls, "snapshot_into", c_sensors_snapshot_into);
+}
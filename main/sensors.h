@@ -0,0 +1,30 @@
+/*! @file
+  @brief
+  Batch acquisition of the board sensors.
+
+  <pre>
+  This file is distributed under BSD 3-Clause License.
+  </pre>
+*/
+
+#ifndef SENSORS_H_
+#define SENSORS_H_
+
+#include <stdint.h>
+
+//================================================================
+/*!@brief
+  Sensor access. The default is MH-Z19 on UART2 and the thermistor on
+  the ADC scanner. (see hal_uart_read, mrbc_adc_value)
+*/
+typedef struct SENSORS_BACKEND {
+  int (*co2_request)(void);			//!< send "read CO2" command.
+  int (*co2_receive)(uint8_t *buf, int len);	//!< bytes received, no wait.
+  int (*thermistor_mv)(void);
+} sensors_backend;
+
+void sensors_set_backend(const sensors_backend *backend);
+void sensors_notify(void);
+void sensors_define_class(void);
+
+#endif
@@ -4,10 +4,13 @@ $co2 = Co2.new
 $thermistor = Thermistor.new
 
 led = Led.new(19)
+sensors = SensorRecord.new
+VM.scratch # loop temporaries from the task arena
 
 while true
-  co2 = $co2.concentrate
-  temperature = $thermistor.temperature
+  Sensors.snapshot_into(sensors, CO2_MAX_AGE)
+  co2 = sensors.co2
+  temperature = sensors.temperature
   puts "CO2: #{co2}, Temperature: #{temperature}"
   if co2 > 2000
     5.times do
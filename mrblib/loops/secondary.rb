@@ -1,16 +1,27 @@
 sleep 80 # wait until CO2 sensor is warmed up
 
 debugprint('start', 'sub_loop')
+sensors = SensorRecord.new
+VM.scratch # loop temporaries from the task arena
+health_wait = 0
 
 while true
-  co2 = $co2.concentrate
-  temperature = $thermistor.temperature
+  Sensors.snapshot_into(sensors, CO2_MAX_AGE)
+  co2 = sensors.co2
+  temperature = sensors.temperature
   if co2 > 0
     data = "co2=#{co2}&temperature=#{temperature}"
     puts "DATASEND:#{data}"
+    puts "HEALTH:#{VM.health}"
+    health_wait = 0
     debugprint("slave_loop", "debug")
     sleep 300
   else
+    health_wait += 3
+    if health_wait >= 300 # also while the sensor is not ready.
+      puts "HEALTH:#{VM.health}"
+      health_wait = 0
+    end
     sleep 3
   end
 end
@@ -1,13 +1,9 @@
+CO2_MAX_AGE = 5000 # ms. MH-Z19 does not update faster.
+
+# MH-Z19 on UART2, read by Sensors. (see main/sensors.c)
 class Co2
-  def initialize
-    @value = 0
-  end
+  # shared by tasks.
   def concentrate
-    res = get_co2
-    if res[0] == 255 && res[1] == 134
-      res[2] * 256 + res[3]
-    else
-      0
-    end
+    Sensors.snapshot(CO2_MAX_AGE).co2
   end
 end
@@ -1,7 +1,5 @@
-B = 3435
-To = 25
-V = 3300 # mV
-Rref = 10_000 # Ohm
+# B = 3435, To = 25, V = 3300 mV and Rref = 10k Ohm, in main/sensors.c
+THERMISTOR_MAX_AGE = 1000 # ms
 
 class Thermistor
   def initialize
@@ -10,9 +8,8 @@ class Thermistor
     init_adc
   end
 
+  # shared by tasks. (see main/sensors.c)
   def temperature
-    vref = read_adc
-    r = (V - vref).to_f / (vref.to_f/ Rref)
-    1.to_f / ( 1.to_f / B * Math.log(r / Rref) + 1.to_f / (To + 273) ) - 273
+    Sensors.snapshot(THERMISTOR_MAX_AGE).temperature
   end
 end
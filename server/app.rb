@@ -1,14 +1,44 @@
 require "sinatra"
 require "csv"
+require_relative "../log/health_record"
 
 set :bind, '0.0.0.0'
 
+HEALTH_CSV = "../log/health.csv"
+
 post "/data" do
   puts params
 end
 
+# health record of a device. (see log/health_record.rb)
+post "/health" do
+  device = request.user_agent || request.ip
+  CSV.open(HEALTH_CSV, "a") do |csv|
+    csv << HealthRecord.row(Time.now, device, params)
+  end
+  ""
+end
+
 get "/data", layout: false do
   csv = CSV.read("../log/data.csv")
   format = "%m/%d %H:%M"
   erb :data, content_type: :js, locals: {csv: csv, format: format}
 end
+
+# the worst of the fleet (or ?device=) in each minute.
+get "/health", layout: false do
+  format = "%m/%d %H:%M"
+  rows = File.exist?(HEALTH_CSV) ? CSV.read(HEALTH_CSV) : []
+  rows = rows.select { |r| r[1] == params["device"] } if params["device"]
+  health = rows.group_by { |r| Time.parse(r[0]).strftime(format) }.map do |time, rs|
+    { time: time,
+      devices: rs.map { |r| r[1] }.uniq.size,
+      heap_used: rs.map { |r| r[3].to_i }.max,
+      heap_largest: rs.map { |r| r[6].to_i }.min,
+      heap_frag: rs.map { |r| r[5].to_i }.max,
+      sym_used: rs.map { |r| r[7].to_i }.max,
+      overruns: rs.sum { |r| r[9].to_i },
+      cpu: rs.map { |r| HealthRecord.max_cpu(r[10]) }.max }
+  end
+  erb :health, content_type: :js, locals: {health: health, format: format}
+end
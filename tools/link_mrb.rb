@@ -0,0 +1,179 @@
+#
+# Link application byte code into one image, with shared symbol and
+# string pools. (see mrbc_load_mrb() in components/mrubyc/mrubyc_src/load.c)
+#
+#  ruby link_mrb.rb [-n image_name] [-o output.h] app.mrb|app.h ...
+#
+#   app.mrb, app.h  application byte code. (.mrb, or C source by mrbc -B)
+#   -n  name of the image array. (default mrblib_image)
+#   -o  output file. (default stdout)
+#
+# Each script is given as a pointer into the image, with the name of
+# mrbc -B (or the file name), so that mrbc_create_task(name, 0) works
+# same as with the header of mrbc -B.
+# Debug information (mrbc -g) is dropped.
+#
+require "optparse"
+
+# shared with load.c
+IMAGE_HEADER_SIZE = 18
+SYMS_LINKED = 0x8000_0000
+POOL_TT_STRING = 0
+POOL_TT_LINKED_STRING = 3
+NULL_SYM = 0xffff
+
+Irep = Struct.new(:nlocals, :nregs, :code, :pools, :syms, :reps)
+
+def read_bytecode(filename)
+  data = File.binread(filename)
+  return [data, File.basename(filename, ".*")] if data.start_with?("RITE")
+
+  # C source by mrbc -B
+  name = data[/extern\s+const\s+uint8_t\s+(\w+)\s*\[/, 1] || File.basename(filename, ".*")
+  body = data[/\{(.*)\}/m, 1] or raise "byte code not found in #{filename}"
+  [body.scan(/0x(\h\h)/).flatten.map(&:hex).pack("C*"), name]
+end
+
+def parse_irep(data, pos)
+  pos += 4                                      # record size
+  nlocals, nregs, rlen, ilen = data[pos, 10].unpack("nnnN")
+  pos += 10
+  pos += -pos & 3                               # padding
+  code = data[pos, ilen]
+  pos += ilen
+
+  plen = data[pos, 4].unpack1("N")
+  pos += 4
+  pools = plen.times.map do
+    tt, len = data[pos, 3].unpack("Cn")
+    value = data[pos + 3, len]
+    pos += 3 + len
+    [tt, value]
+  end
+
+  slen = data[pos, 4].unpack1("N")
+  pos += 4
+  syms = slen.times.map do
+    len = data[pos, 2].unpack1("n")
+    pos += 2
+    next nil if len == 0xffff
+    s = data[pos, len]
+    pos += len + 1
+    s
+  end
+
+  irep = Irep.new(nlocals, nregs, code, pools, syms, [])
+  rlen.times do
+    child, pos = parse_irep(data, pos)
+    irep.reps << child
+  end
+  [irep, pos]
+end
+
+def load_irep(filename)
+  data, name = read_bytecode(filename)
+  raise "#{filename} is not RITE0006" unless data.start_with?("RITE0006")
+  pos = 22
+  while pos < data.size
+    section, size = data[pos, 8].unpack("a4N")
+    return [parse_irep(data, pos + 12)[0], name] if section == "IREP"
+    break if section == "END\0"
+    pos += size
+  end
+  raise "IREP section not found in #{filename}"
+end
+
+def each_irep(irep, &block)
+  yield irep
+  irep.reps.each { |r| each_irep(r, &block) }
+end
+
+# length, data, '\0'. same as SYMS and string POOL entry.
+def entry(s)
+  [s.bytesize].pack("n") + s.b + "\0"
+end
+
+# write an irep tree at out.bytesize, out is the image from its top.
+def write_irep(out, irep, sym_index, str_index, sym_table_pos)
+  start = out.bytesize
+  out << [0, irep.nlocals, irep.nregs, irep.reps.size, irep.code.bytesize].pack("NnnnN")
+  out << "\0" * (-out.bytesize & 3)             # padding from the image top
+  out << irep.code
+
+  out << [irep.pools.size].pack("N")
+  irep.pools.each do |tt, value|
+    if tt == POOL_TT_STRING
+      out << [POOL_TT_LINKED_STRING, 2, str_index[value]].pack("Cnn")
+    else
+      out << [tt, value.bytesize].pack("Cn") << value
+    end
+  end
+
+  out << [SYMS_LINKED | irep.syms.size, out.bytesize - sym_table_pos].pack("NN")
+  out << irep.syms.map { |s| s ? sym_index[s] : NULL_SYM }.pack("n*")
+  out[start, 4] = [out.bytesize - start].pack("N")
+
+  irep.reps.each { |r| write_irep(out, r, sym_index, str_index, sym_table_pos) }
+end
+
+image_name = "mrblib_image"
+output = nil
+OptionParser.new do |opt|
+  opt.banner = "usage: ruby #{$0} [-n image_name] [-o output.h] app.mrb ..."
+  opt.on("-n NAME") { |v| image_name = v }
+  opt.on("-o FILE") { |v| output = v }
+end.parse!(ARGV)
+abort "no application byte code." if ARGV.empty?
+
+scripts = ARGV.map { |f| load_irep(f) }
+
+# shared pools, in order of appearance.
+sym_index = {}
+str_index = {}
+scripts.each do |irep, _|
+  each_irep(irep) do |r|
+    r.syms.each { |s| sym_index[s] ||= sym_index.size if s }
+    r.pools.each { |tt, v| str_index[v] ||= str_index.size if tt == POOL_TT_STRING }
+  end
+end
+abort "too many symbols." if sym_index.size >= NULL_SYM
+abort "too many strings." if str_index.size > 0xffff
+
+# header and tables.
+#  "MRBL" "0001" total size, n of scripts, n of symbols, n of strings
+sym_table_pos = IMAGE_HEADER_SIZE
+str_table_pos = sym_table_pos + 4 * sym_index.size
+entries_pos = str_table_pos + 4 * str_index.size
+
+out = +"".b
+out << ["MRBL", "0001", 0, scripts.size, sym_index.size, str_index.size].pack("a4a4Nnnn")
+pos = entries_pos
+sym_index.keys.each { |s| out << [pos - sym_table_pos].pack("N"); pos += entry(s).bytesize }
+str_index.keys.each { |s| out << [pos - str_table_pos].pack("N"); pos += entry(s).bytesize }
+sym_index.keys.each { |s| out << entry(s) }
+str_index.keys.each { |s| out << entry(s) }
+
+# scripts. "MRBS" and offset from the image top, then IREP records.
+offsets = {}
+scripts.each do |irep, name|
+  abort "duplicated script name #{name}." if offsets[name]
+  offsets[name] = out.bytesize
+  out << ["MRBS", out.bytesize].pack("a4N")
+  write_irep(out, irep, sym_index, str_index, sym_table_pos)
+end
+out << "END\0"
+out[8, 4] = [out.bytesize].pack("N")
+
+src = +"/* generated by tools/link_mrb.rb. DO NOT EDIT. */\n"
+src << "#include <stdint.h>\n"
+src << "static const uint8_t #{image_name}[] = {\n"
+out.bytes.each_slice(16) { |l| src << "  " << l.map { |b| format("0x%02x,", b) }.join(" ") << "\n" }
+src << "};\n"
+offsets.each { |name, ofs| src << "#define #{name} (#{image_name} + #{ofs})\n" }
+src << "/* #{sym_index.size} symbols, #{str_index.size} strings, #{out.bytesize} bytes. */\n"
+
+if output
+  File.write(output, src)
+else
+  print src
+end
@@ -0,0 +1,202 @@
+#
+# Generate the list of built-in methods used by the application.
+# (see mrbc_set_used_methods() in components/mrubyc/mrubyc_src/class.c)
+#
+#  ruby used_methods.rb [-m mrblib.c] [-k keep_file] [-o output.h] app.mrb|app.h ...
+#
+#   app.mrb, app.h  application byte code. (.mrb, or C source by mrbc -B)
+#   -m  mruby/c mrblib byte code. method bodies in mrblib are followed,
+#       only when the method name is used.
+#   -k  names of methods to keep always. (one name in a line, # is comment)
+#       e.g. names called by send with a computed name.
+#   -o  output file. (default stdout)
+#
+require "optparse"
+
+# operand formats of mruby 2.0 opcodes. (see opcode.h)
+OPERANDS = %w(
+  Z BB BB BB BB B B B B B B B B B BB B
+  B B B BB BB BB BB BB BB BB BB BB BB BB BB BBB
+  BBB S BS BS BS S B BB B B B B BB BB BBB BBB
+  Z BB BS W BB Z BB B B B BS B BB B BB B
+  B B B B B B BB BBB B B B BBB BBB BBB B BB
+  B BB BB B BB BB BB B B B BB BB BB BB BB B
+  B B BBB B Z Z Z Z
+)
+OP_METHOD  = 0x56
+OP_DEF     = 0x5d
+OP_ALIAS   = 0x5e
+OP_EXT1, OP_EXT2, OP_EXT3 = 0x64, 0x65, 0x66
+
+# methods called by name from the VM and C methods.
+# (+ and * have no symbol in OP_ADD and OP_MUL, sent by name for non-numbers)
+IMPLICIT = %w(initialize to_s inspect kind_of? call new == === <=> + *)
+
+Irep = Struct.new(:code, :syms, :reps)
+
+def read_bytecode(filename)
+  data = File.binread(filename)
+  return data if data.start_with?("RITE")
+
+  # C source by mrbc -B
+  body = data[/\{(.*)\}/m, 1] or raise "byte code not found in #{filename}"
+  body.scan(/0x(\h\h)/).flatten.map(&:hex).pack("C*")
+end
+
+def parse_irep(data, pos)
+  pos += 4                                      # record size
+  _nlocals, _nregs, rlen, ilen = data[pos, 10].unpack("nnnN")
+  pos += 10
+  pos += -pos & 3                               # padding
+  code = data[pos, ilen]
+  pos += ilen
+
+  plen = data[pos, 4].unpack1("N")
+  pos += 4
+  plen.times do
+    pos += 3 + data[pos + 1, 2].unpack1("n")
+  end
+
+  slen = data[pos, 4].unpack1("N")
+  pos += 4
+  syms = slen.times.map do
+    len = data[pos, 2].unpack1("n")
+    pos += 2
+    next nil if len == 0xffff
+    s = data[pos, len]
+    pos += len + 1
+    s
+  end
+
+  irep = Irep.new(code, syms, [])
+  rlen.times do
+    child, pos = parse_irep(data, pos)
+    irep.reps << child
+  end
+  [irep, pos]
+end
+
+def load_irep(filename)
+  data = read_bytecode(filename)
+  pos = 22
+  while pos < data.size
+    section, size = data[pos, 8].unpack("a4N")
+    return parse_irep(data, pos + 12)[0] if section == "IREP"
+    break if section == "END\0"
+    pos += size
+  end
+  raise "IREP section not found in #{filename}"
+end
+
+# decode instructions. yields opcode and operands.
+def each_op(code)
+  pc = 0
+  ext = 0
+  while pc < code.size
+    op = code.getbyte(pc)
+    pc += 1
+    if (OP_EXT1..OP_EXT3).cover?(op)
+      ext = op - OP_EXT1 + 1
+      next
+    end
+    operands = OPERANDS[op].chars.each_with_index.map do |t, i|
+      size = { "B" => 1, "S" => 2, "W" => 3, "Z" => 0 }[t]
+      size = 2 if t == "B" && i < 2 && ext[i] == 1
+      v = code[pc, size].bytes.inject(0) { |a, b| a << 8 | b }
+      pc += size
+      t == "Z" ? nil : v
+    end.compact
+    ext = 0
+    yield op, *operands
+  end
+end
+
+def all_syms(irep)
+  irep.syms.compact + irep.reps.flat_map { |r| all_syms(r) }
+end
+
+# collect method definitions in mrblib.
+#  always: symbols used outside of method bodies.
+#  methods: name => [symbols used in the body]
+#  aliases: new name => old name
+def scan_mrblib(irep, always, methods, aliases)
+  method_reg = {}
+  def_targets = []
+  each_op(irep.code) do |op, a, b|
+    case op
+    when OP_METHOD
+      method_reg[a] = b
+    when OP_DEF
+      name = irep.syms[b]
+      body = irep.reps[method_reg[a + 1]]
+      (methods[name] ||= []).concat(all_syms(body))
+      def_targets << b
+    when OP_ALIAS
+      (aliases[irep.syms[a]] ||= []) << irep.syms[b]
+      def_targets << a << b
+    end
+  end
+
+  irep.syms.each_with_index do |s, i|
+    always << s if s && !def_targets.include?(i)
+  end
+  bodies = method_reg.values
+  irep.reps.each_with_index do |r, i|
+    scan_mrblib(r, always, methods, aliases) unless bodies.include?(i)
+  end
+end
+
+mrblib = nil
+keep_file = nil
+output = nil
+OptionParser.new do |opt|
+  opt.banner = "usage: ruby #{$0} [-m mrblib.c] [-k keep_file] [-o output.h] app.mrb ..."
+  opt.on("-m FILE") { |v| mrblib = v }
+  opt.on("-k FILE") { |v| keep_file = v }
+  opt.on("-o FILE") { |v| output = v }
+end.parse!(ARGV)
+abort "no application byte code." if ARGV.empty?
+
+used = {}
+IMPLICIT.each { |s| used[s] = true }
+ARGV.each { |f| all_syms(load_irep(f)).each { |s| used[s] = true } }
+if keep_file
+  File.foreach(keep_file) do |line|
+    name = line.sub(/#.*/, "").strip
+    used[name] = true unless name.empty?
+  end
+end
+
+if mrblib
+  always = []
+  methods = {}
+  aliases = {}
+  scan_mrblib(load_irep(mrblib), always, methods, aliases)
+  always.each { |s| used[s] = true }
+
+  # follow method bodies until no more names are added.
+  loop do
+    added = false
+    used.keys.each do |name|
+      ((methods[name] || []) + (aliases[name] || [])).each do |s|
+        next if used[s]
+        used[s] = true
+        added = true
+      end
+    end
+    break unless added
+  end
+end
+
+names = used.keys.sort  # byte order, same as strcmp()
+src = +"/* generated by tools/used_methods.rb. DO NOT EDIT. */\n"
+src << "static const char * const used_methods[] = {\n"
+names.each { |s| src << "  #{s.dump},\n" }
+src << "};\n"
+src << "#define USED_METHODS_SIZE (sizeof(used_methods) / sizeof(used_methods[0]))\n"
+
+if output
+  File.write(output, src)
+else
+  print src
+end